@@ -0,0 +1,62 @@
+// CompactRoute.h
+
+// A route as the EdgeIds of the StreetGraph it runs over, start to end, plus its length. That is 4 bytes a
+// segment, where a list<StreetSegment> costs a list node, four strings of coordinate text and a street name
+// for every segment. Segments are looked at through SegmentRefs, which read the graph directly, and the
+// legacy list<StreetSegment> is only built if a caller asks for it with toStreetSegments().
+//
+// assign() reuses the edge vector's capacity, so a CompactRoute that is routed into over and over stops
+// allocating once it has grown to fit the longest route.
+
+#ifndef COMPACTROUTE_INCLUDED
+#define COMPACTROUTE_INCLUDED
+
+#include "StreetGraph.h"
+#include <list>
+#include <vector>
+
+class CompactRoute
+{
+public:
+    CompactRoute() : m_graph(nullptr), m_distance(0) {}
+
+        // Makes this the route along edges[0, length) of graph, adding up its length
+    void assign(const StreetGraph* graph, const EdgeId* edges, size_t length) {
+        m_graph = graph;
+        m_edges.assign(edges, edges + length);
+        m_distance = 0;
+        for (EdgeId e : m_edges) {
+            m_distance += graph->edgeLength(e);
+        }
+    }
+    void clear() {
+        m_edges.clear();
+        m_distance = 0;
+    }
+
+    const StreetGraph* graph() const { return m_graph; }
+    const std::vector<EdgeId>& edges() const { return m_edges; }
+    size_t size() const { return m_edges.size(); }
+    bool empty() const { return m_edges.empty(); }
+    double distance() const { return m_distance; }      // in miles
+
+    SegmentRef operator[](size_t i) const { return SegmentRef(m_graph, m_edges[i]); }
+    NodeId startNode() const { return m_graph->edgeSource(m_edges.front()); }      // the route mustn't be empty
+    NodeId endNode() const { return m_graph->edgeTarget(m_edges.back()); }
+
+        // The route as the legacy list of StreetSegments, strings and all
+    std::list<StreetSegment> toStreetSegments() const {
+        std::list<StreetSegment> segments;
+        for (EdgeId e : m_edges) {
+            segments.push_back(SegmentRef(m_graph, e).toStreetSegment());
+        }
+        return segments;
+    }
+
+private:
+    const StreetGraph* m_graph;
+    std::vector<EdgeId> m_edges;
+    double m_distance;
+};
+
+#endif // COMPACTROUTE_INCLUDED
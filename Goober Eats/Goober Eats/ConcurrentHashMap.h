@@ -0,0 +1,482 @@
+// ConcurrentHashMap.h
+
+// A thread-safe sibling of ExpandableHashMap, for maps that many threads read at once while a few write
+// to them (shared caches, indexes of live orders, ...). associate() and find() mean the same thing as they
+// do in ExpandableHashMap, and any number of threads may call them concurrently.
+//
+//  - The keys are spread over a fixed number of shards, each an open addressing table with its own mutex.
+//    Writers lock only the shard their key is in.
+//  - Readers never lock. Every slot has a version number that a writer makes odd while it changes the
+//    slot, and a reader copies the slot out and then checks the version didn't change (a seqlock). For that
+//    copy to be safe, the keys and values have to be trivially copyable, and find() returns a copy of the
+//    value rather than a pointer into the map.
+//  - When a shard grows, the writer fills a new table and swaps it in, and readers that are part way through
+//    the old one keep using it. The old table is freed by the EpochDomain once no reader can still be in it.
+
+#ifndef CONCURRENTHASHMAP_INCLUDED
+#define CONCURRENTHASHMAP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+    // Misuse that would otherwise run off the end of an array or hang a probe loop ends the program, release builds included
+[[noreturn]] inline void concurrentHashMapFailure(const char* message)
+{
+    std::fprintf(stderr, "ConcurrentHashMap: %s\n", message);
+    std::abort();
+}
+
+    // Epoch based reclamation, shared by every ConcurrentHashMap
+    // A reader announces the current epoch before it loads a table pointer, and withdraws it when it is done.
+    // Retiring a table advances the epoch, so once every announced epoch is newer than the retirement,
+    // no reader can still hold a pointer to the table and it is deleted.
+class EpochDomain
+{
+    struct ThreadRecord;
+
+public:
+    static const size_t MAX_THREADS = 512;
+
+    static EpochDomain& instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+        // Marks the calling thread as reading until the guard goes out of scope
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        ThreadRecord& m_record;
+    };
+
+        // Hands ptr to the domain to be deleted once no reader can still see it
+        // The caller must already have unpublished ptr, so that new readers can't find it
+    template<typename T>
+    void retire(T* ptr) {
+        std::lock_guard<std::mutex> lock(m_retiredMutex);
+        uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        m_retired.push_back(Retired{epoch, ptr, [](void* p) { delete static_cast<T*>(p); }});
+        reclaim();
+    }
+
+    ~EpochDomain() {
+        for (Retired& r : m_retired) {
+            r.deleter(r.ptr);
+        }
+    }
+
+private:
+    static const uint64_t QUIESCENT = UINT64_MAX;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{QUIESCENT};
+        std::atomic<bool> inUse{false};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* ptr;
+        void (*deleter)(void*);
+    };
+
+    std::atomic<uint64_t> m_epoch{1};
+    Slot m_slots[MAX_THREADS];
+    std::atomic<size_t> m_slotsUsed{0};     // every slot a thread has ever held is below this
+
+    std::mutex m_retiredMutex;
+    std::vector<Retired> m_retired;
+
+    EpochDomain() {}
+
+        // Each thread holds one slot from its first read until it exits
+    static ThreadRecord& threadRecord();
+
+        // Deletes everything retired before the oldest epoch a reader has announced; m_retiredMutex must be held
+    void reclaim() {
+        uint64_t oldest = QUIESCENT;
+        size_t used = m_slotsUsed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < used; i++) {
+            uint64_t epoch = m_slots[i].epoch.load(std::memory_order_seq_cst);
+            if (epoch < oldest) {
+                oldest = epoch;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < m_retired.size(); i++) {
+            if (m_retired[i].epoch < oldest) {
+                m_retired[i].deleter(m_retired[i].ptr);
+            } else {
+                m_retired[kept++] = m_retired[i];
+            }
+        }
+        m_retired.resize(kept);
+    }
+};
+
+struct EpochDomain::ThreadRecord {
+    size_t slot;
+    unsigned depth;
+
+    ThreadRecord() : depth(0) {
+        EpochDomain& domain = instance();
+        for (slot = 0; slot < MAX_THREADS; slot++) {
+            bool expected = false;
+            if (domain.m_slots[slot].inUse.compare_exchange_strong(expected, true)) {
+                break;
+            }
+        }
+        if (slot == MAX_THREADS) {
+            concurrentHashMapFailure("more threads that have read are still running than there are epoch slots");
+        }
+
+        size_t used = domain.m_slotsUsed.load();
+        while (used < slot + 1 && !domain.m_slotsUsed.compare_exchange_weak(used, slot + 1)) {}
+    }
+
+    ~ThreadRecord() {
+        EpochDomain& domain = instance();
+        domain.m_slots[slot].epoch.store(QUIESCENT, std::memory_order_release);
+        domain.m_slots[slot].inUse.store(false, std::memory_order_release);
+    }
+};
+
+inline EpochDomain::ThreadRecord& EpochDomain::threadRecord()
+{
+    thread_local ThreadRecord record;
+    return record;
+}
+
+inline EpochDomain::Guard::Guard() : m_record(threadRecord())
+{
+    if (m_record.depth++ == 0) {
+        EpochDomain& domain = instance();
+        domain.m_slots[m_record.slot].epoch.store(domain.m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+}
+
+inline EpochDomain::Guard::~Guard()
+{
+    if (--m_record.depth == 0) {
+        instance().m_slots[m_record.slot].epoch.store(QUIESCENT, std::memory_order_release);
+    }
+}
+
+template<typename KeyType, typename ValueType>
+class ConcurrentHashMap
+{
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                  "readers copy slots while they may be being written, so keys and values must be trivially copyable");
+    static_assert(std::is_default_constructible<KeyType>::value && std::is_default_constructible<ValueType>::value,
+                  "readers copy slots into default constructed keys and values");
+
+public:
+        // constructor
+        // The number of shards is rounded up to a power of 2; more shards means less contention between writers
+        // maximumLoadFactor must be above 0 and below 1, or a full shard's probe loops would never end
+    ConcurrentHashMap(double maximumLoadFactor = 0.5, unsigned int shardCount = 64);
+        // destructor; deletes all of the items in the hashmap
+        // No other thread may be using the hashmap by now
+    ~ConcurrentHashMap();
+
+        // resets every shard back to 8 slots, deletes all items
+    void reset();
+        // return the number of associations in the hashmap
+        // While writers are running this is only a snapshot
+    int size() const;
+
+        // The associate method associates one item (key) with another (value).
+        // If no association currently exists with that key, this method inserts
+        // a new association into the hashmap with that key-value pair.
+        // If there is already an association with that key in the hashmap, then
+        // the item associated with that key is replaced by the second parameter
+        // (the value), i.e. it is updated
+    void associate(const KeyType& key, const ValueType& value);
+
+        // If no association exists with the given key, return false; otherwise,
+        // copy the value associated with that key into value and return true.
+        // A pointer into the map wouldn't stay valid once another thread updates or moves the value
+    bool find(const KeyType& key, ValueType& value) const;
+
+        // Approximate number of bytes of heap memory held by the hashmap
+    size_t memoryUsage() const;
+
+      // C++11 syntax for preventing copying and assignment
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+private:
+    static const size_t KEY_WORDS = (sizeof(KeyType) + 7) / 8;
+    static const size_t VALUE_WORDS = (sizeof(ValueType) + 7) / 8;
+
+        // The key and value are stored as atomic words, so that readers copying them while a writer
+        //      changes them is well defined; the version number tells the reader whether that happened
+    struct Slot {
+        std::atomic<uint32_t> version{0};   // 0 if empty, odd while a writer is changing the slot, even and > 0 otherwise
+        std::atomic<uint32_t> hash{0};
+        std::atomic<uint64_t> key[KEY_WORDS];
+        std::atomic<uint64_t> value[VALUE_WORDS];
+    };
+
+    struct Table {
+        explicit Table(size_t capacity) : slots(new Slot[capacity]), capacity(capacity) {}
+        ~Table() { delete [] slots; }
+        Slot* slots;
+        size_t capacity;                    // always a power of 2
+    };
+
+    struct alignas(64) Shard {
+        std::atomic<Table*> table{nullptr};
+        std::mutex writeMutex;
+        std::atomic<size_t> size{0};
+    };
+
+    Shard* m_shards;
+    unsigned int m_shardBits;
+    double m_maxLoadFactor;
+
+    static unsigned int getHash(const KeyType& key) {
+        unsigned int hasher(const KeyType& k);
+        return hasher(key);
+    }
+
+        // The top bits of the scrambled hash pick the shard, and the bottom bits the home slot in it
+    Shard& getShard(unsigned int h) const {
+        return m_shards[m_shardBits == 0 ? 0 : static_cast<uint32_t>(h * 2654435769u) >> (32 - m_shardBits)];
+    }
+
+    template<typename T, size_t WORDS>
+    static void load(const std::atomic<uint64_t> (&words)[WORDS], T& out);
+    template<typename T, size_t WORDS>
+    static void store(std::atomic<uint64_t> (&words)[WORDS], const T& in);
+
+    static Slot* findSlot(const Table* table, const KeyType& key, unsigned int h);
+    void grow(Shard& shard);
+};
+
+template <typename KeyType, typename ValueType>
+ConcurrentHashMap<KeyType, ValueType>::ConcurrentHashMap(double maximumLoadFactor, unsigned int shardCount) : m_shardBits(0), m_maxLoadFactor(maximumLoadFactor)
+{
+    if (!(maximumLoadFactor > 0 && maximumLoadFactor < 1)) {
+        concurrentHashMapFailure("the maximum load factor must be above 0 and below 1");
+    }
+    while ((1u << m_shardBits) < shardCount) {
+        m_shardBits++;
+    }
+    m_shards = new Shard[size_t(1) << m_shardBits];
+    for (size_t i = 0; i < (size_t(1) << m_shardBits); i++) {
+        m_shards[i].table.store(new Table(8));
+    }
+}
+
+template <typename KeyType, typename ValueType>
+ConcurrentHashMap<KeyType, ValueType>::~ConcurrentHashMap()
+{
+    for (size_t i = 0; i < (size_t(1) << m_shardBits); i++) {
+        delete m_shards[i].table.load();
+    }
+    delete [] m_shards;
+}
+
+template <typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::reset()
+{
+    for (size_t i = 0; i < (size_t(1) << m_shardBits); i++) {
+        Shard& shard = m_shards[i];
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        Table* old = shard.table.exchange(new Table(8), std::memory_order_seq_cst);
+        shard.size.store(0, std::memory_order_relaxed);
+        EpochDomain::instance().retire(old);
+    }
+}
+
+template <typename KeyType, typename ValueType>
+int ConcurrentHashMap<KeyType, ValueType>::size() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < (size_t(1) << m_shardBits); i++) {
+        total += m_shards[i].size.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(total);
+}
+
+template <typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+{
+    unsigned int h = getHash(key);
+    Shard& shard = getShard(h);
+    std::lock_guard<std::mutex> lock(shard.writeMutex);
+
+        // Only writers holding the shard's mutex change the table pointer, so we don't need an epoch guard here
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    Slot* slot = findSlot(table, key, h);
+
+    // Whether we are updating an association or creating a new one, we make the slot's version odd
+    //      while we write to it, so readers know to try again
+    uint32_t version = slot->version.load(std::memory_order_relaxed);
+    slot->version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (version == 0) {
+        slot->hash.store(h, std::memory_order_relaxed);
+        store(slot->key, key);
+    }
+    store(slot->value, value);
+    slot->version.store(version + 2 == 0 ? 2 : version + 2, std::memory_order_release);     // never back to "empty"
+
+    // Grow the shard if we exceed maxLoadFactor
+    if (version == 0) {
+        size_t size = shard.size.load(std::memory_order_relaxed) + 1;
+        shard.size.store(size, std::memory_order_relaxed);
+        if (static_cast<double>(size) / table->capacity > m_maxLoadFactor) {
+            grow(shard);
+        }
+    }
+}
+
+template <typename KeyType, typename ValueType>
+bool ConcurrentHashMap<KeyType, ValueType>::find(const KeyType& key, ValueType& value) const
+{
+    unsigned int h = getHash(key);
+    const Shard& shard = getShard(h);
+
+    EpochDomain::Guard guard;
+    const Table* table = shard.table.load(std::memory_order_seq_cst);
+    size_t mask = table->capacity - 1;
+
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        const Slot& slot = table->slots[i];
+        for (;;) {
+            uint32_t before = slot.version.load(std::memory_order_acquire);
+            if (before == 0) {
+                return false;   // the end of the probe sequence; the key isn't here (yet)
+            }
+            if (before & 1) {
+                std::this_thread::yield();      // a writer is part way through this slot
+                continue;
+            }
+
+                // Keys and hashes never change once the slot has been filled, so only the value can tear
+            if (slot.hash.load(std::memory_order_relaxed) != h) {
+                break;
+            }
+            KeyType slotKey;
+            load(slot.key, slotKey);
+            if (!(slotKey == key)) {
+                break;
+            }
+
+            ValueType copy;
+            load(slot.value, copy);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.version.load(std::memory_order_relaxed) == before) {
+                value = copy;
+                return true;
+            }
+        }
+    }
+}
+
+template <typename KeyType, typename ValueType>
+size_t ConcurrentHashMap<KeyType, ValueType>::memoryUsage() const
+{
+    EpochDomain::Guard guard;
+    size_t total = (size_t(1) << m_shardBits) * sizeof(Shard);
+    for (size_t i = 0; i < (size_t(1) << m_shardBits); i++) {
+        total += m_shards[i].table.load(std::memory_order_seq_cst)->capacity * sizeof(Slot);
+    }
+    return total;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+template <typename KeyType, typename ValueType>
+template<typename T, size_t WORDS>
+void ConcurrentHashMap<KeyType, ValueType>::load(const std::atomic<uint64_t> (&words)[WORDS], T& out)
+{
+    uint64_t buffer[WORDS];
+    for (size_t i = 0; i < WORDS; i++) {
+        buffer[i] = words[i].load(std::memory_order_relaxed);
+    }
+    std::memcpy(static_cast<void*>(&out), buffer, sizeof(T));
+}
+
+template <typename KeyType, typename ValueType>
+template<typename T, size_t WORDS>
+void ConcurrentHashMap<KeyType, ValueType>::store(std::atomic<uint64_t> (&words)[WORDS], const T& in)
+{
+    uint64_t buffer[WORDS] = {};
+    std::memcpy(buffer, static_cast<const void*>(&in), sizeof(T));
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+}
+
+    // The slot holding key, or the empty slot it would go in; only called by writers
+template <typename KeyType, typename ValueType>
+typename ConcurrentHashMap<KeyType, ValueType>::Slot* ConcurrentHashMap<KeyType, ValueType>::findSlot(const Table* table, const KeyType& key, unsigned int h)
+{
+    size_t mask = table->capacity - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        Slot* slot = &table->slots[i];
+        if (slot->version.load(std::memory_order_relaxed) == 0) {
+            return slot;
+        }
+        if (slot->hash.load(std::memory_order_relaxed) == h) {
+            KeyType slotKey;
+            load(slot->key, slotKey);
+            if (slotKey == key) {
+                return slot;
+            }
+        }
+    }
+}
+
+    // Copies the shard into a table twice the size, publishes it, and retires the old one
+    // Readers still in the old table see a consistent (if soon out of date) map, since writers no longer touch it
+template <typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::grow(Shard& shard)
+{
+    Table* old = shard.table.load(std::memory_order_relaxed);
+    Table* bigger = new Table(old->capacity * 2);
+    size_t mask = bigger->capacity - 1;
+
+    for (size_t i = 0; i < old->capacity; i++) {
+        const Slot& from = old->slots[i];
+        if (from.version.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        uint32_t h = from.hash.load(std::memory_order_relaxed);
+        size_t j = h & mask;
+        while (bigger->slots[j].version.load(std::memory_order_relaxed) != 0) {
+            j = (j + 1) & mask;
+        }
+        Slot& to = bigger->slots[j];
+        to.hash.store(h, std::memory_order_relaxed);
+        for (size_t w = 0; w < KEY_WORDS; w++) {
+            to.key[w].store(from.key[w].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        for (size_t w = 0; w < VALUE_WORDS; w++) {
+            to.value[w].store(from.value[w].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        to.version.store(2, std::memory_order_relaxed);
+    }
+
+        // The seq_cst store publishes every slot written above, and orders it before the retirement's epoch change
+    shard.table.store(bigger, std::memory_order_seq_cst);
+    EpochDomain::instance().retire(old);
+}
+
+#endif // CONCURRENTHASHMAP_INCLUDED
@@ -0,0 +1,711 @@
+#include "ContractionHierarchy.h"
+#include "IndexedHeap.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+using namespace std;
+
+/////////////////////////////////////////////////
+// Hierarchy file format
+/////////////////////////////////////////////////
+    // The header, followed by the arcs, the up offsets and edges, and the down offsets and edges, in that order
+    // The checksum is FNV-1a over everything after the header
+struct HierarchyHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint64_t fingerprint;
+    uint64_t arcCount;
+    uint64_t upEdgeCount;
+    uint64_t downEdgeCount;
+    uint64_t shortcutCount;
+    uint64_t checksum;
+};
+
+const char HIERARCHY_MAGIC[8] = { 'G', 'O', 'O', 'B', 'C', 'H', '\0', '\0' };
+const uint32_t HIERARCHY_VERSION = 2;   // 2 added the checksum
+
+    // Carries an FNV-1a hash on over size more bytes, so that a file's checksum can be worked out one array at a time
+uint64_t fnv1aContinue(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+    // A witness search gives up after settling this many nodes, and the shortcut it was checking is added anyway
+    // That can only cost an unnecessary shortcut, never a wrong answer
+const int WITNESS_SETTLE_LIMIT = 500;
+    // Working out a node's priority only estimates the shortcuts it needs, so it searches less far (most witnesses
+    //      are found within a few nodes, and this makes preprocessing several times faster for the same hierarchy)
+const int SIMULATION_SETTLE_LIMIT = 20;
+
+    // Identifies a graph by its size and every edge's ends and length (FNV-1a over them)
+uint64_t graphFingerprint(const StreetGraph& graph)
+{
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            h ^= (value >> (8 * i)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    };
+
+    mix(graph.nodeCount());
+    mix(graph.edgeCount());
+    for (EdgeId e = 0; e < graph.edgeCount(); e++) {
+        double length = graph.edgeLength(e);
+        uint64_t lengthBits;
+        memcpy(&lengthBits, &length, sizeof(lengthBits));
+        mix((static_cast<uint64_t>(graph.edgeSource(e)) << 32) | graph.edgeTarget(e));
+        mix(lengthBits);
+    }
+    return h;
+}
+
+/////////////////////////////////////////////////
+// Preprocessing
+/////////////////////////////////////////////////
+    // Contracts a copy of the graph node by node, filling in a ContractionHierarchy
+    // The next node contracted is always the one whose contraction would change the graph least: the fewest shortcuts
+    //      added for the arcs it takes away, favouring nodes low in the hierarchy built so far (so it stays shallow;
+    //      without this, long chains of streets get contracted one end to the other, and preprocessing mapdata.txt
+    //      takes minutes instead of a second)
+class ContractionBuilder
+{
+public:
+    ContractionBuilder(const StreetGraph& graph, ContractionHierarchy& ch);
+    void build();
+
+private:
+    typedef ContractionHierarchy::Arc Arc;
+    typedef ContractionHierarchy::HierarchyEdge HierarchyEdge;
+
+        // An edge or shortcut between two nodes that haven't been contracted yet
+    struct RemainingEdge {
+        NodeId node;            // the other end
+        double length;
+        uint32_t arc;
+    };
+
+    const StreetGraph& m_graph;
+    ContractionHierarchy& m_ch;
+
+    vector<vector<RemainingEdge>> m_out;        // what is left of the graph
+    vector<vector<RemainingEdge>> m_in;
+    vector<vector<HierarchyEdge>> m_up;         // the arcs each contracted node had left when it was contracted
+    vector<vector<HierarchyEdge>> m_down;
+    vector<uint32_t> m_level;                   // 1 + the highest level of a contracted neighbour
+    IndexedHeap<double> m_queue;                // the nodes not contracted yet, by priority
+
+        // State of the latest witness search
+    vector<double> m_distance;
+    vector<uint32_t> m_reached;                 // the search that set each m_distance
+    vector<uint32_t> m_target;                  // the search each node was last a target of
+    uint32_t m_search;
+    IndexedHeap<double> m_witnessSet;
+
+    uint32_t addArc(NodeId source, NodeId target, double length, EdgeId edge, uint32_t first, uint32_t second);
+    int contract(NodeId v, bool addShortcuts, int& hops);
+    double priority(NodeId v);
+    void contractNode(NodeId v);
+    void witnessSearch(NodeId source, NodeId avoid, double maxLength, int settleLimit);
+    void addShortcut(NodeId from, NodeId to, double length, uint32_t first, uint32_t second);
+};
+
+ContractionBuilder::ContractionBuilder(const StreetGraph& graph, ContractionHierarchy& ch)
+ : m_graph(graph), m_ch(ch), m_out(graph.nodeCount()), m_in(graph.nodeCount()), m_up(graph.nodeCount()), m_down(graph.nodeCount()),
+   m_level(graph.nodeCount(), 0), m_queue(graph.nodeCount()),
+   m_distance(graph.nodeCount(), 0), m_reached(graph.nodeCount(), 0), m_target(graph.nodeCount(), 0), m_search(0), m_witnessSet(graph.nodeCount())
+{}
+
+void ContractionBuilder::build()
+{
+    size_t nNodes = m_graph.nodeCount();
+
+        // Copy the graph, keeping only the shortest of any parallel edges (the first, if they tie, like A* does)
+        //      and leaving out edges from a node to itself, which no shortest path uses
+    for (NodeId u = 0; u < nNodes; u++) {
+        for (EdgeId e = m_graph.edgeBegin(u); e != m_graph.edgeEnd(u); e++) {
+            NodeId v = m_graph.edgeTarget(e);
+            if (v == u) {
+                continue;
+            }
+            auto existing = find_if(m_out[u].begin(), m_out[u].end(), [v](const RemainingEdge& edge) { return edge.node == v; });
+            if (existing == m_out[u].end()) {
+                m_out[u].push_back(RemainingEdge{v, m_graph.edgeLength(e), e});
+            } else if (m_graph.edgeLength(e) < existing->length) {
+                *existing = RemainingEdge{v, m_graph.edgeLength(e), e};
+            }
+        }
+    }
+    for (NodeId u = 0; u < nNodes; u++) {
+        for (RemainingEdge& edge : m_out[u]) {
+            edge.arc = addArc(u, edge.node, edge.length, edge.arc, 0, 0);
+            m_in[edge.node].push_back(RemainingEdge{u, edge.length, edge.arc});
+        }
+    }
+
+    for (NodeId v = 0; v < nNodes; v++) {
+        m_queue.push(v, priority(v));
+    }
+
+    while (!m_queue.empty()) {
+            // Contracting other nodes may have changed this one's priority since it was last worked out;
+            //      if it has gone up, put it back and look again
+        NodeId v = m_queue.top();
+        double p = priority(v);
+        if (p > m_queue.topPriority()) {
+            m_queue.update(v, p);
+            if (m_queue.top() != v) {
+                continue;
+            }
+        }
+        m_queue.pop();
+        contractNode(v);
+    }
+
+        // Pack each node's arcs into the hierarchy's CSR arrays
+    m_ch.m_upOffsets.assign(1, 0);
+    m_ch.m_downOffsets.assign(1, 0);
+    m_ch.m_shortcutCount = 0;
+    for (NodeId v = 0; v < nNodes; v++) {
+        for (const HierarchyEdge& edge : m_up[v]) {
+            m_ch.m_upEdges.push_back(edge);
+            m_ch.m_shortcutCount += (m_ch.m_arcs[edge.arc].edge == NO_EDGE);
+        }
+        for (const HierarchyEdge& edge : m_down[v]) {
+            m_ch.m_downEdges.push_back(edge);
+            m_ch.m_shortcutCount += (m_ch.m_arcs[edge.arc].edge == NO_EDGE);
+        }
+        m_ch.m_upOffsets.push_back(static_cast<uint32_t>(m_ch.m_upEdges.size()));
+        m_ch.m_downOffsets.push_back(static_cast<uint32_t>(m_ch.m_downEdges.size()));
+    }
+}
+
+uint32_t ContractionBuilder::addArc(NodeId source, NodeId target, double length, EdgeId edge, uint32_t first, uint32_t second)
+{
+    uint32_t edgeCount = (edge != NO_EDGE) ? 1 : m_ch.m_arcs[first].edgeCount + m_ch.m_arcs[second].edgeCount;
+    m_ch.m_arcs.push_back(Arc{source, target, length, edge, first, second, edgeCount});
+    return static_cast<uint32_t>(m_ch.m_arcs.size() - 1);
+}
+
+    // Works out which shortcuts contracting v needs, and adds them if addShortcuts is true; returns how many it needs,
+    //      and sets hops to how many of the graph's edges they would stand for between them
+    // For every pair of neighbours u -> v -> w, a shortcut u -> w is needed unless a search from u that avoids v
+    //      finds a path to w that is no longer (a witness)
+int ContractionBuilder::contract(NodeId v, bool addShortcuts, int& hops)
+{
+    int shortcuts = 0;
+    hops = 0;
+
+        // Adding a shortcut u -> w changes m_out[u] and m_in[w], but never v's own lists
+    for (const RemainingEdge& in : m_in[v]) {
+        double maxLength = -1;
+        for (const RemainingEdge& out : m_out[v]) {
+            if (out.node != in.node) {
+                maxLength = max(maxLength, in.length + out.length);
+            }
+        }
+        if (maxLength < 0) {
+            continue;
+        }
+
+        witnessSearch(in.node, v, maxLength, addShortcuts ? WITNESS_SETTLE_LIMIT : SIMULATION_SETTLE_LIMIT);
+        for (const RemainingEdge& out : m_out[v]) {
+            if (out.node == in.node) {
+                continue;
+            }
+            double length = in.length + out.length;
+            if (m_reached[out.node] == m_search && m_distance[out.node] <= length) {
+                continue;
+            }
+            shortcuts++;
+            hops += m_ch.m_arcs[in.arc].edgeCount + m_ch.m_arcs[out.arc].edgeCount;
+            if (addShortcuts) {
+                addShortcut(in.node, out.node, length, in.arc, out.arc);
+            }
+        }
+    }
+    return shortcuts;
+}
+
+    // Lower is contracted sooner
+    // The arcs and hops (graph edges) the shortcuts would add are compared to those contracting v takes away as ratios
+    //      rather than differences, so that in the dense graph left near the end, nodes with many arcs aren't favoured
+    //      just for having many arcs to take away
+double ContractionBuilder::priority(NodeId v)
+{
+    int hops;
+    int shortcuts = contract(v, false, hops);
+
+    int removed = 0;
+    int removedHops = 0;
+    for (const RemainingEdge& in : m_in[v]) {
+        removed++;
+        removedHops += m_ch.m_arcs[in.arc].edgeCount;
+    }
+    for (const RemainingEdge& out : m_out[v]) {
+        removed++;
+        removedHops += m_ch.m_arcs[out.arc].edgeCount;
+    }
+    if (removed == 0) {
+        return m_level[v];
+    }
+    return 2 * (static_cast<double>(shortcuts) / removed + static_cast<double>(hops) / removedHops) + m_level[v];
+}
+
+    // Takes v out of the graph, keeping its remaining arcs as its arcs in the hierarchy
+void ContractionBuilder::contractNode(NodeId v)
+{
+    for (const RemainingEdge& out : m_out[v]) {
+        m_up[v].push_back(HierarchyEdge{out.node, out.arc, out.length});
+    }
+    for (const RemainingEdge& in : m_in[v]) {
+        m_down[v].push_back(HierarchyEdge{in.node, in.arc, in.length});
+    }
+    int hops;
+    contract(v, true, hops);
+
+        // Take v's edges out of its neighbours' lists
+    vector<NodeId> neighbours;
+    for (const RemainingEdge& out : m_out[v]) {
+        vector<RemainingEdge>& in = m_in[out.node];
+        in.erase(remove_if(in.begin(), in.end(), [v](const RemainingEdge& edge) { return edge.node == v; }), in.end());
+        neighbours.push_back(out.node);
+    }
+    for (const RemainingEdge& in : m_in[v]) {
+        vector<RemainingEdge>& out = m_out[in.node];
+        out.erase(remove_if(out.begin(), out.end(), [v](const RemainingEdge& edge) { return edge.node == v; }), out.end());
+        neighbours.push_back(in.node);
+    }
+    vector<RemainingEdge>().swap(m_out[v]);
+    vector<RemainingEdge>().swap(m_in[v]);
+
+        // Then the neighbours' priorities have changed
+    sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    for (NodeId n : neighbours) {
+        m_level[n] = max(m_level[n], m_level[v] + 1);
+        m_queue.update(n, priority(n));
+    }
+}
+
+    // Dijkstra from source over the remaining graph, not going through avoid, until every node within maxLength
+    //      or all of avoid's other neighbours are settled, or settleLimit nodes have been
+void ContractionBuilder::witnessSearch(NodeId source, NodeId avoid, double maxLength, int settleLimit)
+{
+    if (++m_search == 0) {
+        fill(m_reached.begin(), m_reached.end(), 0);
+        fill(m_target.begin(), m_target.end(), 0);
+        m_search = 1;
+    }
+    m_witnessSet.clear();
+
+        // The nodes we need distances to are avoid's other neighbours, and we can stop once they're all settled
+    int targetsLeft = 0;
+    for (const RemainingEdge& out : m_out[avoid]) {
+        if (out.node != source) {
+            m_target[out.node] = m_search;
+            targetsLeft++;
+        }
+    }
+
+    m_distance[source] = 0;
+    m_reached[source] = m_search;
+    m_witnessSet.push(source, 0);
+
+    for (int settled = 0; !m_witnessSet.empty() && settled < settleLimit; settled++) {
+        if (m_witnessSet.topPriority() > maxLength) {
+            break;
+        }
+        NodeId u = m_witnessSet.pop();
+        if (m_target[u] == m_search && --targetsLeft == 0) {
+            break;
+        }
+        for (const RemainingEdge& edge : m_out[u]) {
+            if (edge.node == avoid) {
+                continue;
+            }
+            double distance = m_distance[u] + edge.length;
+            if (m_reached[edge.node] == m_search && m_distance[edge.node] <= distance) {
+                continue;
+            }
+            m_distance[edge.node] = distance;
+            m_reached[edge.node] = m_search;
+            m_witnessSet.pushOrDecrease(edge.node, distance);
+        }
+    }
+}
+
+    // Adds the shortcut from -> to, unless there is already an edge between them that is no longer
+void ContractionBuilder::addShortcut(NodeId from, NodeId to, double length, uint32_t first, uint32_t second)
+{
+    auto out = find_if(m_out[from].begin(), m_out[from].end(), [to](const RemainingEdge& edge) { return edge.node == to; });
+    if (out != m_out[from].end() && out->length <= length) {
+        return;
+    }
+
+    uint32_t arc = addArc(from, to, length, NO_EDGE, first, second);
+    if (out != m_out[from].end()) {
+        *out = RemainingEdge{to, length, arc};
+        auto in = find_if(m_in[to].begin(), m_in[to].end(), [from](const RemainingEdge& edge) { return edge.node == from; });
+        *in = RemainingEdge{from, length, arc};
+    } else {
+        m_out[from].push_back(RemainingEdge{to, length, arc});
+        m_in[to].push_back(RemainingEdge{from, length, arc});
+    }
+}
+
+/////////////////////////////////////////////////
+// ContractionHierarchy
+/////////////////////////////////////////////////
+ContractionHierarchy::ContractionHierarchy() : m_shortcutCount(0), m_fingerprint(0)
+{}
+
+void ContractionHierarchy::build(const StreetGraph& graph)
+{
+    m_arcs.clear();
+    m_upEdges.clear();
+    m_downEdges.clear();
+
+    ContractionBuilder builder(graph, *this);
+    builder.build();
+    m_fingerprint = graphFingerprint(graph);
+}
+
+bool ContractionHierarchy::save(string file) const
+{
+    HierarchyHeader header;
+    memcpy(header.magic, HIERARCHY_MAGIC, sizeof(header.magic));
+    header.version = HIERARCHY_VERSION;
+    header.nodeCount = static_cast<uint32_t>(nodeCount());
+    header.fingerprint = m_fingerprint;
+    header.arcCount = m_arcs.size();
+    header.upEdgeCount = m_upEdges.size();
+    header.downEdgeCount = m_downEdges.size();
+    header.shortcutCount = m_shortcutCount;
+    uint64_t h = 14695981039346656037ULL;
+    h = fnv1aContinue(h, m_arcs.data(), m_arcs.size() * sizeof(Arc));
+    h = fnv1aContinue(h, m_upOffsets.data(), m_upOffsets.size() * sizeof(uint32_t));
+    h = fnv1aContinue(h, m_upEdges.data(), m_upEdges.size() * sizeof(HierarchyEdge));
+    h = fnv1aContinue(h, m_downOffsets.data(), m_downOffsets.size() * sizeof(uint32_t));
+    h = fnv1aContinue(h, m_downEdges.data(), m_downEdges.size() * sizeof(HierarchyEdge));
+    header.checksum = h;
+
+    ofstream out(file, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "Cannot open hierarchy file for writing!" << endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_arcs.data()), m_arcs.size() * sizeof(Arc));
+    out.write(reinterpret_cast<const char*>(m_upOffsets.data()), m_upOffsets.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(m_upEdges.data()), m_upEdges.size() * sizeof(HierarchyEdge));
+    out.write(reinterpret_cast<const char*>(m_downOffsets.data()), m_downOffsets.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(m_downEdges.data()), m_downEdges.size() * sizeof(HierarchyEdge));
+    return static_cast<bool>(out);
+}
+
+    // Reads a file written by save(), which must have been built from graph
+    // Nothing in the file is trusted: the counts in the header have to add up to the size of the file before anything
+    //      is allocated, the checksum has to match, and every offset, node and arc number has to be in range, so a
+    //      damaged file is turned away rather than read out of bounds by findPath() or unpack()
+bool ContractionHierarchy::load(string file, const StreetGraph& graph)
+{
+    ifstream in(file, ios::binary | ios::ate);
+    if (!in) {
+        cerr << "Cannot open hierarchy file!" << endl;
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+
+    HierarchyHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, HIERARCHY_MAGIC, sizeof(header.magic)) != 0
+        || header.version != HIERARCHY_VERSION) {
+        cerr << "Not a hierarchy file, or one from a different version!" << endl;
+        return false;
+    }
+    if (header.nodeCount != graph.nodeCount() || header.fingerprint != graphFingerprint(graph)) {
+        cerr << "Hierarchy file was built from a different map!" << endl;
+        return false;
+    }
+
+
+        // The counts are checked against the file's size one at a time first, so that adding them up can't overflow
+    uint64_t available = fileSize - sizeof(header);
+    uint64_t offsetBytes = 2 * (uint64_t(header.nodeCount) + 1) * sizeof(uint32_t);
+    if (header.arcCount > available / sizeof(Arc) || header.upEdgeCount > available / sizeof(HierarchyEdge)
+        || header.downEdgeCount > available / sizeof(HierarchyEdge) || header.arcCount >= NO_EDGE
+        || header.arcCount * sizeof(Arc) + offsetBytes + (header.upEdgeCount + header.downEdgeCount) * sizeof(HierarchyEdge) != available) {
+        cerr << "Hierarchy file is truncated or corrupt!" << endl;
+        return false;
+    }
+
+    vector<Arc> arcs(header.arcCount);
+    vector<uint32_t> upOffsets(header.nodeCount + 1);
+    vector<HierarchyEdge> upEdges(header.upEdgeCount);
+    vector<uint32_t> downOffsets(header.nodeCount + 1);
+    vector<HierarchyEdge> downEdges(header.downEdgeCount);
+    in.read(reinterpret_cast<char*>(arcs.data()), arcs.size() * sizeof(Arc));
+    in.read(reinterpret_cast<char*>(upOffsets.data()), upOffsets.size() * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(upEdges.data()), upEdges.size() * sizeof(HierarchyEdge));
+    in.read(reinterpret_cast<char*>(downOffsets.data()), downOffsets.size() * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(downEdges.data()), downEdges.size() * sizeof(HierarchyEdge));
+    uint64_t h = 14695981039346656037ULL;
+    h = fnv1aContinue(h, arcs.data(), arcs.size() * sizeof(Arc));
+    h = fnv1aContinue(h, upOffsets.data(), upOffsets.size() * sizeof(uint32_t));
+    h = fnv1aContinue(h, upEdges.data(), upEdges.size() * sizeof(HierarchyEdge));
+    h = fnv1aContinue(h, downOffsets.data(), downOffsets.size() * sizeof(uint32_t));
+    h = fnv1aContinue(h, downEdges.data(), downEdges.size() * sizeof(HierarchyEdge));
+    if (!in || h != header.checksum) {
+        cerr << "Hierarchy file is truncated or corrupt!" << endl;
+        return false;
+    }
+
+        // An arc is one of the graph's edges, or a shortcut for two arcs before it, which unpack() relies on to finish
+    bool valid = true;
+    for (uint32_t a = 0; valid && a < arcs.size(); a++) {
+        const Arc& arc = arcs[a];
+        valid = arc.source < header.nodeCount && arc.target < header.nodeCount;
+        if (valid && arc.edge != NO_EDGE) {
+            valid = arc.edge < graph.edgeCount() && arc.edgeCount == 1;
+        } else if (valid) {
+            valid = arc.first < a && arc.second < a
+                 && uint64_t(arc.edgeCount) == uint64_t(arcs[arc.first].edgeCount) + arcs[arc.second].edgeCount;
+        }
+    }
+        // Each node's edges are a range of its edge array, and each names a node and an arc that exist
+    auto validEdges = [&](const vector<uint32_t>& offsets, const vector<HierarchyEdge>& edges) {
+        if (offsets.front() != 0 || offsets.back() != edges.size()) {
+            return false;
+        }
+        for (size_t n = 0; n + 1 < offsets.size(); n++) {
+            if (offsets[n] > offsets[n + 1]) {
+                return false;
+            }
+        }
+        for (const HierarchyEdge& edge : edges) {
+            if (edge.node >= header.nodeCount || edge.arc >= arcs.size()) {
+                return false;
+            }
+        }
+        return true;
+    };
+    valid = valid && validEdges(upOffsets, upEdges) && validEdges(downOffsets, downEdges);
+    if (!valid) {
+        cerr << "Hierarchy file is truncated or corrupt!" << endl;
+        return false;
+    }
+
+    m_arcs.swap(arcs);
+    m_upOffsets.swap(upOffsets);
+    m_upEdges.swap(upEdges);
+    m_downOffsets.swap(downOffsets);
+    m_downEdges.swap(downEdges);
+    m_shortcutCount = header.shortcutCount;
+    m_fingerprint = header.fingerprint;
+    return true;
+}
+
+/**
+* A query is a bidirectional Dijkstra search that only climbs: forwards from start along the arcs up out of each node,
+*   and backwards from end along the arcs down into each node. Every shortest path has a counterpart in the hierarchy
+*   whose most important node both searches reach, so mu, the shortest start -> end path through a node both have
+*   reached, is the answer once neither search has anything left closer than it
+* Searches are also stalled on demand: a node reached more cheaply through a more important node (going the other way
+*   along one of its arcs) can't be on a shortest path, so its arcs aren't relaxed
+* The workspace's parent edges hold arc numbers rather than EdgeIds, until the path is unpacked
+*/
+bool ContractionHierarchy::findPath(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& path, size_t& length) const
+{
+    workspace.beginSearch();
+    SearchSpace& forward = workspace.forward();
+    SearchSpace& backward = workspace.backward();
+    RouteStats& stats = workspace.stats();
+
+    forward.reach(start, 0, NO_EDGE);
+    forward.openSet().push(start, 0);
+    backward.reach(end, 0, NO_EDGE);
+    backward.openSet().push(end, 0);
+
+    double mu = numeric_limits<double>::infinity();
+    NodeId meet = NO_NODE;
+
+    for (;;) {
+        bool forwardOpen = !forward.openSet().empty() && forward.openSet().topPriority() < mu;
+        bool backwardOpen = !backward.openSet().empty() && backward.openSet().topPriority() < mu;
+        if (!forwardOpen && !backwardOpen) {
+            break;
+        }
+        bool goForward = forwardOpen && (!backwardOpen || forward.openSet().topPriority() <= backward.openSet().topPriority());
+        SearchSpace& search = goForward ? forward : backward;
+        SearchSpace& other = goForward ? backward : forward;
+
+        NodeId currNode = search.openSet().pop();
+        search.close(currNode);
+        stats.settledNodes++;
+        double currGCost = search.node(currNode).gCost;
+
+        if (other.reached(currNode) && currGCost + other.node(currNode).gCost < mu) {
+            mu = currGCost + other.node(currNode).gCost;
+            meet = currNode;
+        }
+
+            // The arcs this search climbs, and the ones it would arrive along from above
+        const vector<uint32_t>& offsets = goForward ? m_upOffsets : m_downOffsets;
+        const vector<HierarchyEdge>& edges = goForward ? m_upEdges : m_downEdges;
+        const vector<uint32_t>& stallOffsets = goForward ? m_downOffsets : m_upOffsets;
+        const vector<HierarchyEdge>& stallEdges = goForward ? m_downEdges : m_upEdges;
+
+        bool stalled = false;
+        for (uint32_t i = stallOffsets[currNode]; i != stallOffsets[currNode + 1] && !stalled; i++) {
+            const HierarchyEdge& edge = stallEdges[i];
+            stalled = search.reached(edge.node) && search.node(edge.node).gCost + edge.length < currGCost;
+        }
+        if (stalled) {
+            continue;
+        }
+
+        for (uint32_t i = offsets[currNode]; i != offsets[currNode + 1]; i++) {
+            const HierarchyEdge& edge = edges[i];
+            stats.relaxedEdges++;
+            double gCost = currGCost + edge.length;
+            if (search.reached(edge.node) && search.node(edge.node).gCost <= gCost) {
+                continue;
+            }
+            search.reach(edge.node, gCost, edge.arc);
+            search.openSet().pushOrDecrease(edge.node, gCost);
+        }
+    }
+
+    if (meet == NO_NODE) {
+        return false;
+    }
+
+        // Collect the arcs start -> meet -> end, then unpack each of them in turn
+    size_t forwardArcs = 0;
+    size_t nArcs = 0;
+    length = 0;
+    for (uint32_t a = forward.node(meet).parentEdge; a != NO_EDGE; a = forward.node(m_arcs[a].source).parentEdge) {
+        forwardArcs++;
+        length += m_arcs[a].edgeCount;
+    }
+    nArcs = forwardArcs;
+    for (uint32_t a = backward.node(meet).parentEdge; a != NO_EDGE; a = backward.node(m_arcs[a].target).parentEdge) {
+        nArcs++;
+        length += m_arcs[a].edgeCount;
+    }
+
+    uint32_t* arcs = workspace.arena().allocate<uint32_t>(nArcs);
+    size_t i = forwardArcs;
+    for (uint32_t a = forward.node(meet).parentEdge; a != NO_EDGE; a = forward.node(m_arcs[a].source).parentEdge) {
+        arcs[--i] = a;
+    }
+    i = forwardArcs;
+    for (uint32_t a = backward.node(meet).parentEdge; a != NO_EDGE; a = backward.node(m_arcs[a].target).parentEdge) {
+        arcs[i++] = a;
+    }
+
+    EdgeId* edges = workspace.arena().allocate<EdgeId>(length);
+    EdgeId* out = edges;
+    for (i = 0; i < nArcs; i++) {
+        out = unpack(arcs[i], out);
+    }
+    path = edges;
+    return true;
+}
+
+    // The searches are the same as findPath()'s, except that they run until they've settled every node they can reach
+void ContractionHierarchy::searchToTarget(SearchWorkspace& workspace, NodeId target, uint32_t targetIndex, vector<BucketEntry>& entries) const
+{
+    thread_local vector<NodeId> settled;
+    upwardSearch(workspace, target, false, settled);
+    for (NodeId n : settled) {
+        entries.push_back(BucketEntry{n, targetIndex, workspace.forward().node(n).gCost});
+    }
+}
+
+void ContractionHierarchy::scanBuckets(SearchWorkspace& workspace, NodeId source, const vector<uint32_t>& bucketOffsets,
+                                       const vector<BucketEntry>& buckets, double* row, size_t targetCount) const
+{
+    fill(row, row + targetCount, numeric_limits<double>::infinity());
+    thread_local vector<NodeId> settled;
+    upwardSearch(workspace, source, true, settled);
+    for (NodeId n : settled) {
+        double toNode = workspace.forward().node(n).gCost;
+        for (uint32_t i = bucketOffsets[n]; i != bucketOffsets[n + 1]; i++) {
+            row[buckets[i].target] = min(row[buckets[i].target], toNode + buckets[i].distance);
+        }
+    }
+}
+
+size_t ContractionHierarchy::memoryUsage() const
+{
+    return m_arcs.capacity() * sizeof(Arc) + (m_upOffsets.capacity() + m_downOffsets.capacity()) * sizeof(uint32_t)
+        + (m_upEdges.capacity() + m_downEdges.capacity()) * sizeof(HierarchyEdge);
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // Writes the graph edges an arc stands for to out, in order, and returns the position after the last
+EdgeId* ContractionHierarchy::unpack(uint32_t arc, EdgeId* out) const {
+    const Arc& a = m_arcs[arc];
+    if (a.edge != NO_EDGE) {
+        *out = a.edge;
+        return out + 1;
+    }
+    return unpack(a.second, unpack(a.first, out));
+}
+
+    // Dijkstra from one node along the arcs up out of each node (or down into each node, if not forward), stalling on demand,
+    //      until it runs out of nodes; the distances end up in the workspace's forward search, whichever way it went
+    // settled is set to the nodes settled without being stalled, which are the only ones whose distances are exact
+void ContractionHierarchy::upwardSearch(SearchWorkspace& workspace, NodeId from, bool forward, vector<NodeId>& settled) const {
+    workspace.beginSearch();
+    SearchSpace& search = workspace.forward();
+    RouteStats& stats = workspace.stats();
+    const vector<uint32_t>& offsets = forward ? m_upOffsets : m_downOffsets;
+    const vector<HierarchyEdge>& edges = forward ? m_upEdges : m_downEdges;
+    const vector<uint32_t>& stallOffsets = forward ? m_downOffsets : m_upOffsets;
+    const vector<HierarchyEdge>& stallEdges = forward ? m_downEdges : m_upEdges;
+
+    settled.clear();
+    search.reach(from, 0, NO_EDGE);
+    search.openSet().push(from, 0);
+    while (!search.openSet().empty()) {
+        NodeId currNode = search.openSet().pop();
+        search.close(currNode);
+        stats.settledNodes++;
+        double currGCost = search.node(currNode).gCost;
+
+        bool stalled = false;
+        for (uint32_t i = stallOffsets[currNode]; i != stallOffsets[currNode + 1] && !stalled; i++) {
+            const HierarchyEdge& edge = stallEdges[i];
+            stalled = search.reached(edge.node) && search.node(edge.node).gCost + edge.length < currGCost;
+        }
+        if (stalled) {
+            continue;
+        }
+        settled.push_back(currNode);
+
+        for (uint32_t i = offsets[currNode]; i != offsets[currNode + 1]; i++) {
+            const HierarchyEdge& edge = edges[i];
+            stats.relaxedEdges++;
+            double gCost = currGCost + edge.length;
+            if (search.reached(edge.node) && search.node(edge.node).gCost <= gCost) {
+                continue;
+            }
+            search.reach(edge.node, gCost, edge.arc);
+            search.openSet().pushOrDecrease(edge.node, gCost);
+        }
+    }
+}
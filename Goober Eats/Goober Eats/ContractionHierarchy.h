@@ -0,0 +1,100 @@
+// ContractionHierarchy.h
+
+// A Contraction Hierarchy over a StreetGraph: the graph preprocessed so that a shortest path query
+// only has to search a few hundred nodes, however far apart its two ends are.
+//
+// build() contracts the nodes one at a time, least important first. Contracting a node takes it out
+// of the graph, and wherever the only shortest path between two of its remaining neighbours went
+// through it, a shortcut between those neighbours, exactly as long as that path, takes its place.
+// The order the nodes were contracted in ranks them, and each node keeps only its edges and shortcuts
+// to nodes ranked above it. Every shortest path then has a counterpart that climbs from its start and
+// descends to its end, so a query is two small Dijkstra searches that only ever go upwards: one from
+// the start, and one back from the end along the edges that come down into each node.
+//
+// Every shortcut remembers the two arcs it stands for, so a path found in the hierarchy unpacks into
+// the graph's own EdgeIds. A hierarchy only fits the graph it was built from; save() writes it to a
+// file next to the map, and load() refuses a file built from any other graph.
+
+#ifndef CONTRACTIONHIERARCHY_INCLUDED
+#define CONTRACTIONHIERARCHY_INCLUDED
+
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ContractionHierarchy
+{
+public:
+    ContractionHierarchy();
+
+        // Preprocesses graph, replacing whatever hierarchy was built or loaded before
+    void build(const StreetGraph& graph);
+        // Write the hierarchy to a file, and read one back for the same graph
+    bool save(std::string file) const;
+    bool load(std::string file, const StreetGraph& graph);
+
+    size_t nodeCount() const { return m_upOffsets.empty() ? 0 : m_upOffsets.size() - 1; }
+    size_t shortcutCount() const { return m_shortcutCount; }
+
+        // Finds a shortest path from start to end, and lays it out start to end as EdgeIds of the graph
+        //      in the workspace's arena, where it stays until the workspace's next search
+        // Returns false if there is no path. The nodes settled and arcs relaxed are added to the workspace's stats
+    bool findPath(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& path, size_t& length) const;
+
+        // Many to many distances, in two kinds of search so that they can be spread over threads (see DistanceMatrix.cpp)
+        //  - searchToTarget() searches back up from a target, and adds a BucketEntry for every node it settles
+        //  - once the entries of every target are sorted by node (bucketOffsets[n] is where node n's start),
+        //    scanBuckets() searches up from a source, and fills in row[t] with the shortest distance to target t
+        //    through any node both searches settled, or infinity if there is none
+    struct BucketEntry {
+        NodeId node;
+        uint32_t target;        // which target it is an entry for
+        double distance;        // from node to the target
+    };
+    void searchToTarget(SearchWorkspace& workspace, NodeId target, uint32_t targetIndex, std::vector<BucketEntry>& entries) const;
+    void scanBuckets(SearchWorkspace& workspace, NodeId source, const std::vector<uint32_t>& bucketOffsets,
+                     const std::vector<BucketEntry>& buckets, double* row, size_t targetCount) const;
+
+        // Approximate number of bytes of heap memory held
+    size_t memoryUsage() const;
+
+        // C++11 syntax for preventing copying and assignment
+    ContractionHierarchy(const ContractionHierarchy&) = delete;
+    ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+
+private:
+    friend class ContractionBuilder;
+
+        // An edge of the graph, or a shortcut standing for the arcs first then second
+    struct Arc {
+        NodeId source;
+        NodeId target;
+        double length;
+        EdgeId edge;            // NO_EDGE for a shortcut
+        uint32_t first;
+        uint32_t second;
+        uint32_t edgeCount;     // how many of the graph's edges it unpacks into
+    };
+
+        // An arc between a node and a more important one, as the node sees it
+    struct HierarchyEdge {
+        NodeId node;            // the more important end
+        uint32_t arc;
+        double length;
+    };
+
+    std::vector<Arc> m_arcs;
+    std::vector<uint32_t> m_upOffsets;          // nodeCount() + 1 entries
+    std::vector<HierarchyEdge> m_upEdges;       // the arcs leaving n upwards are [m_upOffsets[n], m_upOffsets[n + 1])
+    std::vector<uint32_t> m_downOffsets;        // nodeCount() + 1 entries
+    std::vector<HierarchyEdge> m_downEdges;     // the arcs coming down into n
+    size_t m_shortcutCount;
+    uint64_t m_fingerprint;                     // of the graph it was built from
+
+    EdgeId* unpack(uint32_t arc, EdgeId* out) const;
+    void upwardSearch(SearchWorkspace& workspace, NodeId from, bool forward, std::vector<NodeId>& settled) const;
+};
+
+#endif // CONTRACTIONHIERARCHY_INCLUDED
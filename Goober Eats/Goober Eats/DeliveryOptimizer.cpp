@@ -1,6 +1,12 @@
 #include "provided.h"
+#include "TourImprover.h"
+#include "HeldKarp.h"
+#include "TourAnnealer.h"
+#include "FleetRouter.h"
+#include "TimeWindowImprover.h"
 #include <vector>
 #include <algorithm>
+#include <limits>
 using namespace std;
 
 class DeliveryOptimizerImpl
@@ -13,9 +19,35 @@ public:
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+    bool optimizeFleet(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<double>& capacities,
+        vector<vector<DeliveryRequest>>& routes,
+        double& crowDistance) const;
+    void setExactStops(size_t maxStops);
+    void setSearchTime(double milliseconds);
+    void setSearchIterations(size_t iterations);
+    void setAnnealing(double milliseconds, size_t rounds, unsigned int threads, unsigned long long seed);
+    void setTravelModel(const TravelModel& model);
+private:
+    size_t m_exactStops;
+    double m_searchMilliseconds;
+    size_t m_searchIterations;
+    double m_annealMilliseconds;
+    size_t m_annealRounds;
+    unsigned int m_annealThreads;
+    unsigned long long m_annealSeed;
+    TravelModel m_travel;
+    
+    void crowDistances(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, vector<double>& distances) const;
+    double heuristicOrder(const vector<double>& distances, size_t count, vector<uint32_t>& tour) const;
+    bool windowedOrder(const vector<DeliveryRequest>& deliveries, const vector<double>& distances, vector<uint32_t>& tour, double& crowDistance) const;
 };
 
 DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
+ : m_exactStops(12), m_searchMilliseconds(numeric_limits<double>::infinity()), m_searchIterations(numeric_limits<size_t>::max()),
+   m_annealMilliseconds(0), m_annealRounds(0), m_annealThreads(0), m_annealSeed(0)
 {}
 
 DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
@@ -27,57 +59,245 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
     double& oldCrowDistance,
     double& newCrowDistance) const
 {
+    if (deliveries.empty()) {
+        return;
+    }
+    
+        // Work out the distance as the crow flies between every pair of locations once, up front
+    size_t count = deliveries.size() + 1;
+    vector<double> distances;
+    crowDistances(depot, deliveries, distances);
+    
+        // First get total distance as the crow flies in the given order, including the return to the depot
+    vector<uint32_t> tour(count);
+    for (uint32_t i = 0; i < count; i++) {
+        tour[i] = i;
+    }
+    double givenCrowDistance = TourImprover::tourLength(distances.data(), count, tour);
+    oldCrowDistance += givenCrowDistance;
+    
+        // Batches with time windows are ordered around them; otherwise, batches small enough to order exactly are, and
+        //      anything bigger gets our greedy model, improved by local search
+    double crowDistance;
+    bool reorder;
+    bool timed = any_of(deliveries.begin(), deliveries.end(), [] (const DeliveryRequest& request)
+                            { return request.earliest > 0 || request.latest != numeric_limits<double>::infinity(); } );
+    if (timed) {
+        reorder = windowedOrder(deliveries, distances, tour, crowDistance);
+    } else {
+        if (deliveries.size() <= m_exactStops) {
+            solveHeldKarp(distances.data(), deliveries.size(), tour);
+            crowDistance = TourImprover::tourLength(distances.data(), count, tour);
+        } else {
+            crowDistance = heuristicOrder(distances, count, tour);
+        }
+        reorder = crowDistance < givenCrowDistance;
+    }
+    
+    if (reorder) {
+        vector<DeliveryRequest> reorderedDeliveries;
+        for (size_t i = 1; i < count; i++) {
+            reorderedDeliveries.push_back(deliveries[tour[i] - 1]);
+        }
+        deliveries = reorderedDeliveries;
+        newCrowDistance += crowDistance;
+    } else {
+        newCrowDistance += givenCrowDistance;
+    }
+}
+
+bool DeliveryOptimizerImpl::optimizeFleet(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<double>& capacities,
+    vector<vector<DeliveryRequest>>& routes,
+    double& crowDistance) const
+{
+    routes.clear();
+    size_t count = deliveries.size() + 1;
+    vector<double> distances;
+    crowDistances(depot, deliveries, distances);
+    vector<double> loads(count, 0);
+    for (size_t i = 1; i < count; i++) {
+        loads[i] = deliveries[i - 1].load;
+    }
+    
+        // Split the deliveries between the vehicles, and then order each vehicle's just as we would one courier's
+    FleetRouter router(distances.data(), loads.data(), count);
+    vector<vector<uint32_t>> stops;
+    if (!router.route(capacities, stops)) {
+        return false;
+    }
+    routes.resize(stops.size());
+    for (size_t v = 0; v < stops.size(); v++) {
+        for (uint32_t s : stops[v]) {
+            routes[v].push_back(deliveries[s - 1]);
+        }
+        double oldCrowDistance = 0;
+        optimizeDeliveryOrder(depot, routes[v], oldCrowDistance, crowDistance);
+    }
+    return true;
+}
+
+void DeliveryOptimizerImpl::setExactStops(size_t maxStops)
+{
+    m_exactStops = min(maxStops, HELD_KARP_MAX_STOPS);
+}
+
+void DeliveryOptimizerImpl::setSearchTime(double milliseconds)
+{
+    m_searchMilliseconds = milliseconds;
+}
+
+void DeliveryOptimizerImpl::setSearchIterations(size_t iterations)
+{
+    m_searchIterations = iterations;
+}
+
+void DeliveryOptimizerImpl::setAnnealing(double milliseconds, size_t rounds, unsigned int threads, unsigned long long seed)
+{
+    m_annealMilliseconds = milliseconds;
+    m_annealRounds = rounds;
+    m_annealThreads = threads;
+    m_annealSeed = seed;
+}
+
+void DeliveryOptimizerImpl::setTravelModel(const TravelModel& model)
+{
+    m_travel = model;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // Fills in distances with the count x count matrix of distances as the crow flies between every pair of locations:
+    //      location 0 is the depot, and location i the delivery deliveries[i - 1]
+void DeliveryOptimizerImpl::crowDistances(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, vector<double>& distances) const {
+    size_t count = deliveries.size() + 1;
+    distances.assign(count * count, 0);
+    for (size_t i = 0; i < count; i++) {
+        const GeoCoord& from = (i == 0) ? depot : deliveries[i - 1].location;
+        for (size_t j = i + 1; j < count; j++) {
+            const GeoCoord& to = deliveries[j - 1].location;
+            distances[i * count + j] = distances[j * count + i] = distanceEarthMiles(from, to);
+        }
+    }
+}
+
+/**
+* Orders the locations of distances (count x count, the depot first) with our greedy model, then improves that order
+*   with local search, and then annealing if it's on; returns the tour's length
+*/
+double DeliveryOptimizerImpl::heuristicOrder(const vector<double>& distances, size_t count, vector<uint32_t>& tour) const {
         // Our model is to go to the furthest point from the depot, and then work our way backwards by
         //      visiting the next closest delivery location, and then heading back to the depot.
-    vector<DeliveryRequest> copyOfDeliveries = deliveries;
-    vector<DeliveryRequest> reorderedDeliveries;
+    vector<uint32_t> remaining;
+    for (uint32_t i = 1; i < count; i++) {
+        remaining.push_back(i);
+    }
+    tour.assign(1, 0);
+    vector<uint32_t>::iterator furthestLocItr = max_element(remaining.begin(),
+                                                            remaining.end(),
+                                                            [&distances] (uint32_t l1, uint32_t l2)
+                                                                { return distances[l1] < distances[l2]; } );
+    tour.push_back(*furthestLocItr);
+    remaining.erase(furthestLocItr);
     
-        // First get total distance as the crow flies in the given order
-    GeoCoord prevLoc = depot;
-    for (vector<DeliveryRequest>::iterator itr = deliveries.begin(); itr != deliveries.end(); itr++) {
-        oldCrowDistance += distanceEarthMiles(prevLoc, (*itr).location);
-        prevLoc = (*itr).location;
+        // Now find the next closest delivery point from the each point we're visiting
+    while (!remaining.empty()) {
+        const double* fromPrev = &distances[tour.back() * count];
+        vector<uint32_t>::iterator nextClosestItr = min_element(remaining.begin(),
+                                                                remaining.end(),
+                                                                [fromPrev] (uint32_t l1, uint32_t l2)
+                                                                    { return fromPrev[l1] < fromPrev[l2]; } );
+        tour.push_back(*nextClosestItr);
+        remaining.erase(nextClosestItr);
     }
-        // Then include return to depot
-    oldCrowDistance += distanceEarthMiles(prevLoc, depot);
     
-        // Now we do our model
-        // First we'll find the furthest delivery point from the depot; this will be the first point we visit
-    vector<DeliveryRequest>::iterator furthestLocItr = max_element(copyOfDeliveries.begin(),
-                                                                   copyOfDeliveries.end(),
-                                                                   [depot] (const DeliveryRequest& d1, const DeliveryRequest& d2)
-                                                                        { return distanceEarthMiles(depot, d1.location) < distanceEarthMiles(depot, d2.location); } );
-    reorderedDeliveries.push_back(*furthestLocItr);
-    newCrowDistance += distanceEarthMiles(depot, furthestLocItr->location);
+        // Then improve that order with local search, for as long as it keeps getting shorter (or the budget allows)
+    TourImprover improver(distances.data(), count);
+    double length = improver.improve(tour, m_searchMilliseconds, m_searchIterations);
     
-    prevLoc = furthestLocItr->location;
+    if (m_annealRounds != 0) {
+        TourAnnealer annealer(distances.data(), count);
+        length = annealer.anneal(tour, m_annealMilliseconds, m_annealRounds, m_annealThreads, m_annealSeed);
+    }
+    return length;
+}
+
+/**
+* Orders deliveries (tour, the given order, in and out) to be as little late as they can be, and then as short, with local
+*   search from the order that ignores the windows, the order of the deadlines and a greedy order that heeds them,
+*   keeping the best
+* @return Whether the order found is better than the given one, with its distance as the crow flies in crowDistance
+*/
+bool DeliveryOptimizerImpl::windowedOrder(const vector<DeliveryRequest>& deliveries, const vector<double>& distances, vector<uint32_t>& tour, double& crowDistance) const {
+    size_t count = deliveries.size() + 1;
+    vector<double> earliest(count, 0);
+    vector<double> latest(count, numeric_limits<double>::infinity());
+    for (size_t i = 1; i < count; i++) {
+        earliest[i] = deliveries[i - 1].earliest;
+        latest[i] = deliveries[i - 1].latest;
+    }
+        // The optimizer only has distances as the crow flies, so it drives them as slowly as the roads would take
+    TimeWindowImprover improver(distances.data(), count, m_travel.minutesPerMile() * m_travel.roadFactor, m_travel.serviceMinutes,
+                                earliest.data(), latest.data());
+    TimeWindowCost given = improver.evaluate(tour);
     
-    furthestLocItr = copyOfDeliveries.erase(furthestLocItr);
+    vector<uint32_t> shortest;
+    heuristicOrder(distances, count, shortest);
+    vector<uint32_t> deadlines = tour;
+    stable_sort(deadlines.begin() + 1, deadlines.end(), [&latest, &earliest] (uint32_t l1, uint32_t l2)
+                    { return (latest[l1] != latest[l2]) ? latest[l1] < latest[l2] : earliest[l1] < earliest[l2]; } );
     
-        // Now find the next closest delivery point from the each point we're visiting; this is the second point we visit
-    for (int i = 1; i < deliveries.size() - 1; i++) {
-        vector<DeliveryRequest>::iterator nextClosestItr = min_element(copyOfDeliveries.begin(),
-                                                                       copyOfDeliveries.end(),
-                                                                       [prevLoc] (const DeliveryRequest& d1, const DeliveryRequest& d2)
-                                                                       { return distanceEarthMiles(prevLoc, d1.location) < distanceEarthMiles(prevLoc, d2.location); } );
-        reorderedDeliveries.push_back(*nextClosestItr);
-        newCrowDistance += distanceEarthMiles(prevLoc, nextClosestItr->location);
-        
-        prevLoc = nextClosestItr->location;
-        
-        nextClosestItr = copyOfDeliveries.erase(nextClosestItr);
+        // And the greedy order a courier would drive: each time, on to whichever stop can be got to soonest without being
+        //      late, counting waiting as well as driving, and whose window is closing soonest
+    double minutesPerMile = m_travel.minutesPerMile() * m_travel.roadFactor;
+    vector<uint32_t> nearest(1, 0);
+    vector<char> visited(count, false);
+    double time = 0;
+    for (size_t step = 1; step < count; step++) {
+        const double* fromPrev = &distances[nearest.back() * count];
+        uint32_t next = 0;
+        double nextCost = numeric_limits<double>::infinity();
+        for (uint32_t l = 1; l < count; l++) {
+            if (visited[l]) {
+                continue;
+            }
+            double arrival = time + fromPrev[l] * minutesPerMile;
+            double cost = fromPrev[l] * minutesPerMile + max(arrival, earliest[l]) - time;
+            cost += (arrival > latest[l]) ? 1e6 + arrival - latest[l] : 0.2 * min(latest[l] - arrival, 1e6);
+            if (cost < nextCost) {
+                nextCost = cost;
+                next = l;
+            }
+        }
+        visited[next] = true;
+        time = max(time + fromPrev[next] * minutesPerMile, earliest[next]) + m_travel.serviceMinutes;
+        nearest.push_back(next);
     }
     
-        // Now push_back the last delivery point remaining in the copyOfDeliveries vector (if there is more than 1)
-    if (deliveries.size() > 1) {
-        vector<DeliveryRequest>::iterator lastDelReq = copyOfDeliveries.begin();
-        reorderedDeliveries.push_back(*lastDelReq);
-        newCrowDistance += distanceEarthMiles(prevLoc, lastDelReq->location);
+    vector<vector<uint32_t>> starts = { shortest, deadlines, nearest };
+    size_t best = 0;
+    TimeWindowCost cost;
+    for (size_t s = 0; s < starts.size(); s++) {
+        TimeWindowCost startCost = improver.evaluate(starts[s]);
+        if (m_searchIterations != 0) {
+            startCost = improver.improve(starts[s], m_searchMilliseconds / starts.size(), m_searchIterations);
+        }
+        if (s == 0 || TimeWindowImprover::score(startCost) < TimeWindowImprover::score(cost)) {
+            best = s;
+            cost = startCost;
+        }
     }
     
-    if (newCrowDistance < oldCrowDistance) {
-        deliveries = reorderedDeliveries;
+    if (TimeWindowImprover::score(cost) < TimeWindowImprover::score(given)) {
+        tour = starts[best];
+        crowDistance = cost.miles;
+        return true;
     }
+    crowDistance = given.miles;
+    return false;
 }
 
 //******************** DeliveryOptimizer functions ****************************
@@ -103,3 +323,38 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
 {
     return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
 }
+
+bool DeliveryOptimizer::optimizeFleet(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<double>& capacities,
+        vector<vector<DeliveryRequest>>& routes,
+        double& crowDistance) const
+{
+    return m_impl->optimizeFleet(depot, deliveries, capacities, routes, crowDistance);
+}
+
+void DeliveryOptimizer::setExactStops(size_t maxStops)
+{
+    m_impl->setExactStops(maxStops);
+}
+
+void DeliveryOptimizer::setSearchTime(double milliseconds)
+{
+    m_impl->setSearchTime(milliseconds);
+}
+
+void DeliveryOptimizer::setSearchIterations(size_t iterations)
+{
+    m_impl->setSearchIterations(iterations);
+}
+
+void DeliveryOptimizer::setAnnealing(double milliseconds, size_t rounds, unsigned int threads, unsigned long long seed)
+{
+    m_impl->setAnnealing(milliseconds, rounds, threads, seed);
+}
+
+void DeliveryOptimizer::setTravelModel(const TravelModel& model)
+{
+    m_impl->setTravelModel(model);
+}
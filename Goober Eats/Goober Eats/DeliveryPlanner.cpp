@@ -1,6 +1,11 @@
 #include "provided.h"
+#include "StreetGraph.h"
+#include "CompactRoute.h"
+#include "SpatialIndex.h"
+#include "ParallelFor.h"
 #include <vector>
 #include <algorithm>
+#include <cmath>
 using namespace std;
 
 class DeliveryPlannerImpl
@@ -12,29 +17,53 @@ public:
         const GeoCoord& depot,
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled,
+        vector<DeliveryTiming>* timings) const;
+    DeliveryResult generateFleetPlan(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<double>& capacities,
+        vector<vector<DeliveryCommand>>& commands,
+        vector<double>& vehicleDistances,
         double& totalDistanceTravelled) const;
+    void setThreadCount(unsigned int threads);
+    void setTravelModel(const TravelModel& model);
+    void setRouteCache(RouteCache* cache);
+    void setSnapDistance(double maxMiles);
 private:
     const StreetMap* m_streetMap;
+    const StreetGraph& m_graph;
+    RouteCache* m_cache;
+    double m_snapMiles;
+    unsigned int m_threadCount;
+    TravelModel m_travel;
     
-    string dirToWords(const double& dir) const;
-    bool proceedAlongStreet(
-        list<StreetSegment>& currRoute,
-        const StreetSegment& currSS,
-        list<StreetSegment>::iterator& currSSItr,
+    NodeId locate(const GeoCoord& gc) const;
+    DeliveryResult checkLocations(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const;
+    DeliveryResult planTrip(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& orderedDeliveries,
         vector<DeliveryCommand>& commands,
-        double& totalDistanceTravelled) const;
-    
-    double getDistanceAlongStreet(
-        const list<StreetSegment>::iterator startSSItr,
-        const list<StreetSegment>::iterator endSSItr) const;
+        double& distanceTravelled,
+        vector<DeliveryTiming>* timings) const;
+    string dirToWords(const double& dir) const;
+    void legCommands(
+        const CompactRoute& leg,
+        const string* item,
+        vector<DeliveryCommand>& commands) const;
+    size_t proceedAlongStreet(
+        const CompactRoute& leg,
+        size_t first,
+        vector<DeliveryCommand>& commands) const;
     
     void turnOntoStreet(
-        const StreetSegment& prevSS,
-        const StreetSegment& currSS,
+        EdgeId prevEdge,
+        EdgeId currEdge,
         vector<DeliveryCommand>& commands) const;
+    double edgeHeading(EdgeId e) const;
 };
 
-DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm) : m_streetMap(sm)
+DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm) : m_streetMap(sm), m_graph(sm->getStreetGraph()), m_cache(nullptr), m_snapMiles(0), m_threadCount(0)
 {}
 
 DeliveryPlannerImpl::~DeliveryPlannerImpl()
@@ -45,197 +74,249 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
     vector<DeliveryCommand>& commands,
-    double& totalDistanceTravelled) const
+    double& totalDistanceTravelled,
+    vector<DeliveryTiming>* timings) const
 {
+        // Before anything else, check every delivery is somewhere the depot has streets to
+    DeliveryResult dr = checkLocations(depot, deliveries);
+    if (dr != DELIVERY_SUCCESS) {
+        return dr;
+    }
+    
         // Reorder delivery requests to make optimal
     DeliveryOptimizer deliveryOpt(m_streetMap);
+    deliveryOpt.setTravelModel(m_travel);
     double oldCrowDist = 0;
     double newCrowDist = 0;
     vector<DeliveryRequest> orderedDeliveries = deliveries;
     deliveryOpt.optimizeDeliveryOrder(depot, orderedDeliveries, oldCrowDist, newCrowDist);
     
-        // Generate point-to-point routes between the depot to each of the successive delivery points
-    vector<list<StreetSegment>> completeRoute;
-    vector<string> deliveryItems;
-    
-    GeoCoord prevLoc = depot;
-    
-    PointToPointRouter ptpr(m_streetMap);
-    
-    for (vector<DeliveryRequest>::iterator itr = orderedDeliveries.begin(); itr != orderedDeliveries.end(); itr++) {
-        deliveryItems.push_back((*itr).item);
-        list<StreetSegment> currRoute;
-        
-        DeliveryResult dr = ptpr.generatePointToPointRoute(prevLoc, (*itr).location, currRoute, totalDistanceTravelled);
-        
-        if (dr == NO_ROUTE) {
-            return NO_ROUTE;
-        } else if (dr == BAD_COORD) {
-            return BAD_COORD;
-        }
-        
-        completeRoute.push_back(currRoute);
-        prevLoc = (*itr).location;
-    }
+    totalDistanceTravelled = 0;
+    return planTrip(depot, orderedDeliveries, commands, totalDistanceTravelled, timings);
+}
 
-        // Then find route back to the depot
-    list<StreetSegment> routeBackToDepot;
-    if (ptpr.generatePointToPointRoute(prevLoc, depot, routeBackToDepot, totalDistanceTravelled) == NO_ROUTE) {
-        return NO_ROUTE;
+DeliveryResult DeliveryPlannerImpl::generateFleetPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<double>& capacities,
+    vector<vector<DeliveryCommand>>& commands,
+    vector<double>& vehicleDistances,
+    double& totalDistanceTravelled) const
+{
+    DeliveryResult dr = checkLocations(depot, deliveries);
+    if (dr != DELIVERY_SUCCESS) {
+        return dr;
     }
-    completeRoute.push_back(routeBackToDepot);
-    
-        // Deliver all the items, generating DeliveryCommands
-    DeliveryCommand dc;
-    for (int i = 0; i < completeRoute.size() - 1; i++) {
-            // Checking for the case that the delivery of food is actually at the depot, in which case our first command is to deliver
-        if (completeRoute[i].empty()) {
-            dc.initAsDeliverCommand(deliveryItems[i]);
-            commands.push_back(dc);
-            continue;
-        }
-        
-        list<StreetSegment> currRoute = completeRoute[i];      // just makes the code easier to read
     
-            // If we do not deliver first, then our actual first command is to proceed down a street
-        list<StreetSegment>::iterator startSSItr = currRoute.begin();
-        StreetSegment startSS = *startSSItr;
-        
-        if (proceedAlongStreet(currRoute, startSS, startSSItr, commands, totalDistanceTravelled)) {
-            dc.initAsDeliverCommand(deliveryItems[i]);
-            commands.push_back(dc);
-            continue;
-        }
-        
-            // The next DC will either be a turn, or a proceed down a new street
-        auto currSSItr = startSSItr;
-        for (auto itr = currSSItr; itr != currRoute.end(); ) {
-            StreetSegment currSS = *itr;
-            auto prevSSItr = itr;
-            prevSSItr--;
-            StreetSegment prevSS = *prevSSItr;
-            
-            turnOntoStreet(prevSS, currSS, commands);
-            
-            if (proceedAlongStreet(currRoute, currSS, itr, commands, totalDistanceTravelled)) {
-                dc.initAsDeliverCommand(deliveryItems[i]);
-                commands.push_back(dc);
-                break;
-            }
-        }
+        // Split the deliveries between the vehicles, each share already in order
+    DeliveryOptimizer deliveryOpt(m_streetMap);
+    deliveryOpt.setTravelModel(m_travel);
+    vector<vector<DeliveryRequest>> vehicleDeliveries;
+    double crowDist = 0;
+    if (!deliveryOpt.optimizeFleet(depot, deliveries, capacities, vehicleDeliveries, crowDist)) {
+        return OVER_CAPACITY;
     }
     
-        // Now we'll return to the depot
-    list<StreetSegment> currRoute = completeRoute[completeRoute.size()-1];
-        // First command is to proceed down a street
-    list<StreetSegment>::iterator startSSItr = currRoute.begin();
-    StreetSegment startSS = *startSSItr;
-    
-    if (proceedAlongStreet(currRoute, startSS, startSSItr, commands, totalDistanceTravelled)) {
-        return DELIVERY_SUCCESS;
-    }
+        // Then each vehicle's trip is planned on whichever thread is free; a vehicle with nothing to deliver stays put
+    commands.assign(vehicleDeliveries.size(), vector<DeliveryCommand>());
+    vehicleDistances.assign(vehicleDeliveries.size(), 0);
+    vector<DeliveryResult> results(vehicleDeliveries.size(), DELIVERY_SUCCESS);
+    runInParallel(vehicleDeliveries.size(), m_threadCount, [&](size_t v) {
+        if (!vehicleDeliveries[v].empty()) {
+            results[v] = planTrip(depot, vehicleDeliveries[v], commands[v], vehicleDistances[v], nullptr);
+        }
+    });
     
-        // The next DC will either be a turn, or a proceed down a new street
-    auto currSSItr = startSSItr;
-    for (auto itr = currSSItr; itr != currRoute.end(); ) {
-        StreetSegment currSS = *itr;
-        auto prevSSItr = itr;
-        prevSSItr--;
-        StreetSegment prevSS = *prevSSItr;
-        
-        turnOntoStreet(prevSS, currSS, commands);
-        
-        if (proceedAlongStreet(currRoute, currSS, itr, commands, totalDistanceTravelled)) {
-            return DELIVERY_SUCCESS;
+    totalDistanceTravelled = 0;
+    for (size_t v = 0; v < results.size(); v++) {
+        if (results[v] != DELIVERY_SUCCESS) {
+            return results[v];
         }
+        totalDistanceTravelled += vehicleDistances[v];
     }
-    
-    
-    
     return DELIVERY_SUCCESS;
 }
 
+void DeliveryPlannerImpl::setThreadCount(unsigned int threads)
+{
+    m_threadCount = threads;
+}
+
+void DeliveryPlannerImpl::setTravelModel(const TravelModel& model)
+{
+    m_travel = model;
+}
+
+void DeliveryPlannerImpl::setRouteCache(RouteCache* cache)
+{
+    m_cache = cache;
+}
+
+void DeliveryPlannerImpl::setSnapDistance(double maxMiles)
+{
+    m_snapMiles = maxMiles;
+}
+
 /////////////////////////////////////////////////
 // Auxiliary Functions
 /////////////////////////////////////////////////
-    // Proceeds along a passed in current Street Segment until that Street ends
-bool DeliveryPlannerImpl::proceedAlongStreet(
-    list<StreetSegment>& currRoute,
-    const StreetSegment& currSS,
-    list<StreetSegment>::iterator& currSSItr,
+    // The node the router will use for gc: its own, or, if snapping is on, the one it snaps to
+NodeId DeliveryPlannerImpl::locate(const GeoCoord& gc) const {
+    NodeId node = m_graph.findNode(gc);
+    if (node == NO_NODE && m_snapMiles > 0) {
+        node = m_streetMap->getSpatialIndex().snap(gc, m_snapMiles);
+    }
+    return node;
+}
+
+    // BAD_COORD if the depot or a delivery isn't anywhere on the map, NO_ROUTE if a delivery is somewhere the depot has
+    //      no streets to
+DeliveryResult DeliveryPlannerImpl::checkLocations(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const {
+    NodeId depotNode = locate(depot);
+    if (depotNode == NO_NODE) {
+        return BAD_COORD;
+    }
+    for (const DeliveryRequest& request : deliveries) {
+        NodeId node = locate(request.location);
+        if (node == NO_NODE) {
+            return BAD_COORD;
+        } else if (!m_graph.mayReach(depotNode, node)) {
+            return NO_ROUTE;
+        }
+    }
+    return DELIVERY_SUCCESS;
+}
+
+    // Routes from the depot to each of orderedDeliveries in turn and back, appending the commands to commands and the
+    //      miles to distanceTravelled, and when each delivery gets there to timings, if there are any
+    // Every call has its own router, and searches in its own thread's SearchWorkspace, so trips can be planned at once
+DeliveryResult DeliveryPlannerImpl::planTrip(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& orderedDeliveries,
     vector<DeliveryCommand>& commands,
-    double& totalDistanceTravelled) const
+    double& distanceTravelled,
+    vector<DeliveryTiming>* timings) const
 {
-        // Find when we reach a Street Segment with a different name to our currStreet
-        // That indicates to us when to stop proceeding
-    list<StreetSegment>::iterator nextStreetItr = find_if(currSSItr, currRoute.end(), [currSS] (const StreetSegment& ss) { return ss.name != currSS.name; } );
+        // Generate point-to-point routes between the depot to each of the successive delivery points, and then back
+        //      to the depot
+        // Each leg is kept as just its EdgeIds; the commands are worked out from the graph, without any StreetSegments
+    vector<CompactRoute> legs(orderedDeliveries.size() + 1);
     
-        // nextStreetItr points to the Street Segment after the end of the currStreet
-        // Get the distance to travel along the road (sum of the lengths of each StreetSegment)
-    double dist = getDistanceAlongStreet(currSSItr, nextStreetItr);
-        // And then the direction to proceed
-    string dir = dirToWords(angleOfLine(currSS));
+    PointToPointRouter ptpr(m_streetMap);
+    if (m_streetMap->getContractionHierarchy() != nullptr) {
+        ptpr.setAlgorithm(CONTRACTION_HIERARCHY);
+    }
+    ptpr.setRouteCache(m_cache);
+    ptpr.setSnapDistance(m_snapMiles);
     
-        // Now init a proceed command
-    DeliveryCommand dc;
-    dc.initAsProceedCommand(dir, currSS.name, dist);
-    commands.push_back(dc);
+    GeoCoord prevLoc = depot;
+    for (size_t i = 0; i < legs.size(); i++) {
+        const GeoCoord& nextLoc = (i < orderedDeliveries.size()) ? orderedDeliveries[i].location : depot;
+        DeliveryResult dr = ptpr.generatePointToPointRoute(prevLoc, nextLoc, legs[i]);
+        if (dr != DELIVERY_SUCCESS) {
+            return dr;
+        }
+        prevLoc = nextLoc;
+    }
     
-        // Update currSSItr for use in caller
-    currSSItr = nextStreetItr;
+        // Deliver all the items, generating DeliveryCommands, and then return to the depot
+    for (size_t i = 0; i < legs.size(); i++) {
+        legCommands(legs[i], (i < orderedDeliveries.size()) ? &orderedDeliveries[i].item : nullptr, commands);
+        distanceTravelled += legs[i].distance();
+    }
     
-        // Did we deliver the item? (Or alternatively are we back at the depot?)
-        //      We return true if we did to inform the caller
-    if (nextStreetItr == currRoute.end()) {
-        return true;
-    } else {
-        return false;
+        // Then drive the legs at the travel model's speed, waiting wherever we're early
+    if (timings != nullptr) {
+        double time = 0;
+        for (size_t i = 0; i < orderedDeliveries.size(); i++) {
+            const DeliveryRequest& request = orderedDeliveries[i];
+            time += legs[i].distance() * m_travel.minutesPerMile();
+            timings->push_back({ request.item, time, max(time - request.latest, 0.0) });
+            time = max(time, request.earliest) + m_travel.serviceMinutes;
+        }
     }
     
+    return DELIVERY_SUCCESS;
+}
 
+    // Generates the commands for one leg of the trip: proceeding down each street in turn, turning between them,
+    //      and then delivering item at the end (no item means the leg is the one back to the depot)
+    // A leg can be empty, if the food is actually delivered to the depot, in which case our only command is to deliver
+void DeliveryPlannerImpl::legCommands(
+    const CompactRoute& leg,
+    const string* item,
+    vector<DeliveryCommand>& commands) const
+{
+    size_t i = 0;
+    while (i < leg.size()) {
+            // Every street after the first is either turned onto, or carried straight on into
+        if (i > 0) {
+            turnOntoStreet(leg.edges()[i - 1], leg.edges()[i], commands);
+        }
+        i = proceedAlongStreet(leg, i, commands);
+    }
     
+    if (item != nullptr) {
+        DeliveryCommand dc;
+        dc.initAsDeliverCommand(*item);
+        commands.push_back(dc);
+    }
 }
 
 /**
-* Works out the cumulative distance across all StreetSegments (SS) on a street
-* @param startSSItr An iterator pointing to the starting SS of the road we're proceeding down
-* @param endSSItr An iterator pointing to the SS following the last SS on the road we're proceeding down (it's used as a stopping condition)
-* @return The distance to proceed along the road
+* Proceeds along the street the leg's first'th segment is on, until that street ends
+* @param leg The leg of the trip we're on
+* @param first The index in leg of the first segment on the street
+* @return The index in leg of the first segment on the next street, or leg.size() if the leg ends on this street
 */
-double DeliveryPlannerImpl::getDistanceAlongStreet(
-    const list<StreetSegment>::iterator startSSItr,
-    const list<StreetSegment>::iterator endSSItr) const
+size_t DeliveryPlannerImpl::proceedAlongStreet(
+    const CompactRoute& leg,
+    size_t first,
+    vector<DeliveryCommand>& commands) const
 {
-        // prev due to use in loop
-    auto ssItr = startSSItr;
-    
-    double distance = 0;
+        // Find when we reach a segment with a different name to our current street, adding up the lengths of the ones
+        //      before it to get the distance to travel along the road
+        // Every record has its own name in the graph, so the names are compared rather than their StreetNameIds
+    string_view name = leg[first].name();
+    double dist = 0;
+    size_t next = first;
+    while (next < leg.size() && leg[next].name() == name) {
+        dist += leg[next].length();
+        next++;
+    }
     
-    while (ssItr != endSSItr) {
-            // Work out length of each SS we travel down
-        distance += distanceEarthMiles((*ssItr).start, (*ssItr).end);
-        ssItr++;
+        // And then the direction to proceed, and init a proceed command
+    double dir = rad2deg(edgeHeading(leg.edges()[first]));
+    if (dir < 0) {
+        dir += 360;
     }
-
-    return distance;
+    DeliveryCommand dc;
+    dc.initAsProceedCommand(dirToWords(dir), string(name), dist);
+    commands.push_back(dc);
+    
+    return next;
 }
 
     // Turns onto a new Street from a prev Street, also working out whether that turn is a left or a right
 void DeliveryPlannerImpl::turnOntoStreet(
-    const StreetSegment &prevSS,
-    const StreetSegment &currSS,
-    vector<DeliveryCommand> &commands) const
+    EdgeId prevEdge,
+    EdgeId currEdge,
+    vector<DeliveryCommand>& commands) const
 {
-    double turnDirDeg = angleBetween2Lines(prevSS, currSS);
+    double turnDirDeg = rad2deg(edgeHeading(currEdge) - edgeHeading(prevEdge));
+    if (turnDirDeg < 0) {
+        turnDirDeg += 360;
+    }
     DeliveryCommand dc;
+    string name(m_graph.streetName(m_graph.edgeStreet(currEdge)));
     
     if (turnDirDeg >= 1 && turnDirDeg < 180) {
             // Turn left
-        dc.initAsTurnCommand("left", currSS.name);
+        dc.initAsTurnCommand("left", name);
         commands.push_back(dc);
     } else if (turnDirDeg >= 180 && turnDirDeg <= 359) {
             // Turn right
-        dc.initAsTurnCommand("right", currSS.name);
+        dc.initAsTurnCommand("right", name);
         commands.push_back(dc);
     } else {    // turnDirDeg < 1 || turnDirDeg > 359
             // Do not generate a turn command
@@ -243,6 +324,13 @@ void DeliveryPlannerImpl::turnOntoStreet(
     }
 }
 
+    // The angle of a segment from due east, in radians, worked out from the coordinates in the graph just like
+    //      angleOfLine() and angleBetween2Lines() do from a StreetSegment's
+double DeliveryPlannerImpl::edgeHeading(EdgeId e) const {
+    NodeId from = m_graph.edgeSource(e);
+    NodeId to = m_graph.edgeTarget(e);
+    return atan2(m_graph.latitude(to) - m_graph.latitude(from), m_graph.longitude(to) - m_graph.longitude(from));
+}
 
     // Converts a direction in degrees to something in words
 string DeliveryPlannerImpl::dirToWords(const double& dir) const {
@@ -288,5 +376,47 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled,
+    vector<DeliveryTiming>& timings) const
+{
+    timings.clear();
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, &timings);
+}
+
+DeliveryResult DeliveryPlanner::generateFleetPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<double>& capacities,
+    vector<vector<DeliveryCommand>>& commands,
+    vector<double>& vehicleDistances,
+    double& totalDistanceTravelled) const
+{
+    return m_impl->generateFleetPlan(depot, deliveries, capacities, commands, vehicleDistances, totalDistanceTravelled);
+}
+
+void DeliveryPlanner::setThreadCount(unsigned int threads)
+{
+    m_impl->setThreadCount(threads);
+}
+
+void DeliveryPlanner::setTravelModel(const TravelModel& model)
+{
+    m_impl->setTravelModel(model);
+}
+
+void DeliveryPlanner::setRouteCache(RouteCache* cache)
+{
+    m_impl->setRouteCache(cache);
+}
+
+void DeliveryPlanner::setSnapDistance(double maxMiles)
+{
+    m_impl->setSnapDistance(maxMiles);
 }
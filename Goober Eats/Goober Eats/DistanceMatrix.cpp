@@ -0,0 +1,193 @@
+#include "provided.h"
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include "ContractionHierarchy.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+using namespace std;
+
+class DistanceMatrixImpl
+{
+public:
+    DistanceMatrixImpl(const StreetMap* sm);
+    ~DistanceMatrixImpl();
+    DeliveryResult computeDistances(
+        const vector<GeoCoord>& sources,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const;
+    void setThreadCount(unsigned int threads);
+private:
+    const StreetMap* m_streetMap;
+    const StreetGraph& m_graph;
+    unsigned int m_threadCount;
+
+    void dijkstraDistances(const vector<NodeId>& sources, const vector<NodeId>& targets, double* distances) const;
+    void hierarchyDistances(const vector<NodeId>& sources, const vector<NodeId>& targets, double* distances) const;
+};
+
+DistanceMatrixImpl::DistanceMatrixImpl(const StreetMap* sm) : m_streetMap(sm), m_graph(sm->getStreetGraph()), m_threadCount(0)
+{}
+
+DistanceMatrixImpl::~DistanceMatrixImpl()
+{}
+
+DeliveryResult DistanceMatrixImpl::computeDistances(
+        const vector<GeoCoord>& sources,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const
+{
+        // Check every GeoCoord is in m_streetMap before doing any work
+    vector<NodeId> sourceNodes;
+    vector<NodeId> targetNodes;
+    for (const GeoCoord& gc : sources) {
+        sourceNodes.push_back(m_graph.findNode(gc));
+    }
+    for (const GeoCoord& gc : targets) {
+        targetNodes.push_back(m_graph.findNode(gc));
+    }
+    if (find(sourceNodes.begin(), sourceNodes.end(), NO_NODE) != sourceNodes.end()
+        || find(targetNodes.begin(), targetNodes.end(), NO_NODE) != targetNodes.end()) {
+        return BAD_COORD;
+    }
+
+    distances.assign(sources.size() * targets.size(), numeric_limits<double>::infinity());
+    if (distances.empty()) {
+        return DELIVERY_SUCCESS;
+    }
+    if (m_streetMap->getContractionHierarchy() != nullptr) {
+        hierarchyDistances(sourceNodes, targetNodes, distances.data());
+    } else {
+        dijkstraDistances(sourceNodes, targetNodes, distances.data());
+    }
+    return DELIVERY_SUCCESS;
+}
+
+void DistanceMatrixImpl::setThreadCount(unsigned int threads)
+{
+    m_threadCount = threads;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+/**
+* One Dijkstra search per source, which stops as soon as it has settled every target rather than running over the whole map
+* Dijkstra rather than A*, since there is no one target to aim for; each thread searches in its own SearchWorkspace
+* Targets in a different weak component from the source aren't waited for, so a source on an island of the map costs
+*   no more than the island
+* @param distances The matrix to fill in, row by row; entries for targets a search never settles are left infinite
+*/
+void DistanceMatrixImpl::dijkstraDistances(const vector<NodeId>& sources, const vector<NodeId>& targets, double* distances) const {
+        // Several targets can be the same node; the search only needs to know which nodes are targets, and how many
+        //      of them are in each weak component, since those are the only ones a search can ever settle
+    vector<char> isTarget(m_graph.nodeCount(), false);
+    vector<size_t> targetNodes(m_graph.weakComponentCount(), 0);
+    for (NodeId t : targets) {
+        targetNodes[m_graph.weakComponent(t)] += !isTarget[t];
+        isTarget[t] = true;
+    }
+
+    runInParallel(sources.size(), m_threadCount, [&](size_t s) {
+        SearchWorkspace& workspace = SearchWorkspace::forThread(m_graph);
+        workspace.beginSearch();
+        SearchSpace& search = workspace.forward();
+        IndexedHeap<double>& openSet = search.openSet();
+
+        search.reach(sources[s], 0, NO_EDGE);
+        openSet.push(sources[s], 0);
+        size_t targetsLeft = targetNodes[m_graph.weakComponent(sources[s])];
+        while (!openSet.empty() && targetsLeft != 0) {
+            NodeId currNode = openSet.pop();
+            search.close(currNode);
+            targetsLeft -= isTarget[currNode];
+
+            double currGCost = search.node(currNode).gCost;
+            for (EdgeId e = m_graph.edgeBegin(currNode); e != m_graph.edgeEnd(currNode); e++) {
+                NodeId child = m_graph.edgeTarget(e);
+                double gCost = currGCost + m_graph.edgeLength(e);
+                if (search.closed(child) || (search.reached(child) && search.node(child).gCost <= gCost)) {
+                    continue;
+                }
+                search.reach(child, gCost, e);
+                openSet.pushOrDecrease(child, gCost);
+            }
+        }
+
+        double* row = distances + s * targets.size();
+        for (size_t t = 0; t < targets.size(); t++) {
+            if (search.closed(targets[t])) {
+                row[t] = search.node(targets[t]).gCost;
+            }
+        }
+    });
+}
+
+/**
+* Bucket based many to many search over the map's ContractionHierarchy
+* First one upward search back from each target leaves an entry (the target, and the distance to it) in the bucket
+*   of every node it settles. Then one upward search from each source looks in the bucket of every node it settles:
+*   every shortest path climbs to a top node that both its source's and its target's searches settle
+* Each search only settles a few hundred nodes, so the whole matrix costs about (sources + targets) point to point queries
+*/
+void DistanceMatrixImpl::hierarchyDistances(const vector<NodeId>& sources, const vector<NodeId>& targets, double* distances) const {
+    const ContractionHierarchy& hierarchy = *m_streetMap->getContractionHierarchy();
+
+        // Each target's entries go into its own list, so the threads never share one
+    vector<vector<ContractionHierarchy::BucketEntry>> entries(targets.size());
+    runInParallel(targets.size(), m_threadCount, [&](size_t t) {
+        hierarchy.searchToTarget(SearchWorkspace::forThread(m_graph), targets[t], static_cast<uint32_t>(t), entries[t]);
+    });
+
+        // Sort the entries into buckets by node, like the edges of a CSR graph
+    vector<uint32_t> bucketOffsets(m_graph.nodeCount() + 1, 0);
+    for (const auto& targetEntries : entries) {
+        for (const ContractionHierarchy::BucketEntry& entry : targetEntries) {
+            bucketOffsets[entry.node + 1]++;
+        }
+    }
+    for (size_t n = 0; n < m_graph.nodeCount(); n++) {
+        bucketOffsets[n + 1] += bucketOffsets[n];
+    }
+    vector<ContractionHierarchy::BucketEntry> buckets(bucketOffsets.back());
+    vector<uint32_t> nextEntry(bucketOffsets.begin(), bucketOffsets.end() - 1);
+    for (auto& targetEntries : entries) {
+        for (const ContractionHierarchy::BucketEntry& entry : targetEntries) {
+            buckets[nextEntry[entry.node]++] = entry;
+        }
+        vector<ContractionHierarchy::BucketEntry>().swap(targetEntries);
+    }
+
+    runInParallel(sources.size(), m_threadCount, [&](size_t s) {
+        hierarchy.scanBuckets(SearchWorkspace::forThread(m_graph), sources[s], bucketOffsets, buckets,
+                              distances + s * targets.size(), targets.size());
+    });
+}
+
+//******************** DistanceMatrix functions ********************************
+
+// These functions simply delegate to DistanceMatrixImpl's functions.
+
+DistanceMatrix::DistanceMatrix(const StreetMap* sm)
+{
+    m_impl = new DistanceMatrixImpl(sm);
+}
+
+DistanceMatrix::~DistanceMatrix()
+{
+    delete m_impl;
+}
+
+DeliveryResult DistanceMatrix::computeDistances(
+        const vector<GeoCoord>& sources,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const
+{
+    return m_impl->computeDistances(sources, targets, distances);
+}
+
+void DistanceMatrix::setThreadCount(unsigned int threads)
+{
+    m_impl->setThreadCount(threads);
+}
@@ -5,6 +5,11 @@
 
 ///
 
+#ifndef EXPANDABLEHASHMAP_INCLUDED
+#define EXPANDABLEHASHMAP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
 #include <list>
 #include <vector>
 #include <utility>
@@ -14,7 +19,11 @@ class ExpandableHashMap
 {
 public:
         // constructor
-    ExpandableHashMap(double maximumLoadFactor = 0.5);
+        // Normally, the associate() that takes the hashmap past its maximum load factor moves every item
+        // into a table twice the size before it returns. With incrementalRehash set, the bigger table is
+        // filled a few buckets at a time by the associate() calls that follow instead, so no single call
+        // has to touch every item; until it is full, find() looks in whichever table holds the key's bucket
+    ExpandableHashMap(double maximumLoadFactor = 0.5, bool incrementalRehash = false);
         // destructor; deletes all of the items in the hashmap
     ~ExpandableHashMap();
         
@@ -22,6 +31,8 @@ public:
     void reset();
         // return the number of associations in the hashmap
     int size() const;
+        // whether an incremental rehash is still moving items into the bigger table
+    bool isRehashing() const { return !m_oldHashmap.empty(); }
     
         // The associate method associates one item (key) with another (value).
         // If no association currently exists with that key, this method inserts
@@ -48,26 +59,60 @@ public:
         return const_cast<ValueType*>(const_cast<const ExpandableHashMap*>(this)->find(key));
     }
 
+        // Approximate number of bytes of heap memory held by the hashmap
+        // (each association sits in its own list node, next to the node's two links)
+    size_t memoryUsage() const {
+        return (m_hashmap.capacity() + m_oldHashmap.capacity()) * sizeof(Bucket)
+             + m_size * (sizeof(std::pair<KeyType, ValueType>) + 2 * sizeof(void*));
+    }
+
       // C++11 syntax for preventing copying and assignment
     ExpandableHashMap(const ExpandableHashMap&) = delete;
     ExpandableHashMap& operator=(const ExpandableHashMap&) = delete;
 
 private:
-    std::vector<std::list<std::pair<KeyType, ValueType>>> m_hashmap;
+    typedef std::list<std::pair<KeyType, ValueType>> Bucket;
+    
+    std::vector<Bucket> m_hashmap;
+    unsigned int m_bucketBits;      // m_hashmap has 2^m_bucketBits buckets (once any rehash has finished)
+    
+        // While rehashing, the previous table. Its buckets [0, m_migrated) have been emptied into
+        //      m_hashmap already, with old bucket i becoming new buckets 2i and 2i+1
+    std::vector<Bucket> m_oldHashmap;
+    size_t m_migrated;
     
     size_t m_size;
     double m_maxLoadFactor;
+    bool m_incremental;
+    size_t m_migrationStep;         // old buckets moved per associate() while rehashing
     
-    unsigned int getBucketNumber(const KeyType& key) const {
+        // Uses the top bits of the (scrambled) hash, so doubling the table splits each bucket into two neighbours
+    static unsigned int getBucketNumber(unsigned int h, unsigned int bits) {
+        return static_cast<uint32_t>(h * 2654435769u) >> (32 - bits);
+    }
+    
+    static unsigned int getHash(const KeyType& key) {
         unsigned int hasher(const KeyType& k);
-        unsigned int h = hasher(key);
-        return h % m_hashmap.size();
+        return hasher(key);
     }
+    
+    const Bucket& getBucket(unsigned int h) const;
+    Bucket& getBucket(unsigned int h) {
+        return const_cast<Bucket&>(const_cast<const ExpandableHashMap*>(this)->getBucket(h));
+    }
+    
+    void grow();
+    void migrateBuckets(size_t count);
 };
 
 template <typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor) : m_hashmap(8), m_size(0), m_maxLoadFactor(maximumLoadFactor)
-{}
+ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor, bool incrementalRehash)
+ : m_hashmap(8), m_bucketBits(3), m_migrated(0), m_size(0), m_maxLoadFactor(maximumLoadFactor), m_incremental(incrementalRehash)
+{
+        // The table doubles after another (maximum load factor * old bucket count) insertions at the soonest,
+        //      so moving 1 / maximum load factor old buckets per call always finishes before then
+    m_migrationStep = static_cast<size_t>(1.0 / maximumLoadFactor) + 2;
+}
 
 template <typename KeyType, typename ValueType>
 ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap()
@@ -77,8 +122,11 @@ template <typename KeyType, typename ValueType>
 void ExpandableHashMap<KeyType, ValueType>::reset()
 {
     m_hashmap.clear();
+    std::vector<Bucket>().swap(m_oldHashmap);
+    m_migrated = 0;
     m_size = 0;
-    m_hashmap.resize();
+    m_hashmap.resize(8);
+    m_bucketBits = 3;
 }
 
 template <typename KeyType, typename ValueType>
@@ -90,38 +138,37 @@ int ExpandableHashMap<KeyType, ValueType>::size() const
 template <typename KeyType, typename ValueType>
 void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
 {
+    unsigned int h = getHash(key);
+    Bucket& bucket = getBucket(h);
+    
     // If we find the key already exists in our hashmap, we update its value with the new value
-    ValueType* ptr = find(key);
-    if (ptr != nullptr) {
-        *ptr = value;
+    bool found = false;
+    for (auto& [k, v] : bucket) {
+        if (k == key) {
+            v = value;
+            found = true;
+            break;
+        }
     }
     
     // Else, we did not find the key, so create a new association
-    unsigned int bucketNum = getBucketNumber(key);
-    m_hashmap[bucketNum].emplace_back(key, value);
-    m_size++;
+    if (!found) {
+        bucket.emplace_back(key, value);
+        m_size++;
+    }
     
-    // Rehash if we exceed maxLoadFactor
-    if (static_cast<double>(m_size) / m_hashmap.size() > m_maxLoadFactor) {
-        // Create new vector with increased capacity, and swap this with the current vector
-        std::vector<std::list<std::pair<KeyType, ValueType>>> temp(m_hashmap.size() * 2);
-        m_hashmap.swap(temp);
-        
-        // Re-emplace all the values in the new vector, making sure to account for new hashes
-        for (std::list<std::pair<KeyType, ValueType>>& bucket : temp) {
-            for (auto& [k, v] : bucket) {
-                m_hashmap[getBucketNumber(k)].emplace_back(k, v);
-            }
-        }
+    // Carry on with a rehash that is under way, or start one if we exceed maxLoadFactor
+    if (isRehashing()) {
+        migrateBuckets(m_migrationStep);
+    } else if (static_cast<double>(m_size) / (size_t(1) << m_bucketBits) > m_maxLoadFactor) {
+        grow();
     }
 }
 
 template <typename KeyType, typename ValueType>
 const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const
 {
-    unsigned int bucketNum = getBucketNumber(key);
-    
-    for (auto& [k, v] : m_hashmap[bucketNum]) {
+    for (auto& [k, v] : getBucket(getHash(key))) {
         if (k == key) {
             return &v;
         }
@@ -130,3 +177,56 @@ const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key)
     // else we return the nullptr
     return nullptr;
 }
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // The bucket the key with hash h is in, if it is in the hashmap at all
+template <typename KeyType, typename ValueType>
+const typename ExpandableHashMap<KeyType, ValueType>::Bucket& ExpandableHashMap<KeyType, ValueType>::getBucket(unsigned int h) const
+{
+    if (isRehashing()) {
+        unsigned int oldBucketNum = getBucketNumber(h, m_bucketBits - 1);
+        if (oldBucketNum >= m_migrated) {
+            return m_oldHashmap[oldBucketNum];
+        }
+    }
+    return m_hashmap[getBucketNumber(h, m_bucketBits)];
+}
+
+    // Swaps in a table with twice as many buckets, and starts moving the items across
+    // Only the space for the new buckets is allocated here; each one is constructed when its items arrive
+template <typename KeyType, typename ValueType>
+void ExpandableHashMap<KeyType, ValueType>::grow()
+{
+    m_oldHashmap.swap(m_hashmap);
+    m_bucketBits++;
+    m_hashmap.reserve(size_t(1) << m_bucketBits);
+    m_migrated = 0;
+    
+    migrateBuckets(m_incremental ? m_migrationStep : m_oldHashmap.size());
+}
+
+    // Moves the next count buckets of the old table into the new one
+    // The list nodes are spliced across, so no key or value is copied, and pointers returned by find() stay valid
+template <typename KeyType, typename ValueType>
+void ExpandableHashMap<KeyType, ValueType>::migrateBuckets(size_t count)
+{
+    size_t end = std::min(m_migrated + count, m_oldHashmap.size());
+    for (; m_migrated < end; m_migrated++) {
+        Bucket& from = m_oldHashmap[m_migrated];
+        Bucket& low = m_hashmap.emplace_back();
+        Bucket& high = m_hashmap.emplace_back();
+        while (!from.empty()) {
+            Bucket& to = (getBucketNumber(getHash(from.front().first), m_bucketBits) & 1) ? high : low;
+            to.splice(to.end(), from, from.begin());
+        }
+    }
+    
+    if (m_migrated == m_oldHashmap.size()) {
+        std::vector<Bucket>().swap(m_oldHashmap);
+        m_migrated = 0;
+    }
+}
+
+#endif // EXPANDABLEHASHMAP_INCLUDED
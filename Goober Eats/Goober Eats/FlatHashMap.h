@@ -0,0 +1,281 @@
+// FlatHashMap.h
+
+// An open addressing variant of ExpandableHashMap, with the same associate/find/size/reset
+// interface and the same hasher() convention.
+//
+// All the associations live in one flat array, so inserting doesn't allocate a list node and a
+// lookup is a short linear scan instead of a pointer chase. Collisions are resolved with Robin
+// Hood hashing: every slot remembers how far it is from its home bucket, and an insert that has
+// probed further than the occupant of a slot takes that slot and carries the occupant on. This
+// keeps probe sequences short even at high load factors, and lets find() stop as soon as it
+// reaches a slot that is closer to home than the key it is looking for would be.
+
+#ifndef FLATHASHMAP_INCLUDED
+#define FLATHASHMAP_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+template<typename KeyType, typename ValueType>
+class FlatHashMap
+{
+public:
+        // constructor
+    FlatHashMap(double maximumLoadFactor = 0.8);
+        // destructor; deletes all of the items in the hashmap
+    ~FlatHashMap();
+
+        // resets the hashmap back to 8 buckets, deletes all items
+    void reset();
+        // return the number of associations in the hashmap
+    int size() const;
+        // make room for at least n associations without growing again
+    void reserve(size_t n);
+        // exchange all the associations with those of other, without copying any
+    void swap(FlatHashMap& other);
+
+        // The associate method associates one item (key) with another (value).
+        // If no association currently exists with that key, this method inserts
+        // a new association into the hashmap with that key-value pair.
+        // If there is already an association with that key in the hashmap, then
+        // the item associated with that key is replaced by the second parameter
+        // (the value), i.e. it is updated
+    void associate(const KeyType& key, const ValueType& value);
+    void associate(const KeyType& key, ValueType&& value);
+
+        // If no association exists with the key, constructs a value from args and inserts it.
+        // Either way, returns a pointer to the value associated with the key, and whether it was inserted.
+        // Nothing is constructed if the key is already there.
+    template<typename... Args>
+    std::pair<ValueType*, bool> try_emplace(const KeyType& key, Args&&... args);
+
+        // If no association exists with the given key, return nullptr; otherwise,
+        // return a pointer to the value associated with that key.
+    const ValueType* find(const KeyType& key) const;
+
+    ValueType* find(const KeyType& key)
+    {
+        return const_cast<ValueType*>(const_cast<const FlatHashMap*>(this)->find(key));
+    }
+
+        // Approximate number of bytes of heap memory held by the hashmap
+    size_t memoryUsage() const { return m_capacity * (sizeof(Entry) + sizeof(uint8_t)); }
+
+      // C++11 syntax for preventing copying and assignment
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+        // m_distances[i] is 0 if slot i is empty, and otherwise 1 + how far the entry in it is from its home slot
+        // The entries themselves are raw storage, constructed only in occupied slots
+    std::vector<uint8_t> m_distances;
+    Entry* m_entries;
+    size_t m_capacity;          // always a power of 2
+    size_t m_size;
+    double m_maxLoadFactor;
+
+    size_t homeSlot(const KeyType& key) const {
+        unsigned int hasher(const KeyType& k);
+        return hasher(key) & (m_capacity - 1);
+    }
+
+    void allocate(size_t capacity);
+    void destroyAll();
+    void grow();
+    Entry* insertNew(Entry&& entry);
+};
+
+template <typename KeyType, typename ValueType>
+FlatHashMap<KeyType, ValueType>::FlatHashMap(double maximumLoadFactor) : m_entries(nullptr), m_capacity(0), m_size(0), m_maxLoadFactor(maximumLoadFactor)
+{
+    allocate(8);
+}
+
+template <typename KeyType, typename ValueType>
+FlatHashMap<KeyType, ValueType>::~FlatHashMap()
+{
+    destroyAll();
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::reset()
+{
+    destroyAll();
+    allocate(8);
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::swap(FlatHashMap& other)
+{
+    m_distances.swap(other.m_distances);
+    std::swap(m_entries, other.m_entries);
+    std::swap(m_capacity, other.m_capacity);
+    std::swap(m_size, other.m_size);
+    std::swap(m_maxLoadFactor, other.m_maxLoadFactor);
+}
+
+template <typename KeyType, typename ValueType>
+int FlatHashMap<KeyType, ValueType>::size() const
+{
+    return static_cast<int>(m_size);
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::reserve(size_t n)
+{
+    while (static_cast<double>(n) > m_capacity * m_maxLoadFactor) {
+        grow();
+    }
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+{
+    std::pair<ValueType*, bool> result = try_emplace(key, value);
+    if (!result.second) {
+        *result.first = value;
+    }
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::associate(const KeyType& key, ValueType&& value)
+{
+    ValueType* existing = find(key);
+    if (existing != nullptr) {
+        *existing = std::move(value);
+    } else {
+        try_emplace(key, std::move(value));
+    }
+}
+
+template <typename KeyType, typename ValueType>
+template<typename... Args>
+std::pair<ValueType*, bool> FlatHashMap<KeyType, ValueType>::try_emplace(const KeyType& key, Args&&... args)
+{
+    ValueType* existing = find(key);
+    if (existing != nullptr) {
+        return std::make_pair(existing, false);
+    }
+
+        // Grow before inserting, so the pointer we hand back stays valid until the next insert
+    if (static_cast<double>(m_size + 1) > m_capacity * m_maxLoadFactor) {
+        grow();
+    }
+    Entry* entry = insertNew(Entry(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)));
+    if (entry == nullptr) {
+        return std::make_pair(find(key), true);
+    }
+    return std::make_pair(&entry->second, true);
+}
+
+template <typename KeyType, typename ValueType>
+const ValueType* FlatHashMap<KeyType, ValueType>::find(const KeyType& key) const
+{
+    size_t mask = m_capacity - 1;
+    size_t slot = homeSlot(key);
+
+        // Every entry we pass is at least as far from home as we are, or the key would have displaced it
+    for (unsigned distance = 1; m_distances[slot] >= distance; distance++) {
+        if (m_distances[slot] == distance && m_entries[slot].first == key) {
+            return &m_entries[slot].second;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return nullptr;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::allocate(size_t capacity)
+{
+    m_entries = static_cast<Entry*>(::operator new(capacity * sizeof(Entry)));
+    m_distances.assign(capacity, 0);
+    m_capacity = capacity;
+    m_size = 0;
+}
+
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::destroyAll()
+{
+    for (size_t i = 0; i < m_capacity; i++) {
+        if (m_distances[i] != 0) {
+            m_entries[i].~Entry();
+        }
+    }
+    ::operator delete(m_entries);
+    m_entries = nullptr;
+    m_capacity = 0;
+    m_size = 0;
+}
+
+    // Doubles the number of slots, moving (not copying) every entry across
+template <typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::grow()
+{
+    std::vector<uint8_t> oldDistances;
+    oldDistances.swap(m_distances);
+    Entry* oldEntries = m_entries;
+    size_t oldCapacity = m_capacity;
+
+    allocate(oldCapacity * 2);
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldDistances[i] != 0) {
+            insertNew(std::move(oldEntries[i]));
+            oldEntries[i].~Entry();
+        }
+    }
+    ::operator delete(oldEntries);
+}
+
+    // Robin Hood insertion of a key we know isn't in the map yet
+    // Returns where the new entry ended up, or nullptr if the table had to grow part way through
+template <typename KeyType, typename ValueType>
+typename FlatHashMap<KeyType, ValueType>::Entry* FlatHashMap<KeyType, ValueType>::insertNew(Entry&& entry)
+{
+    size_t mask = m_capacity - 1;
+    size_t slot = homeSlot(entry.first);
+    unsigned distance = 1;
+    Entry* placed = nullptr;
+
+    for (;;) {
+        if (m_distances[slot] == 0) {
+            new (&m_entries[slot]) Entry(std::move(entry));
+            m_distances[slot] = static_cast<uint8_t>(distance);
+            m_size++;
+            return placed != nullptr ? placed : &m_entries[slot];
+        }
+
+            // Take the slot from an entry that is closer to its home than we are to ours, and carry it on
+        if (m_distances[slot] < distance) {
+            std::swap(entry, m_entries[slot]);
+            unsigned displaced = m_distances[slot];
+            m_distances[slot] = static_cast<uint8_t>(distance);
+            distance = displaced;
+            if (placed == nullptr) {
+                placed = &m_entries[slot];
+            }
+        }
+
+        slot = (slot + 1) & mask;
+        distance++;
+
+            // Probe distances are stored in a byte; a run this long means we should have more room anyway
+            //      Growing moves everything, so the caller has to look the new entry up again
+        if (distance == UINT8_MAX) {
+            grow();
+            insertNew(std::move(entry));
+            return nullptr;
+        }
+    }
+}
+
+#endif // FLATHASHMAP_INCLUDED
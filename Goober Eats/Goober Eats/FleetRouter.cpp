@@ -0,0 +1,386 @@
+#include "FleetRouter.h"
+#include "TourImprover.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+using namespace std;
+
+    // A move has to shorten the routes by more than this, so rounding can't have two moves undo each other forever
+const double MIN_GAIN = 1e-10;
+
+FleetRouter::FleetRouter(const double* distances, const double* loads, size_t count)
+ : m_distances(distances), m_loads(loads), m_count(count)
+{}
+
+bool FleetRouter::route(const vector<double>& capacities, vector<vector<uint32_t>>& routes)
+{
+    auto start = chrono::steady_clock::now();
+    m_stats = FleetRouterStats();
+    routes.clear();
+    size_t nStops = (m_count == 0) ? 0 : m_count - 1;
+    if (nStops == 0) {
+        routes.resize(capacities.size());
+        return true;
+    }
+    if (capacities.empty()) {
+        return false;
+    }
+
+        // Stops too heavy for any vehicle, or more load than the whole fleet has room for, can't be helped
+    double maxCapacity = *max_element(capacities.begin(), capacities.end());
+    double totalLoad = 0;
+    for (size_t s = 1; s < m_count; s++) {
+        if (m_loads[s] > maxCapacity) {
+            return false;
+        }
+        totalLoad += m_loads[s];
+    }
+    if (totalLoad > accumulate(capacities.begin(), capacities.end(), 0.0)) {
+        return false;
+    }
+
+        // Every stop starts on a route of its own
+    m_routes.assign(nStops, vector<uint32_t>());
+    m_routeLoads.assign(nStops, 0);
+    m_routeOf.assign(m_count, 0);
+    m_positionOf.assign(m_count, 0);
+    for (uint32_t s = 1; s < m_count; s++) {
+        m_routes[s - 1].push_back(s);
+        m_routeLoads[s - 1] = m_loads[s];
+        m_routeOf[s] = s - 1;
+    }
+
+    buildSavingsRoutes(maxCapacity);
+    joinDownTo(capacities.size(), maxCapacity);
+
+        // The heaviest route goes on the biggest vehicle, and so on down, which fits them all if any assignment of whole
+        //      routes to vehicles does
+    vector<uint32_t> used;
+    for (uint32_t r = 0; r < m_routes.size(); r++) {
+        if (!m_routes[r].empty()) {
+            used.push_back(r);
+        }
+    }
+    stable_sort(used.begin(), used.end(), [this] (uint32_t r1, uint32_t r2) { return m_routeLoads[r1] > m_routeLoads[r2]; });
+    vector<uint32_t> vehicles(capacities.size());
+    iota(vehicles.begin(), vehicles.end(), 0);
+    stable_sort(vehicles.begin(), vehicles.end(), [&capacities] (uint32_t v1, uint32_t v2) { return capacities[v1] > capacities[v2]; });
+    vector<vector<uint32_t>> assigned(capacities.size());
+    for (size_t i = 0; i < used.size(); i++) {
+        assigned[vehicles[i]].swap(m_routes[used[i]]);
+    }
+    m_routes.swap(assigned);
+    m_capacities = capacities;
+    m_routeLoads.assign(m_routes.size(), 0);
+    for (uint32_t r = 0; r < m_routes.size(); r++) {
+        for (uint32_t s : m_routes[r]) {
+            m_routeOf[s] = r;
+            m_routeLoads[r] += m_loads[s];
+        }
+        updatePositions(r, 0);
+        m_stats.savingsMiles += routeLength(m_routes[r]);
+    }
+
+    if (!repairOverloads()) {
+        m_routes.clear();
+        return false;
+    }
+    searchBetweenRoutes();
+
+    routes = m_routes;
+    for (const vector<uint32_t>& r : routes) {
+        m_stats.miles += routeLength(r);
+    }
+    m_stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // The locations either side of stop on its route, the depot at either end
+uint32_t FleetRouter::prev(uint32_t stop) const
+{
+    uint32_t position = m_positionOf[stop];
+    return (position == 0) ? 0 : m_routes[m_routeOf[stop]][position - 1];
+}
+
+uint32_t FleetRouter::next(uint32_t stop) const
+{
+    const vector<uint32_t>& route = m_routes[m_routeOf[stop]];
+    uint32_t position = m_positionOf[stop];
+    return (position + 1 == route.size()) ? 0 : route[position + 1];
+}
+
+double FleetRouter::routeLength(const vector<uint32_t>& route) const
+{
+    if (route.empty()) {
+        return 0;
+    }
+    double length = distance(0, route.front()) + distance(route.back(), 0);
+    for (size_t i = 1; i < route.size(); i++) {
+        length += distance(route[i - 1], route[i]);
+    }
+    return length;
+}
+
+    // Joins routes end to end, biggest saving first, as long as the joined load fits the biggest vehicle
+    // Two stops can only be joined if each is at an end of its route, next to the depot
+void FleetRouter::buildSavingsRoutes(double maxCapacity)
+{
+    size_t k = min(SAVINGS_NEIGHBOURS, m_count - 1);
+    vector<uint32_t> neighbours;
+    TourImprover::nearestNeighbours(m_distances, m_count, k, neighbours);
+
+    struct Saving {
+        double saving;
+        uint32_t a;
+        uint32_t b;
+    };
+    vector<Saving> savings;
+    for (uint32_t a = 1; a < m_count; a++) {
+        for (size_t i = 0; i < k; i++) {
+            uint32_t b = neighbours[a * k + i];
+            double saving = distance(0, a) + distance(0, b) - distance(a, b);
+            if (b != 0 && saving > 0) {
+                savings.push_back({ saving, min(a, b), max(a, b) });
+            }
+        }
+    }
+        // Ties are broken by stop, so the routes never depend on the sort
+    sort(savings.begin(), savings.end(), [] (const Saving& s1, const Saving& s2) {
+        return (s1.saving != s2.saving) ? s1.saving > s2.saving : (s1.a != s2.a) ? s1.a < s2.a : s1.b < s2.b;
+    });
+
+    for (const Saving& s : savings) {
+        uint32_t ra = m_routeOf[s.a];
+        uint32_t rb = m_routeOf[s.b];
+        if (ra == rb || m_routeLoads[ra] + m_routeLoads[rb] > maxCapacity) {
+            continue;
+        }
+        const vector<uint32_t>& routeA = m_routes[ra];
+        const vector<uint32_t>& routeB = m_routes[rb];
+        if ((routeA.front() != s.a && routeA.back() != s.a) || (routeB.front() != s.b && routeB.back() != s.b)) {
+            continue;
+        }
+        join(s.a, s.b, routeA.back() != s.a, routeB.front() != s.b);
+        m_stats.savingsJoins++;
+    }
+}
+
+    // While there are more routes than vehicles, joins the two routes whose joining costs least (saves most), trying each
+    //      end of each, of those that fit the biggest vehicle together
+    // Savings can leave routes so full that no two fit; then the two lightest are joined anyway, and repairOverloads()
+    //      moves stops off the result to vehicles with room once every route has one
+void FleetRouter::joinDownTo(size_t vehicles, double maxCapacity)
+{
+    vector<uint32_t> used;
+    for (uint32_t r = 0; r < m_routes.size(); r++) {
+        if (!m_routes[r].empty()) {
+            used.push_back(r);
+        }
+    }
+
+    while (used.size() > vehicles) {
+        double bestSaving = -numeric_limits<double>::infinity();
+        uint32_t bestA = 0, bestB = 0;
+        for (size_t i = 0; i < used.size(); i++) {
+            for (size_t j = i + 1; j < used.size(); j++) {
+                const vector<uint32_t>& routeA = m_routes[used[i]];
+                const vector<uint32_t>& routeB = m_routes[used[j]];
+                if (m_routeLoads[used[i]] + m_routeLoads[used[j]] > maxCapacity) {
+                    continue;
+                }
+                for (uint32_t a : { routeA.front(), routeA.back() }) {
+                    for (uint32_t b : { routeB.front(), routeB.back() }) {
+                        double saving = distance(0, a) + distance(0, b) - distance(a, b);
+                        if (saving > bestSaving) {
+                            bestSaving = saving;
+                            bestA = a;
+                            bestB = b;
+                        }
+                    }
+                }
+            }
+        }
+        if (bestSaving == -numeric_limits<double>::infinity()) {
+            sort(used.begin(), used.end(), [this] (uint32_t r1, uint32_t r2) {
+                return (m_routeLoads[r1] != m_routeLoads[r2]) ? m_routeLoads[r1] < m_routeLoads[r2] : r1 < r2;
+            });
+            bestA = m_routes[used[0]].back();
+            bestB = m_routes[used[1]].front();
+        }
+        uint32_t removed = m_routeOf[bestB];
+        join(bestA, bestB, m_routes[m_routeOf[bestA]].back() != bestA, m_routes[removed].front() != bestB);
+        used.erase(find(used.begin(), used.end(), removed));
+        m_stats.forcedJoins++;
+    }
+}
+
+    // Appends b's route to a's, reversing either first if asked so that a and b end up next to each other
+void FleetRouter::join(uint32_t a, uint32_t b, bool reverseA, bool reverseB)
+{
+    uint32_t ra = m_routeOf[a];
+    uint32_t rb = m_routeOf[b];
+    vector<uint32_t>& routeA = m_routes[ra];
+    vector<uint32_t>& routeB = m_routes[rb];
+    if (reverseA) {
+        reverse(routeA.begin(), routeA.end());
+    }
+    if (reverseB) {
+        reverse(routeB.begin(), routeB.end());
+    }
+    for (uint32_t s : routeB) {
+        m_routeOf[s] = ra;
+    }
+    routeA.insert(routeA.end(), routeB.begin(), routeB.end());
+    m_routeLoads[ra] += m_routeLoads[rb];
+    vector<uint32_t>().swap(routeB);
+    m_routeLoads[rb] = 0;
+    updatePositions(ra, 0);
+}
+
+    // Moves stops off any route that is over its vehicle's capacity, each time the stop and the place on another route with
+    //      room for it that add least to the total length; returns false if there's nowhere for them to go
+bool FleetRouter::repairOverloads()
+{
+    for (uint32_t r = 0; r < m_routes.size(); r++) {
+        while (m_routeLoads[r] > m_capacities[r]) {
+            double bestCost = numeric_limits<double>::infinity();
+            uint32_t bestStop = 0, bestRoute = 0;
+            size_t bestPosition = 0;
+            for (uint32_t u : m_routes[r]) {
+                double removeGain = distance(prev(u), u) + distance(u, next(u)) - distance(prev(u), next(u));
+                for (uint32_t t = 0; t < m_routes.size(); t++) {
+                    if (t == r || m_routeLoads[t] + m_loads[u] > m_capacities[t]) {
+                        continue;
+                    }
+                    const vector<uint32_t>& route = m_routes[t];
+                    for (size_t p = 0; p <= route.size(); p++) {
+                        uint32_t x = (p == 0) ? 0 : route[p - 1];
+                        uint32_t y = (p == route.size()) ? 0 : route[p];
+                        double cost = distance(x, u) + distance(u, y) - distance(x, y) - removeGain;
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestStop = u;
+                            bestRoute = t;
+                            bestPosition = p;
+                        }
+                    }
+                }
+            }
+            if (bestCost == numeric_limits<double>::infinity()) {
+                return false;
+            }
+            removeStop(bestStop);
+            insertStop(bestStop, bestRoute, bestPosition);
+            m_stats.repairMoves++;
+        }
+    }
+    return true;
+}
+
+    // Sweeps over the stops trying relocate and swap moves, until a whole sweep improves nothing
+void FleetRouter::searchBetweenRoutes()
+{
+    size_t k = min(SEARCH_NEIGHBOURS, m_count - 1);
+    vector<uint32_t> neighbours;
+    TourImprover::nearestNeighbours(m_distances, m_count, k, neighbours);
+
+    bool improved = true;
+    for (int sweep = 0; improved && sweep < 100; sweep++) {
+        improved = false;
+        for (uint32_t u = 1; u < m_count; u++) {
+            const uint32_t* uNeighbours = &neighbours[u * k];
+            if (tryRelocate(u, uNeighbours) || trySwap(u, uNeighbours)) {
+                improved = true;
+            }
+        }
+    }
+}
+
+    // Tries moving u onto the route of one of its neighbours v, just before or after v
+bool FleetRouter::tryRelocate(uint32_t u, const uint32_t* neighbours)
+{
+    uint32_t ru = m_routeOf[u];
+    uint32_t pu = prev(u);
+    uint32_t nu = next(u);
+    double removeGain = distance(pu, u) + distance(u, nu) - distance(pu, nu);
+    size_t k = min(SEARCH_NEIGHBOURS, m_count - 1);
+    for (size_t i = 0; i < k; i++) {
+        uint32_t v = neighbours[i];
+        if (v == 0 || m_routeOf[v] == ru || m_routeLoads[m_routeOf[v]] + m_loads[u] > m_capacities[m_routeOf[v]]) {
+            continue;
+        }
+        for (int side = 0; side < 2; side++) {
+            uint32_t x = (side == 0) ? v : prev(v);
+            uint32_t y = (side == 0) ? next(v) : v;
+            if (distance(x, u) + distance(u, y) - distance(x, y) - removeGain < -MIN_GAIN) {
+                uint32_t rv = m_routeOf[v];
+                size_t position = m_positionOf[v] + (side == 0 ? 1 : 0);
+                removeStop(u);
+                insertStop(u, rv, position);
+                m_stats.relocateMoves++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+    // Tries exchanging u with one of its neighbours v on another route, each taking the other's place
+bool FleetRouter::trySwap(uint32_t u, const uint32_t* neighbours)
+{
+    uint32_t ru = m_routeOf[u];
+    uint32_t pu = prev(u);
+    uint32_t nu = next(u);
+    size_t k = min(SEARCH_NEIGHBOURS, m_count - 1);
+    for (size_t i = 0; i < k; i++) {
+        uint32_t v = neighbours[i];
+        uint32_t rv = m_routeOf[v];
+        if (v == 0 || rv == ru
+            || m_routeLoads[ru] - m_loads[u] + m_loads[v] > m_capacities[ru]
+            || m_routeLoads[rv] - m_loads[v] + m_loads[u] > m_capacities[rv]) {
+            continue;
+        }
+        uint32_t pv = prev(v);
+        uint32_t nv = next(v);
+        double delta = distance(pv, u) + distance(u, nv) - distance(pv, v) - distance(v, nv)
+                     + distance(pu, v) + distance(v, nu) - distance(pu, u) - distance(u, nu);
+        if (delta < -MIN_GAIN) {
+            swap(m_routes[ru][m_positionOf[u]], m_routes[rv][m_positionOf[v]]);
+            swap(m_routeOf[u], m_routeOf[v]);
+            swap(m_positionOf[u], m_positionOf[v]);
+            m_routeLoads[ru] += m_loads[v] - m_loads[u];
+            m_routeLoads[rv] += m_loads[u] - m_loads[v];
+            m_stats.swapMoves++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FleetRouter::insertStop(uint32_t stop, uint32_t route, size_t position)
+{
+    m_routes[route].insert(m_routes[route].begin() + position, stop);
+    m_routeOf[stop] = route;
+    m_routeLoads[route] += m_loads[stop];
+    updatePositions(route, position);
+}
+
+void FleetRouter::removeStop(uint32_t stop)
+{
+    uint32_t route = m_routeOf[stop];
+    uint32_t position = m_positionOf[stop];
+    m_routes[route].erase(m_routes[route].begin() + position);
+    m_routeLoads[route] -= m_loads[stop];
+    updatePositions(route, position);
+}
+
+void FleetRouter::updatePositions(uint32_t route, size_t from)
+{
+    for (size_t p = from; p < m_routes[route].size(); p++) {
+        m_positionOf[m_routes[route][p]] = static_cast<uint32_t>(p);
+    }
+}
@@ -0,0 +1,93 @@
+// FleetRouter.h
+
+// Splits a batch of deliveries between a fleet of vehicles, each with a capacity, so that every route
+// starts and ends at the depot, no vehicle carries more than it can, and the routes are short in total.
+// DeliveryOptimizer::optimizeFleet() uses it, then orders each vehicle's stops as it would a single
+// courier's.
+//
+//  - Routes are built with Clarke and Wright's savings: every stop starts on its own route, and routes
+//    are joined end to end in order of how much joining them saves,
+//        saving(i, j) = distance(depot, i) + distance(depot, j) - distance(i, j),
+//    as long as the joined load fits the biggest vehicle. Only pairs in each other's neighbour lists are
+//    considered, which keeps the work near linear in the number of stops.
+//  - If that leaves more routes than vehicles, the pair of routes whose joining costs least is joined,
+//    until there are few enough (the two lightest, over capacity if need be, when no two fit together).
+//    Then the heaviest route goes to the biggest vehicle, the next heaviest to the next biggest, and so
+//    on. Stops are moved out of any route still over its vehicle's capacity.
+//  - Then local search between routes: relocate (move a stop to another route) and swap (exchange two
+//    stops on different routes), again only towards neighbours, with every change in length O(1) from the
+//    distance matrix and every move checked against both vehicles' capacities.
+//
+// Like TourImprover, it works from a precomputed, symmetric distance matrix with the depot as location 0.
+
+#ifndef FLEETROUTER_INCLUDED
+#define FLEETROUTER_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+    // What the last route() did
+struct FleetRouterStats
+{
+    size_t savingsJoins = 0;
+    size_t forcedJoins = 0;         // joins made only to get down to the number of vehicles
+    size_t repairMoves = 0;         // stops moved off overloaded routes
+    size_t relocateMoves = 0;
+    size_t swapMoves = 0;
+    double savingsMiles = 0;        // total length of the routes after the savings, before local search
+    double miles = 0;
+    double milliseconds = 0;
+};
+
+class FleetRouter
+{
+public:
+        // distances is the count x count matrix, row by row, of the distances between the locations, and loads[l] is
+        //      what has to be carried to location l (loads[0], the depot's, is ignored); both must outlive the FleetRouter
+    FleetRouter(const double* distances, const double* loads, size_t count);
+
+        // Fills in routes with each vehicle's stops, in the order visited (the depot is left out), vehicle v having room
+        //      for capacities[v]; returns false, leaving routes empty, if it can't fit the stops into the vehicles (as
+        //      when they add up to more than the whole fleet takes, or one is too heavy for any vehicle)
+    bool route(const std::vector<double>& capacities, std::vector<std::vector<uint32_t>>& routes);
+    const FleetRouterStats& stats() const { return m_stats; }
+
+        // C++11 syntax for preventing copying and assignment
+    FleetRouter(const FleetRouter&) = delete;
+    FleetRouter& operator=(const FleetRouter&) = delete;
+
+private:
+    static constexpr size_t SAVINGS_NEIGHBOURS = 40;   // per stop, for the savings
+    static constexpr size_t SEARCH_NEIGHBOURS = 10;    // per stop, for local search
+
+    const double* m_distances;
+    const double* m_loads;
+    size_t m_count;
+    FleetRouterStats m_stats;
+
+        // The routes being built, and for each stop which route it's on and where
+    std::vector<std::vector<uint32_t>> m_routes;
+    std::vector<double> m_routeLoads;
+    std::vector<double> m_capacities;       // of the vehicle each route is on, once they're assigned
+    std::vector<uint32_t> m_routeOf;
+    std::vector<uint32_t> m_positionOf;
+
+        // Auxiliary Functions
+    double distance(uint32_t from, uint32_t to) const { return m_distances[from * m_count + to]; }
+    uint32_t prev(uint32_t stop) const;
+    uint32_t next(uint32_t stop) const;
+    double routeLength(const std::vector<uint32_t>& route) const;
+    void buildSavingsRoutes(double maxCapacity);
+    void joinDownTo(size_t vehicles, double maxCapacity);
+    void join(uint32_t a, uint32_t b, bool reverseA, bool reverseB);
+    bool repairOverloads();
+    void searchBetweenRoutes();
+    bool tryRelocate(uint32_t u, const uint32_t* neighbours);
+    bool trySwap(uint32_t u, const uint32_t* neighbours);
+    void insertStop(uint32_t stop, uint32_t route, size_t position);
+    void removeStop(uint32_t stop);
+    void updatePositions(uint32_t route, size_t from);
+};
+
+#endif // FLEETROUTER_INCLUDED
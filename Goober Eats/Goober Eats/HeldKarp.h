@@ -0,0 +1,145 @@
+// HeldKarp.h
+
+// The exact shortest delivery tour for a small batch, by Held and Karp's dynamic programming over subsets
+// of the stops. The cost of the shortest path from the depot through every stop of a subset S ending at
+// stop j is
+//
+//      cost(S, j) = min over k in S - {j} of cost(S - {j}, k) + distance(k, j)
+//
+// and the tour is the best cost(all stops, j) plus the way back from j. That is O(2^N N^2) time, so it is
+// only for batches of up to HELD_KARP_MAX_STOPS stops; DeliveryOptimizer picks it by batch size.
+//
+//  - HeldKarp<N> is specialised on the number of stops, so its tables are flat arrays whose size is fixed
+//    at compile time, and every loop runs a constant N times for the compiler to unroll.
+//  - The table is indexed [subset][last stop], and the distances are stored transposed, so the inner min
+//    reads two contiguous rows of N doubles. Stops not in a subset cost infinity rather than being
+//    skipped, so there is no branch in the inner loop and it can be vectorised.
+//  - Each thread keeps its tables for each N once it has used them (8 MB at 16 stops), and the tour is
+//    recovered by checking which k each minimum came from rather than storing a second table.
+
+#ifndef HELDKARP_INCLUDED
+#define HELDKARP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+const size_t HELD_KARP_MAX_STOPS = 16;
+
+template<size_t N>
+class HeldKarp
+{
+    static_assert(N >= 1 && N <= HELD_KARP_MAX_STOPS, "Held-Karp is only for small batches");
+public:
+        // distances is the (N + 1) x (N + 1) matrix, row by row, of the distances between the depot (location 0) and
+        //      the stops; fills in tour with location 0 followed by the stops in the shortest order, and returns its length
+    static double solve(const double* distances, std::vector<uint32_t>& tour) {
+        const size_t count = N + 1;
+        const size_t all = SETS - 1;
+        const double infinity = std::numeric_limits<double>::infinity();
+        Tables& t = tables();
+
+            // Stops are numbered from 0 here; stop j is location j + 1
+        for (size_t j = 0; j < N; j++) {
+            for (size_t k = 0; k < N; k++) {
+                t.toStop[j][k] = distances[(k + 1) * count + j + 1];
+            }
+        }
+
+        for (size_t set = 1; set < SETS; set++) {
+            for (size_t j = 0; j < N; j++) {
+                if ((set & (size_t(1) << j)) == 0) {
+                    t.cost[set][j] = infinity;
+                    continue;
+                }
+                size_t rest = set ^ (size_t(1) << j);
+                if (rest == 0) {
+                    t.cost[set][j] = distances[j + 1];
+                    continue;
+                }
+                t.cost[set][j] = minVia(t.cost[rest], t.toStop[j]);
+            }
+        }
+
+        size_t last = 0;
+        double length = infinity;
+        for (size_t j = 0; j < N; j++) {
+            double tourLength = t.cost[all][j] + distances[(j + 1) * count];
+            if (tourLength < length) {
+                length = tourLength;
+                last = j;
+            }
+        }
+
+            // Walk back from the last stop, finding at each step the stop whose cost the minimum came from
+        tour.assign(count, 0);
+        size_t set = all;
+        for (size_t position = N; position >= 1; position--) {
+            tour[position] = static_cast<uint32_t>(last + 1);
+            size_t rest = set ^ (size_t(1) << last);
+            if (rest == 0) {
+                break;
+            }
+            for (size_t k = 0; k < N; k++) {
+                if ((rest & (size_t(1) << k)) != 0 && t.cost[rest][k] + t.toStop[last][k] == t.cost[set][last]) {
+                    last = k;
+                    break;
+                }
+            }
+            set = rest;
+        }
+        return length;
+    }
+
+private:
+    static const size_t SETS = size_t(1) << N;
+
+    struct Tables {
+        alignas(64) double cost[SETS][N];
+        alignas(64) double toStop[N][N];       // toStop[j][k] is the distance from stop k to stop j
+    };
+
+        // min over k of from[k] + to[k], as LANES separate minimums that are combined at the end: a single running
+        //      minimum would have to be taken in order, so couldn't be split across the lanes of a vector register
+    static double minVia(const double* from, const double* to) {
+        const size_t LANES = 4;
+        double best[LANES];
+        for (size_t l = 0; l < LANES; l++) {
+            best[l] = std::numeric_limits<double>::infinity();
+        }
+        for (size_t k = 0; k + LANES <= N; k += LANES) {
+            for (size_t l = 0; l < LANES; l++) {
+                double via = from[k + l] + to[k + l];
+                best[l] = (via < best[l]) ? via : best[l];
+            }
+        }
+        for (size_t k = N - N % LANES; k < N; k++) {
+            double via = from[k] + to[k];
+            best[0] = (via < best[0]) ? via : best[0];
+        }
+        double lo = (best[1] < best[0]) ? best[1] : best[0];
+        double hi = (best[3] < best[2]) ? best[3] : best[2];
+        return (hi < lo) ? hi : lo;
+    }
+
+    static Tables& tables() {
+        static thread_local std::unique_ptr<Tables> t(new Tables);
+        return *t;
+    }
+};
+
+    // Calls HeldKarp<stops>::solve(), for any stops from 1 to HELD_KARP_MAX_STOPS
+template<size_t... Ns>
+double solveHeldKarp(const double* distances, size_t stops, std::vector<uint32_t>& tour, std::index_sequence<Ns...>) {
+    static double (*const solvers[])(const double*, std::vector<uint32_t>&) = { &HeldKarp<Ns + 1>::solve... };
+    return solvers[stops - 1](distances, tour);
+}
+
+inline double solveHeldKarp(const double* distances, size_t stops, std::vector<uint32_t>& tour) {
+    return solveHeldKarp(distances, stops, tour, std::make_index_sequence<HELD_KARP_MAX_STOPS>());
+}
+
+#endif // HELDKARP_INCLUDED
@@ -0,0 +1,185 @@
+// IndexedHeap.h
+
+// A d-ary min-heap of items identified by dense ids in [0, capacity), such as the NodeIds of a StreetGraph.
+// Alongside the heap it keeps every id's position in it, so an item already in the heap can have its
+// priority lowered in place (decrease-key) instead of being pushed a second time, and contains() is O(1).
+// With Arity 4 the heap is shallower than a binary heap, and the four children of a slot share a cache line.
+
+#ifndef INDEXEDHEAP_INCLUDED
+#define INDEXEDHEAP_INCLUDED
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+template<typename Priority, unsigned int Arity = 4>
+class IndexedHeap
+{
+public:
+        // constructor; ids must be less than capacity
+    IndexedHeap(size_t capacity = 0) : m_positions(capacity, NOT_IN_HEAP) {}
+
+        // changes the range of ids the heap accepts; the heap must be empty
+    void resize(size_t capacity) {
+        assert(m_heap.empty());
+        m_positions.assign(capacity, NOT_IN_HEAP);
+    }
+    size_t capacity() const { return m_positions.size(); }
+
+    bool empty() const { return m_heap.empty(); }
+    size_t size() const { return m_heap.size(); }
+    bool contains(uint32_t id) const { return m_positions[id] != NOT_IN_HEAP; }
+
+        // The id with the lowest priority, and that priority
+    uint32_t top() const { return m_heap[0].id; }
+    Priority topPriority() const { return m_heap[0].priority; }
+
+        // Adds id, which must not already be in the heap
+    void push(uint32_t id, Priority priority);
+        // Lowers the priority of id, which must be in the heap with a priority no lower than the new one
+    void decrease(uint32_t id, Priority priority);
+        // Pushes id if it isn't in the heap yet, or lowers its priority if it is (and the new one is lower)
+    void pushOrDecrease(uint32_t id, Priority priority);
+        // Changes the priority of id, which must be in the heap, to anything at all
+    void update(uint32_t id, Priority priority);
+        // Removes and returns the id with the lowest priority
+    uint32_t pop();
+
+        // Empties the heap, in time proportional to the number of items still in it rather than the capacity
+    void clear();
+
+        // Approximate number of bytes of heap memory held
+    size_t memoryUsage() const { return m_heap.capacity() * sizeof(Entry) + m_positions.capacity() * sizeof(uint32_t); }
+
+private:
+    static constexpr uint32_t NOT_IN_HEAP = UINT32_MAX;
+
+    struct Entry {
+        Priority priority;
+        uint32_t id;
+    };
+
+    std::vector<Entry> m_heap;
+    std::vector<uint32_t> m_positions;      // where each id is in m_heap, or NOT_IN_HEAP
+
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    void place(size_t i, const Entry& entry) {
+        m_heap[i] = entry;
+        m_positions[entry.id] = static_cast<uint32_t>(i);
+    }
+};
+
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::push(uint32_t id, Priority priority)
+{
+    assert(!contains(id));
+    m_heap.push_back(Entry{priority, id});
+    m_positions[id] = static_cast<uint32_t>(m_heap.size() - 1);
+    siftUp(m_heap.size() - 1);
+}
+
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::decrease(uint32_t id, Priority priority)
+{
+    size_t i = m_positions[id];
+    assert(i != NOT_IN_HEAP && !(m_heap[i].priority < priority));
+    m_heap[i].priority = priority;
+    siftUp(i);
+}
+
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::pushOrDecrease(uint32_t id, Priority priority)
+{
+    if (!contains(id)) {
+        push(id, priority);
+    } else if (priority < m_heap[m_positions[id]].priority) {
+        decrease(id, priority);
+    }
+}
+
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::update(uint32_t id, Priority priority)
+{
+    size_t i = m_positions[id];
+    assert(i != NOT_IN_HEAP);
+    bool lower = priority < m_heap[i].priority;
+    m_heap[i].priority = priority;
+    if (lower) {
+        siftUp(i);
+    } else {
+        siftDown(i);
+    }
+}
+
+template<typename Priority, unsigned int Arity>
+uint32_t IndexedHeap<Priority, Arity>::pop()
+{
+    uint32_t id = m_heap[0].id;
+    m_positions[id] = NOT_IN_HEAP;
+
+    Entry last = m_heap.back();
+    m_heap.pop_back();
+    if (!m_heap.empty()) {
+        place(0, last);
+        siftDown(0);
+    }
+    return id;
+}
+
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::clear()
+{
+    for (const Entry& entry : m_heap) {
+        m_positions[entry.id] = NOT_IN_HEAP;
+    }
+    m_heap.clear();
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // Moves the entry at i up past every parent with a higher priority
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::siftUp(size_t i)
+{
+    Entry entry = m_heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / Arity;
+        if (!(entry.priority < m_heap[parent].priority)) {
+            break;
+        }
+        place(i, m_heap[parent]);
+        i = parent;
+    }
+    place(i, entry);
+}
+
+    // Moves the entry at i down, swapping with its lowest priority child, until no child has a lower priority
+template<typename Priority, unsigned int Arity>
+void IndexedHeap<Priority, Arity>::siftDown(size_t i)
+{
+    Entry entry = m_heap[i];
+    size_t n = m_heap.size();
+    for (;;) {
+        size_t first = i * Arity + 1;
+        if (first >= n) {
+            break;
+        }
+        size_t best = first;
+        size_t last = first + Arity < n ? first + Arity : n;
+        for (size_t c = first + 1; c < last; c++) {
+            if (m_heap[c].priority < m_heap[best].priority) {
+                best = c;
+            }
+        }
+        if (!(m_heap[best].priority < entry.priority)) {
+            break;
+        }
+        place(i, m_heap[best]);
+        i = best;
+    }
+    place(i, entry);
+}
+
+#endif // INDEXEDHEAP_INCLUDED
@@ -0,0 +1,183 @@
+#include "Landmarks.h"
+#include "IndexedHeap.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+using namespace std;
+
+const double UNREACHABLE = numeric_limits<double>::infinity();
+
+    // Dijkstra from every node of sources at once, along the edges leaving each node (or arriving at it, if backward)
+    // Fills in each node's distance from the nearest source, and optionally the edge its shortest path arrives
+    //      along and the order the nodes were settled in
+void landmarkDijkstra(const StreetGraph& graph, const vector<NodeId>& sources, bool backward,
+                      vector<double>& distance, vector<EdgeId>* parents, vector<NodeId>* order)
+{
+    distance.assign(graph.nodeCount(), UNREACHABLE);
+    if (parents != nullptr) {
+        parents->assign(graph.nodeCount(), NO_EDGE);
+    }
+    if (order != nullptr) {
+        order->clear();
+    }
+
+    IndexedHeap<double> openSet(graph.nodeCount());
+    for (NodeId source : sources) {
+        distance[source] = 0;
+        openSet.pushOrDecrease(source, 0);
+    }
+
+    while (!openSet.empty()) {
+        NodeId u = openSet.pop();
+        if (order != nullptr) {
+            order->push_back(u);
+        }
+        uint32_t begin = backward ? graph.inEdgeBegin(u) : graph.edgeBegin(u);
+        uint32_t end = backward ? graph.inEdgeEnd(u) : graph.edgeEnd(u);
+        for (uint32_t i = begin; i != end; i++) {
+            EdgeId e = backward ? graph.inEdge(i) : i;
+            NodeId v = backward ? graph.edgeSource(e) : graph.edgeTarget(e);
+            double d = distance[u] + graph.edgeLength(e);
+            if (d < distance[v]) {
+                distance[v] = d;
+                if (parents != nullptr) {
+                    (*parents)[v] = e;
+                }
+                openSet.pushOrDecrease(v, d);
+            }
+        }
+    }
+}
+
+    // The reachable node farthest from all of sources
+NodeId farthestNode(const StreetGraph& graph, const vector<NodeId>& sources)
+{
+    vector<double> distance;
+    landmarkDijkstra(graph, sources, false, distance, nullptr, nullptr);
+    NodeId farthest = sources.front();
+    for (NodeId n = 0; n < graph.nodeCount(); n++) {
+        if (distance[n] != UNREACHABLE && distance[n] > distance[farthest]) {
+            farthest = n;
+        }
+    }
+    return farthest;
+}
+
+    // The next landmark by avoid selection, given the distances from and to the landmarks chosen so far (landmark by landmark)
+    // Returns NO_NODE if every heavy subtree already has a landmark in it
+NodeId avoidNode(const StreetGraph& graph, NodeId root, const vector<NodeId>& landmarks,
+                 const vector<vector<double>>& from, const vector<vector<double>>& to)
+{
+    vector<double> distance;
+    vector<EdgeId> parents;
+    vector<NodeId> order;
+    landmarkDijkstra(graph, vector<NodeId>(1, root), false, distance, &parents, &order);
+
+        // A node's weight is how far the best bound we already have falls short of its real distance from the root
+    vector<double> size(graph.nodeCount(), 0);
+    for (NodeId n : order) {
+        double bound = distanceEarthMiles(graph.latitude(root), graph.longitude(root), graph.latitude(n), graph.longitude(n));
+        for (size_t i = 0; i < landmarks.size(); i++) {
+                // Unreachable landmarks make these infinite or NaN; max() keeps the bound we had then
+            bound = max(bound, from[i][n] - from[i][root]);
+            bound = max(bound, to[i][root] - to[i][n]);
+        }
+        size[n] = max(0.0, distance[n] - bound);
+    }
+
+        // Children are settled after their parents, so going through the nodes backwards adds up each subtree
+        //      before its weight is passed up; a subtree with a landmark in it weighs nothing
+    vector<char> hasLandmark(graph.nodeCount(), false);
+    for (NodeId l : landmarks) {
+        hasLandmark[l] = true;
+    }
+    for (size_t i = order.size(); i-- > 1; ) {
+        NodeId n = order[i];
+        NodeId parent = graph.edgeSource(parents[n]);
+        if (hasLandmark[n]) {
+            size[n] = 0;
+            hasLandmark[parent] = true;
+        } else {
+            size[parent] += size[n];
+        }
+    }
+
+        // Walk down from the root, always into the heaviest subtree, until we reach a leaf
+    vector<uint32_t> childOffsets(graph.nodeCount() + 1, 0);
+    for (size_t i = 1; i < order.size(); i++) {
+        childOffsets[graph.edgeSource(parents[order[i]]) + 1]++;
+    }
+    for (size_t n = 0; n < graph.nodeCount(); n++) {
+        childOffsets[n + 1] += childOffsets[n];
+    }
+    vector<NodeId> children(order.size());
+    vector<uint32_t> nextChild(childOffsets.begin(), childOffsets.end() - 1);
+    for (size_t i = 1; i < order.size(); i++) {
+        children[nextChild[graph.edgeSource(parents[order[i]])]++] = order[i];
+    }
+
+    NodeId n = root;
+    for (;;) {
+        NodeId heaviest = NO_NODE;
+        for (uint32_t c = childOffsets[n]; c != childOffsets[n + 1]; c++) {
+            if (size[children[c]] > 0 && (heaviest == NO_NODE || size[children[c]] > size[heaviest])) {
+                heaviest = children[c];
+            }
+        }
+        if (heaviest == NO_NODE) {
+            break;
+        }
+        n = heaviest;
+    }
+    return (n == root) ? NO_NODE : n;
+}
+
+void buildLandmarks(const StreetGraph& graph, int count, LandmarkSelection selection,
+                    vector<NodeId>& landmarks, vector<double>& fromLandmarks, vector<double>& toLandmarks)
+{
+    landmarks.clear();
+    fromLandmarks.clear();
+    toLandmarks.clear();
+    if (graph.nodeCount() == 0 || count <= 0) {
+        return;
+    }
+
+    mt19937 rng(1);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+
+        // Distances from and to each landmark as it's chosen, one array per landmark
+    vector<vector<double>> from;
+    vector<vector<double>> to;
+
+    while (landmarks.size() < static_cast<size_t>(count)) {
+        NodeId next = NO_NODE;
+        if (selection == AVOID_LANDMARKS) {
+            next = avoidNode(graph, randomNode(rng), landmarks, from, to);
+        }
+        if (next == NO_NODE) {
+                // Farthest selection starts from a random node, whose farthest node is on the edge of the map
+            next = farthestNode(graph, landmarks.empty() ? vector<NodeId>(1, randomNode(rng)) : landmarks);
+        }
+        if (find(landmarks.begin(), landmarks.end(), next) != landmarks.end()) {
+            break;      // every node is a landmark already, or can't be reached from one
+        }
+
+        landmarks.push_back(next);
+        from.emplace_back();
+        to.emplace_back();
+        landmarkDijkstra(graph, vector<NodeId>(1, next), false, from.back(), nullptr, nullptr);
+        landmarkDijkstra(graph, vector<NodeId>(1, next), true, to.back(), nullptr, nullptr);
+    }
+
+        // Interleave the tables node by node
+    size_t k = landmarks.size();
+    fromLandmarks.resize(graph.nodeCount() * k);
+    toLandmarks.resize(graph.nodeCount() * k);
+    for (NodeId n = 0; n < graph.nodeCount(); n++) {
+        for (size_t i = 0; i < k; i++) {
+            fromLandmarks[n * k + i] = from[i][n];
+            toLandmarks[n * k + i] = to[i][n];
+        }
+    }
+}
@@ -0,0 +1,30 @@
+// Landmarks.h
+
+// Landmarks for ALT (A*, Landmarks, Triangle inequality) searches. A landmark L is a node whose shortest
+// distances to and from every other node are precomputed. For any nodes n and t the triangle inequality gives
+//      d(n, t) >= d(L, t) - d(L, n)    and    d(n, t) >= d(n, L) - d(t, L)
+// so every landmark bounds the rest of a route from below, and unlike the straight line distance the bound
+// knows about the rivers, freeways and dead ends between n and t. The bound is tightest for a landmark that
+// lies beyond t as seen from n (or behind n as seen from t), so landmarks are best spread around the edges of
+// the map. They are chosen either by
+//  - FARTHEST_LANDMARKS: each new landmark is the node farthest by road from those chosen so far, or
+//  - AVOID_LANDMARKS: grow a shortest path tree from a random root, weigh each node by how far the bounds
+//    we have so far underestimate its distance from the root, and put the next landmark at the leaf reached
+//    by always stepping into the heaviest subtree without a landmark in it (Goldberg and Werneck)
+//
+// The distances live with the StreetGraph (see StreetGraph::distancesFromLandmarks()), node by node, so the
+// bounds for one node are read from one place, and snapshots can carry them.
+
+#ifndef LANDMARKS_INCLUDED
+#define LANDMARKS_INCLUDED
+
+#include "StreetGraph.h"
+#include <vector>
+
+    // Chooses count landmarks of graph, and fills in distances from and to them: fromLandmarks[n * count + i] is the
+    //      distance from landmark i to node n, and toLandmarks[n * count + i] the distance from n to landmark i,
+    //      or infinity if there is no path
+void buildLandmarks(const StreetGraph& graph, int count, LandmarkSelection selection,
+                    std::vector<NodeId>& landmarks, std::vector<double>& fromLandmarks, std::vector<double>& toLandmarks);
+
+#endif // LANDMARKS_INCLUDED
@@ -0,0 +1,42 @@
+// ParallelFor.h
+
+// Runs the iterations of a loop on several threads at once, for work that splits into independent pieces
+// of uneven size: a row of a DistanceMatrix, or one vehicle's trip in a DeliveryPlanner fleet plan.
+//
+// The iterations aren't split up ahead of time. Every thread takes the next one off a shared counter
+// whenever it finishes its last, so a thread that gets a few slow pieces doesn't hold the others up.
+
+#ifndef PARALLELFOR_INCLUDED
+#define PARALLELFOR_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+    // Calls work(i) for every i in [0, n), handing the next i to whichever thread is free first; the calling thread works
+    //      too. threadCount is the most threads to use, or 0 for one per hardware thread
+template<typename Work>
+void runInParallel(size_t n, unsigned int threadCount, Work work)
+{
+    size_t nThreads = (threadCount != 0) ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    nThreads = std::min(nThreads, n);
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < n; i = next++) {
+            work(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < nThreads; w++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+#endif // PARALLELFOR_INCLUDED
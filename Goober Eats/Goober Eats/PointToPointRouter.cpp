@@ -1,12 +1,17 @@
 #include "provided.h"
-#include <set>
-#include <list>
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include "ContractionHierarchy.h"
+#include "RouteCache.h"
+#include "CompactRoute.h"
+#include "SpatialIndex.h"
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <list>
+#include <vector>
 using namespace std;
 
-struct AStarNode;
-struct ASN_comparator;
-
 class PointToPointRouterImpl
 {
 public:
@@ -17,59 +22,32 @@ public:
         const GeoCoord& end,
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        CompactRoute& route) const;
+    void setAlgorithm(RouteAlgorithm algorithm);
+    void setRouteCache(RouteCache* cache);
+    void setSnapDistance(double maxMiles);
+    RouteStats lastRouteStats() const;
 private:
     const StreetMap* m_streetMap;
+    const StreetGraph& m_graph;
+    RouteAlgorithm m_algorithm;
+    RouteCache* m_cache;
+    double m_snapMiles;
     
-    list<AStarNode> getChildren(AStarNode* asn) const;
-    bool AStarAlgorithm(const GeoCoord& start, const GeoCoord& end, list<StreetSegment>& route) const;
-    void cleanUpAStar(set<AStarNode*, ASN_comparator> openList, list<AStarNode*> closedList) const;
-    list<StreetSegment> reverseNodeRoute(AStarNode* asn) const;
-};
-
-    // We construct an AStarNode struct for use in our A* Pathfinding algorithm.
-    // An AStarNode is essentially a possible movement from one GeoCoord to
-    //      another, with consideration of movement costs and distances from a target
-    //      and/or ending GeoCoord
-    // The node must:
-    //   - have a parent AStarNode data member that indicates where we previously moved from
-    //   - have a GeoCoord data member that stores the position a movement originates from
-    //   - have a GeoCoord data member that stores the eventual target it is trying to reach
-    //   - have a gCost relative to the cost of moving from the parent ASN GeoCoord to the curr GeoCoord
-    //   - have an hCost relative to the distance of the current GeoCoord to the end GeoCoord
-    //   - have a defined operator< so it can be stored in a set of ascending fCosts
-struct AStarNode {
-        // AStarNode
-    AStarNode(AStarNode* parentASN, const GeoCoord& curr, const GeoCoord& target) : parent(parentASN), gc(curr), tar(target) {
-        if (parent == nullptr) {        // for the starting asn, leave gCost as 0
-            gCost = 0;
-        } else {
-            gCost = parent->gCost + distanceEarthMiles(parent->gc, curr);
-        }
-        hCost = distanceEarthMiles(curr, target);
-    }
-    
-    AStarNode* parent;
-    GeoCoord gc;
-    GeoCoord tar;
-    double gCost;
-    double hCost;
-    
-    double fCost() const {
-        return gCost + hCost;
-    }
-};
-    
-    // AStarNode comparator to help order set in AStarAlgorithm
-struct ASN_comparator {
-    bool operator() (const AStarNode* lhs, const AStarNode* rhs) const {
-        if (lhs == rhs)
-            return false;
-            
-        return lhs->fCost() < rhs->fCost();
-    }
+    DeliveryResult findRoute(const GeoCoord& start, const GeoCoord& end, const EdgeId*& edges, size_t& length) const;
+    double hCost(NodeId n, NodeId target) const;
+    double landmarkCost(NodeId n, NodeId target) const;
+    bool AStarAlgorithm(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const;
+    bool bidirectionalAStar(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const;
+    bool hierarchySearch(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const;
+    void reverseNodeRoute(SearchWorkspace& workspace, NodeId meet, bool bidirectional, const EdgeId*& edges, size_t& length) const;
+    list<StreetSegment> buildRoute(const EdgeId* edges, size_t length) const;
 };
 
-PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm) : m_streetMap(sm)
+PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm) : m_streetMap(sm), m_graph(sm->getStreetGraph()), m_algorithm(ASTAR), m_cache(nullptr), m_snapMiles(0)
 {}
 
 PointToPointRouterImpl::~PointToPointRouterImpl()
@@ -81,12 +59,11 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const
 {
-        // Check if start and end are GeoCoords in m_streetMap
-    vector<StreetSegment> startSegs;
-    vector<StreetSegment> endSegs;
-    
-    if (!(m_streetMap->getSegmentsThatStartWith(start, startSegs) && m_streetMap->getSegmentsThatStartWith(end, endSegs))) {
-        return BAD_COORD;
+    const EdgeId* edges = nullptr;
+    size_t length = 0;
+    DeliveryResult result = findRoute(start, end, edges, length);
+    if (result != DELIVERY_SUCCESS) {
+        return result;
     }
     
         // Check if end is where we already are, in which case the routing is  successful
@@ -95,134 +72,342 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         totalDistanceTravelled = 0;
         return DELIVERY_SUCCESS;
     }
+    route = buildRoute(edges, length);
     
-        // Find a path using the AStarAlgorithm
-    if (!AStarAlgorithm(start, end, route)) {
-        return NO_ROUTE;
-    }
-    
-        // Call to AStarAlgorithm has already worked out the real route
-        // Now compute the distance travelled
-    for (StreetSegment ss : route) {
-        totalDistanceTravelled += distanceEarthMiles(ss.start, ss.end);
+        // The search has already worked out the real route
+        // Now add up the distance travelled, from the lengths worked out when the map was loaded
+    for (size_t i = 0; i < length; i++) {
+        totalDistanceTravelled += m_graph.edgeLength(edges[i]);
     }
     
     return DELIVERY_SUCCESS;
 }
 
+DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        CompactRoute& route) const
+{
+    const EdgeId* edges = nullptr;
+    size_t length = 0;
+    DeliveryResult result = findRoute(start, end, edges, length);
+    if (result == DELIVERY_SUCCESS) {
+        route.assign(&m_graph, edges, length);
+    }
+    return result;
+}
+
+void PointToPointRouterImpl::setAlgorithm(RouteAlgorithm algorithm)
+{
+    m_algorithm = algorithm;
+}
+
+void PointToPointRouterImpl::setRouteCache(RouteCache* cache)
+{
+    m_cache = cache;
+}
+
+void PointToPointRouterImpl::setSnapDistance(double maxMiles)
+{
+    m_snapMiles = maxMiles;
+}
+
+RouteStats PointToPointRouterImpl::lastRouteStats() const
+{
+    return SearchWorkspace::forThread(m_graph).stats();
+}
+
 /////////////////////////////////////////////////
 // Auxiliary Functions
 /////////////////////////////////////////////////
+/**
+* Finds the shortest route from start to end, in the cache if there is one, or else by a search with the chosen algorithm
+* Both of the public generatePointToPointRoute()s call this, and then turn the edges it finds into the kind of route they return
+* @param edges Set to the route's edges from start to end, laid out in this thread's workspace's arena; empty if start is end
+* @param length Set to the number of edges in the route
+* @return BAD_COORD if start or end isn't in the map, NO_ROUTE if there is no route between them, DELIVERY_SUCCESS otherwise
+*/
+DeliveryResult PointToPointRouterImpl::findRoute(const GeoCoord& start, const GeoCoord& end, const EdgeId*& edges, size_t& length) const {
+    auto startTime = chrono::steady_clock::now();
+    SearchWorkspace& workspace = SearchWorkspace::forThread(m_graph);
+    workspace.stats() = RouteStats();
+    
+        // Check if start and end are GeoCoords in m_streetMap, or near enough to one of its streets
+    NodeId startNode = m_graph.findNode(start);
+    NodeId endNode = m_graph.findNode(end);
+    if (m_snapMiles > 0) {
+        const SpatialIndex& index = m_streetMap->getSpatialIndex();
+        startNode = (startNode != NO_NODE) ? startNode : index.snap(start, m_snapMiles);
+        endNode = (endNode != NO_NODE) ? endNode : index.snap(end, m_snapMiles);
+    }
+    
+    if (startNode == NO_NODE || endNode == NO_NODE) {
+        return BAD_COORD;
+    }
+    
+        // Check if end is where we already are, in which case the route is empty
+    edges = nullptr;
+    length = 0;
+    if (startNode == endNode) {
+        return DELIVERY_SUCCESS;
+    }
+    
+        // Nor is there any point searching if no street joins the two, since a search would have to run out of places
+        //      to go before giving up
+    if (!m_graph.mayReach(startNode, endNode)) {
+        workspace.stats().milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+        return NO_ROUTE;
+    }
+    
+        // A route the cache already has needs no search at all
+    bool found = false;
+    if (m_cache != nullptr) {
+        double miles;
+        workspace.beginSearch();
+        found = m_cache->find(m_graph, startNode, endNode, workspace.arena(), edges, length, miles);
+        workspace.stats().fromCache = found;
+        if (found && miles == numeric_limits<double>::infinity()) {
+            workspace.stats().milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+            return NO_ROUTE;    // we've searched for this before and found nothing
+        }
+    }
+    
+        // Otherwise find a path using the chosen algorithm; without a hierarchy, bidirectional A* is the next best thing
+    if (!found) {
+        if (m_algorithm == CONTRACTION_HIERARCHY && m_streetMap->getContractionHierarchy() != nullptr) {
+            found = hierarchySearch(workspace, startNode, endNode, edges, length);
+        } else if (m_algorithm == BIDIRECTIONAL_ASTAR || m_algorithm == CONTRACTION_HIERARCHY) {
+            found = bidirectionalAStar(workspace, startNode, endNode, edges, length);
+        } else {
+            found = AStarAlgorithm(workspace, startNode, endNode, edges, length);
+        }
+    }
+    if (!found) {
+        if (m_cache != nullptr) {
+            m_cache->insert(m_graph, startNode, endNode, nullptr, 0, numeric_limits<double>::infinity());
+        }
+        workspace.stats().milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+        return NO_ROUTE;
+    }
+    
+    if (m_cache != nullptr && !workspace.stats().fromCache) {
+        double miles = 0;
+        for (size_t i = 0; i < length; i++) {
+            miles += m_graph.edgeLength(edges[i]);
+        }
+        m_cache->insert(m_graph, startNode, endNode, edges, length, miles);
+    }
+    workspace.stats().milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    return DELIVERY_SUCCESS;
+}
+
 /**
 * Implementation of the A* Search Algorithm to find a path between a starting and destination GeoCoord
 * Based on and adapted from the pseudocode on https://www.geeksforgeeks.org/a-search-algorithm/
-* @param start The starting GeoCoord of the route
-* @param end The destination/ending GeoCoord of the route
-* @param route A list that will store the route taken from end to start (for now)
+* The open set is an IndexedHeap keyed by NodeId, so a node that is reached again by a shorter path has its
+*   fCost lowered in place, and the closed set is a per node stamp; each node is expanded at most once,
+*   making the search O((V + E) log V)
+* With ALT chosen, and landmarks built for the map, the heuristic is landmarkCost() instead of hCost(): a bound
+*   that is never looser, and usually much tighter, so far fewer nodes are expanded
+* @param start The starting node of the route
+* @param end The destination/ending node of the route
+* @param edges Set to the route's edges from start to end, laid out in the workspace's arena
+* @param length Set to the number of edges in the route
 * @return true or false dependent on whether a route is found
 */
-bool PointToPointRouterImpl::AStarAlgorithm(const GeoCoord& start, const GeoCoord& end, list<StreetSegment>& route) const {
-    // Initialise open list and closed list
-    set<AStarNode*, ASN_comparator> openList;        // this will hold the nodes to be analysed; we always analyse the lowest f cost node first, so we use a set with ASN_comparator
-    list<AStarNode*> closedList;                     // this will hold the nodes that have already been analysed; no need to maintain an order, list is fine
-    
-    // Put the starting node onto the openList
-    AStarNode* startNode = new AStarNode(nullptr, start, end);
-    openList.insert(startNode);
-    
-    while (!openList.empty()) {
-        // Get the node with the lowest fCost on the openList, which is just the first element
-        AStarNode* currNode = *openList.begin();
-        openList.erase(openList.begin());
+bool PointToPointRouterImpl::AStarAlgorithm(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const {
+    // All of the search's state lives in this thread's workspace, so nothing is allocated or cleared here
+    workspace.beginSearch();
+    SearchSpace& search = workspace.forward();
+    IndexedHeap<double>& openSet = search.openSet();
+    RouteStats& stats = workspace.stats();
+    bool useLandmarks = m_algorithm == ALT && m_graph.landmarkCount() != 0;
+    auto heuristic = [&](NodeId n) {
+        stats.straightLineDistances++;
+        return useLandmarks ? landmarkCost(n, end) : hCost(n, end);
+    };
+    
+    // Put the starting node onto the open set
+    search.reach(start, 0, NO_EDGE);
+    openSet.push(start, heuristic(start));
+    
+    while (!openSet.empty()) {
+        // Get the node with the lowest fCost on the open set, and close it
+        // Neither heuristic ever overestimates, or drops by more than the length of a segment,
+        //      so by now we know the shortest path to it
+        NodeId currNode = openSet.pop();
+        search.close(currNode);
+        stats.settledNodes++;
         
-        // We're analysing currNode, so add this to the closedList (we do this here as it makes cleaning up easier)
-        closedList.push_back(currNode);
+        // Have we reached the destination?
+        if (currNode == end) {
+            reverseNodeRoute(workspace, end, false, edges, length);
+            return true;
+        }
         
-        // Generate possible children of currNode (adjacent nodes)
-        // it turns out that the cleaning up of all the dynamically allocated memory is much easier if we don't use pointers for this vector
-        list<AStarNode> children = getChildren(currNode);
-       
-        for (AStarNode child : children) {
-            // Have we reached the destination?
-            if (child.gc == end) {
-                route = reverseNodeRoute(&child);
-                cleanUpAStar(openList, closedList);
-                return true;
+        // Relax each segment leaving currNode
+        double currGCost = search.node(currNode).gCost;
+        for (EdgeId e = m_graph.edgeBegin(currNode); e != m_graph.edgeEnd(currNode); e++) {
+            NodeId child = m_graph.edgeTarget(e);
+            stats.relaxedEdges++;
+            if (search.closed(child)) {
+                continue;
             }
             
-            // If a node with the same gc as the child is in the openList and has a lower fCost than the child, skip this child
-            bool skipChild = false;
-            for (AStarNode* node : openList) {
-                if (node->gc == child.gc && node->fCost() <= child.fCost()) {
-                    skipChild = true;
-                    break;
-                }
+            // Skip the child if we already have a path to it that is no longer than this one
+            double gCost = currGCost + m_graph.edgeLength(e);
+            if (search.reached(child) && search.node(child).gCost <= gCost) {
+                continue;
             }
             
-            // If a node with the same gc as the child is in the closedList and has a lower fCost than the child, skip this child
-            for (AStarNode* node : closedList) {
-                if (node->gc == child.gc && node->fCost() <= child.fCost()) {
-                    skipChild = true;
-                    break;
-                }
+            search.reach(child, gCost, e);
+            openSet.pushOrDecrease(child, gCost + heuristic(child));
+        }
+    }
+    
+    // If the open set is empty, we cannot find a path
+    return false;
+}
+
+/**
+* Bidirectional A*: one search forwards from start along the segments leaving each node, and one backwards from end
+*   along the segments arriving at each node, taking turns by whichever has the smaller open set
+* Both use the average potential p(n) = (hCost(n, end) - hCost(n, start)) / 2, the forward search ordering its open set by
+*   gCost + p(n) and the backward one by gCost - p(n). Each is consistent, and together they make the two searches
+*   agree on every segment's reduced length, so each node settled really is settled
+* mu is the shortest start -> end path seen so far through a node both searches have reached; once the two smallest
+*   keys add up to at least mu, no path through an unsettled node can beat it
+* @return true or false dependent on whether a route is found
+*/
+bool PointToPointRouterImpl::bidirectionalAStar(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const {
+    workspace.beginSearch();
+    SearchSpace& forward = workspace.forward();
+    SearchSpace& backward = workspace.backward();
+    RouteStats& stats = workspace.stats();
+    
+    auto potential = [&](NodeId n) {
+        stats.straightLineDistances += 2;
+        return (hCost(n, end) - hCost(n, start)) / 2;
+    };
+    
+    forward.reach(start, 0, NO_EDGE);
+    forward.openSet().push(start, potential(start));
+    backward.reach(end, 0, NO_EDGE);
+    backward.openSet().push(end, -potential(end));
+    
+    double mu = numeric_limits<double>::infinity();
+    NodeId meet = NO_NODE;
+    
+    while (!forward.openSet().empty() && !backward.openSet().empty()) {
+        if (forward.openSet().topPriority() + backward.openSet().topPriority() >= mu) {
+            break;
+        }
+        
+        bool goForward = forward.openSet().size() <= backward.openSet().size();
+        SearchSpace& search = goForward ? forward : backward;
+        SearchSpace& other = goForward ? backward : forward;
+        
+        NodeId currNode = search.openSet().pop();
+        search.close(currNode);
+        stats.settledNodes++;
+        double currGCost = search.node(currNode).gCost;
+        
+        uint32_t begin = goForward ? m_graph.edgeBegin(currNode) : m_graph.inEdgeBegin(currNode);
+        uint32_t finish = goForward ? m_graph.edgeEnd(currNode) : m_graph.inEdgeEnd(currNode);
+        for (uint32_t i = begin; i != finish; i++) {
+            EdgeId e = goForward ? i : m_graph.inEdge(i);
+            NodeId child = goForward ? m_graph.edgeTarget(e) : m_graph.edgeSource(e);
+            stats.relaxedEdges++;
+            if (search.closed(child)) {
+                continue;
             }
             
-            if (skipChild) {
+            double gCost = currGCost + m_graph.edgeLength(e);
+            if (search.reached(child) && search.node(child).gCost <= gCost) {
                 continue;
-            } else {
-                // If we aren't skipping the child, add the child to the openList for analysis
-                openList.insert(new AStarNode(child.parent, child.gc, child.tar));
+            }
+            search.reach(child, gCost, e);
+            search.openSet().pushOrDecrease(child, gCost + (goForward ? potential(child) : -potential(child)));
+            
+                // Does this give a shorter start -> end path?
+            if (other.reached(child) && gCost + other.node(child).gCost < mu) {
+                mu = gCost + other.node(child).gCost;
+                meet = child;
             }
         }
     }
-    // If the openList is empty, we cannot find a path
-    cleanUpAStar(openList, closedList);
-    return false;
+    
+    if (meet == NO_NODE) {
+        return false;
+    }
+    reverseNodeRoute(workspace, meet, true, edges, length);
+    return true;
 }
 
-    // Cleans up all dynamically allocated memory in the AStarAlgorithm
-void PointToPointRouterImpl::cleanUpAStar(set<AStarNode*, ASN_comparator> openList, list<AStarNode*> closedList) const {
-    for (set<AStarNode*, ASN_comparator>::iterator itr = openList.begin(); itr != openList.end(); itr++) {
-        delete *itr;
-    }
-    
-    for (list<AStarNode*>::iterator itr = closedList.begin(); itr != closedList.end(); itr++) {
-        delete *itr;
+    // Searches the map's ContractionHierarchy, which hands back the route with its shortcuts already unpacked into segments
+bool PointToPointRouterImpl::hierarchySearch(SearchWorkspace& workspace, NodeId start, NodeId end, const EdgeId*& edges, size_t& length) const {
+    return m_streetMap->getContractionHierarchy()->findPath(workspace, start, end, edges, length);
+}
+
+    // The straight line distance from n to the target, which the path along streets can't be shorter than
+    // The graph's trig-free bound on it is just as good a heuristic as the real haversine distance, and much cheaper
+double PointToPointRouterImpl::hCost(NodeId n, NodeId target) const {
+    return m_graph.distanceBound(n, target);
+}
+
+    // The straight line distance, raised to the best of the landmarks' triangle inequality bounds (see Landmarks.h)
+    // Where a landmark can't reach n or the target (or be reached from them) its bound is infinite or NaN, and max()
+    //      with the bound first ignores a NaN
+double PointToPointRouterImpl::landmarkCost(NodeId n, NodeId target) const {
+    double bound = hCost(n, target);
+    const double* fromN = m_graph.distancesFromLandmarks(n);
+    const double* fromTarget = m_graph.distancesFromLandmarks(target);
+    const double* toN = m_graph.distancesToLandmarks(n);
+    const double* toTarget = m_graph.distancesToLandmarks(target);
+    for (size_t i = 0; i < m_graph.landmarkCount(); i++) {
+        bound = max(bound, fromTarget[i] - fromN[i]);
+        bound = max(bound, toN[i] - toTarget[i]);
     }
+    return bound;
 }
 
-    // Get the "children" of the passed in asn, which are its adjacent asns
-list<AStarNode> PointToPointRouterImpl::getChildren(AStarNode* asn) const {
-    list<AStarNode> children;
+    // Using the parent edges we can trace back a route from meet to the start node, and (after a bidirectional search)
+    //      on from meet to the end node, laying the edges out start to end in the workspace's arena
+void PointToPointRouterImpl::reverseNodeRoute(SearchWorkspace& workspace, NodeId meet, bool bidirectional, const EdgeId*& edges, size_t& length) const {
+    SearchSpace& forward = workspace.forward();
+    SearchSpace* backward = bidirectional ? &workspace.backward() : nullptr;
     
-    vector<StreetSegment> adjStreetSegs;
-    m_streetMap->getSegmentsThatStartWith(asn->gc, adjStreetSegs);
-    
-    for (StreetSegment ss : adjStreetSegs) {
-        AStarNode toPush(asn, ss.end, asn->tar);
-        children.push_back(toPush);
+        // The start and end nodes have no parent edge, so when we reach them that half of the route is complete
+    size_t forwardLength = 0;
+    for (EdgeId e = forward.node(meet).parentEdge; e != NO_EDGE; e = forward.node(m_graph.edgeSource(e)).parentEdge) {
+        forwardLength++;
+    }
+    length = forwardLength;
+    if (bidirectional) {
+        for (EdgeId e = backward->node(meet).parentEdge; e != NO_EDGE; e = backward->node(m_graph.edgeTarget(e)).parentEdge) {
+            length++;
+        }
     }
     
-    return children;
+    EdgeId* route = workspace.arena().allocate<EdgeId>(length);
+    size_t i = forwardLength;
+    for (EdgeId e = forward.node(meet).parentEdge; e != NO_EDGE; e = forward.node(m_graph.edgeSource(e)).parentEdge) {
+        route[--i] = e;
+    }
+    if (bidirectional) {
+        i = forwardLength;
+        for (EdgeId e = backward->node(meet).parentEdge; e != NO_EDGE; e = backward->node(m_graph.edgeTarget(e)).parentEdge) {
+            route[i++] = e;
+        }
+    }
+    edges = route;
 }
 
-    // Using asn.parent we can trace back a route from an end node to a start node
-list<StreetSegment> PointToPointRouterImpl::reverseNodeRoute(AStarNode* asn) const {
+    // The StreetSegments of a route given as edges from start to end
+list<StreetSegment> PointToPointRouterImpl::buildRoute(const EdgeId* edges, size_t length) const {
     list<StreetSegment> route;
-    
-        // If the passed in asn->parent is a nullptr, then 
-    
-    while (asn->parent != nullptr) {
-        vector<StreetSegment> parentAdjStreetSegs;
-        
-        m_streetMap->getSegmentsThatStartWith(asn->parent->gc, parentAdjStreetSegs);
-        
-        for (StreetSegment ss : parentAdjStreetSegs) {
-            if (ss.end == asn->gc && ss.start == asn->parent->gc) {
-                route.push_front(ss);
-                asn = asn->parent;
-            }
-        }
+    for (size_t i = 0; i < length; i++) {
+        route.push_back(m_graph.segment(edges[i]));
     }
     
     return route;
@@ -251,3 +436,31 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
 {
     return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
 }
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        CompactRoute& route) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route);
+}
+
+void PointToPointRouter::setAlgorithm(RouteAlgorithm algorithm)
+{
+    m_impl->setAlgorithm(algorithm);
+}
+
+void PointToPointRouter::setRouteCache(RouteCache* cache)
+{
+    m_impl->setRouteCache(cache);
+}
+
+void PointToPointRouter::setSnapDistance(double maxMiles)
+{
+    m_impl->setSnapDistance(maxMiles);
+}
+
+RouteStats PointToPointRouter::lastRouteStats() const
+{
+    return m_impl->lastRouteStats();
+}
@@ -0,0 +1,185 @@
+#include "RouteCache.h"
+#include <algorithm>
+#include <utility>
+using namespace std;
+
+RouteCache::RouteCache(size_t byteBudget)
+ : m_byteBudget(byteBudget), m_shardBudget(byteBudget / SHARD_COUNT), m_generation(0), m_invalidations(0)
+{}
+
+bool RouteCache::find(const StreetGraph& graph, NodeId start, NodeId end, SearchArena& arena, const EdgeId*& edges, size_t& length, double& miles)
+{
+    checkGeneration(graph);
+    uint64_t key = static_cast<uint64_t>(start) << 32 | end;
+    Shard& shard = shardFor(key);
+
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto slot = shard.index.find(key);
+    if (slot == shard.index.end()) {
+        shard.misses.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+        // Other readers may be setting the same bit, which is why it's atomic; nothing else about the entry changes
+        //      while we hold the lock shared
+    Entry& entry = shard.slots[slot->second];
+    entry.referenced.store(true, memory_order_relaxed);
+    EdgeId* copy = arena.allocate<EdgeId>(entry.length);
+    copy_n(entry.edges.get(), entry.length, copy);
+    edges = copy;
+    length = entry.length;
+    miles = entry.miles;
+    shard.hits.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+void RouteCache::insert(const StreetGraph& graph, NodeId start, NodeId end, const EdgeId* edges, size_t length, double miles)
+{
+    checkGeneration(graph);
+    size_t bytes = entryBytes(length);
+    if (bytes > m_shardBudget) {
+        return;
+    }
+    uint64_t key = static_cast<uint64_t>(start) << 32 | end;
+    Shard& shard = shardFor(key);
+
+    unique_lock<shared_mutex> lock(shard.mutex);
+    if (shard.index.find(key) != shard.index.end()) {
+        return;     // another thread searched for the same route at the same time, and stored it first
+    }
+    while (shard.bytes + bytes > m_shardBudget) {
+        evictOne(shard);
+    }
+
+    uint32_t slot;
+    if (!shard.freeSlots.empty()) {
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(shard.slots.size());
+        shard.slots.emplace_back(EMPTY_KEY);
+    }
+
+        // A new entry starts unreferenced, so a route asked for only once is the first to go
+    Entry& entry = shard.slots[slot];
+    entry.key = key;
+    entry.miles = miles;
+    entry.length = static_cast<uint32_t>(length);
+    entry.edges.reset(length == 0 ? nullptr : new EdgeId[length]);
+    copy_n(edges, length, entry.edges.get());
+    entry.referenced.store(false, memory_order_relaxed);
+    shard.index.emplace(key, slot);
+    shard.bytes += bytes;
+    shard.insertions++;
+}
+
+void RouteCache::invalidate()
+{
+    lock_guard<mutex> lock(m_invalidateMutex);
+    clearShards();
+    m_invalidations++;
+}
+
+RouteCacheStats RouteCache::stats() const
+{
+    RouteCacheStats stats;
+    for (Shard& shard : m_shards) {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        stats.hits += shard.hits.load(memory_order_relaxed);
+        stats.misses += shard.misses.load(memory_order_relaxed);
+        stats.insertions += shard.insertions;
+        stats.evictions += shard.evictions;
+        stats.entries += shard.index.size();
+        stats.bytes += shard.bytes;
+    }
+    stats.invalidations = m_invalidations;
+    return stats;
+}
+
+void RouteCache::resetStats()
+{
+    for (Shard& shard : m_shards) {
+        unique_lock<shared_mutex> lock(shard.mutex);
+        shard.hits = 0;
+        shard.misses = 0;
+        shard.insertions = 0;
+        shard.evictions = 0;
+    }
+    m_invalidations = 0;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // Routes from one depot go to many places, so the whole key is mixed (splitmix64's finaliser) before picking a shard
+RouteCache::Shard& RouteCache::shardFor(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return m_shards[key % SHARD_COUNT];
+}
+
+    // Empties the cache if its routes came from a different graph than the one now being asked about
+    // Only the first thread to notice does the emptying; the rest wait for it, then find the generation up to date
+void RouteCache::checkGeneration(const StreetGraph& graph)
+{
+    if (m_generation.load(memory_order_acquire) == graph.generation()) {
+        return;
+    }
+    lock_guard<mutex> lock(m_invalidateMutex);
+    uint64_t generation = m_generation.load(memory_order_relaxed);
+    if (generation == graph.generation()) {
+        return;
+    }
+    clearShards();
+    if (generation != 0) {
+        m_invalidations++;      // an empty cache meeting its first graph isn't an invalidation
+    }
+    m_generation.store(graph.generation(), memory_order_release);
+}
+
+void RouteCache::clearShards()
+{
+    for (Shard& shard : m_shards) {
+        unique_lock<shared_mutex> lock(shard.mutex);
+        deque<Entry>().swap(shard.slots);
+        vector<uint32_t>().swap(shard.freeSlots);
+        shard.index.clear();
+        shard.hand = 0;
+        shard.bytes = 0;
+    }
+}
+
+    // What an entry counts against the budget: its slot, its node in the index, and its edges
+size_t RouteCache::entryBytes(size_t length)
+{
+    return sizeof(Entry) + sizeof(pair<const uint64_t, uint32_t>) + 2 * sizeof(void*) + length * sizeof(EdgeId);
+}
+
+    // Sweeps the hand round the shard's slots until it finds an entry that hasn't been hit since the hand last passed it,
+    //      clearing the referenced bits it passes on the way, and evicts that entry
+    // The shard must hold at least one entry, and be locked exclusively
+void RouteCache::evictOne(Shard& shard)
+{
+    for (;;) {
+        if (shard.hand >= shard.slots.size()) {
+            shard.hand = 0;
+        }
+        Entry& entry = shard.slots[shard.hand];
+        size_t slot = shard.hand++;
+        if (entry.key == EMPTY_KEY || entry.referenced.exchange(false, memory_order_relaxed)) {
+            continue;
+        }
+
+        shard.index.erase(entry.key);
+        shard.bytes -= entryBytes(entry.length);
+        entry.key = EMPTY_KEY;
+        entry.edges.reset();
+        shard.freeSlots.push_back(static_cast<uint32_t>(slot));
+        shard.evictions++;
+        return;
+    }
+}
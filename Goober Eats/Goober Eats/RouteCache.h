@@ -0,0 +1,114 @@
+// RouteCache.h
+
+// A bounded cache of routes, keyed by their start and end nodes, that PointToPointRouters (see
+// PointToPointRouter::setRouteCache()) look in before searching and fill in after. Deliveries keep going
+// between the same depots, restaurants and dorms, so most routes are asked for over and over.
+//
+//  - A route is stored as its EdgeIds (4 bytes a segment) and its length, and the cache keeps the total
+//    bytes of its entries under the budget it was made with.
+//  - That there is no route between two nodes is remembered too, as a route of infinite length: a search that
+//    fails has to exhaust everything reachable from the start, so it is the most expensive kind to repeat.
+//  - Eviction is CLOCK: every entry has a referenced bit that a hit sets, and when room is needed a hand
+//    sweeps over the entries, clearing set bits and evicting the first entry whose bit is already clear.
+//    Unlike LRU, a hit only sets a bit rather than moving the entry to the front of a list, so hits don't
+//    need to lock the entry list against each other.
+//  - The keys are spread over shards, each with its own shared_mutex: lookups take it shared, so any number
+//    of threads can hit the same shard at once, and insertions take it exclusively.
+//  - The cache remembers the StreetGraph::generation() its routes came from. The first lookup or insertion
+//    against a different generation (the map was reloaded) empties it.
+//
+// One cache can serve every router and planner thread working on the same StreetMap.
+
+#ifndef ROUTECACHE_INCLUDED
+#define ROUTECACHE_INCLUDED
+
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+    // What a RouteCache has done since it was made (or cleared with resetStats())
+struct RouteCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t insertions = 0;
+    size_t evictions = 0;           // entries pushed out to make room
+    size_t invalidations = 0;       // times the cache was emptied because the map changed, or by invalidate()
+    size_t entries = 0;             // entries held now
+    size_t bytes = 0;               // bytes they take up, as counted against the budget
+};
+
+class RouteCache
+{
+public:
+    explicit RouteCache(size_t byteBudget);
+
+        // Looks up the route from start to end on graph; on a hit, copies its edges into the arena (where they
+        //      stay until the arena's next reset) and returns true. miles is infinite if there is known to be no route
+    bool find(const StreetGraph& graph, NodeId start, NodeId end, SearchArena& arena, const EdgeId*& edges, size_t& length, double& miles);
+        // Remembers the route from start to end on graph, evicting other routes to make room for it
+        // Pass an empty route and infinite miles to remember that there is no route; a route too big for the budget
+        //      on its own is not stored
+    void insert(const StreetGraph& graph, NodeId start, NodeId end, const EdgeId* edges, size_t length, double miles);
+
+        // Forgets every route
+    void invalidate();
+
+    RouteCacheStats stats() const;
+    void resetStats();
+    size_t byteBudget() const { return m_byteBudget; }
+
+        // C++11 syntax for preventing copying and assignment
+    RouteCache(const RouteCache&) = delete;
+    RouteCache& operator=(const RouteCache&) = delete;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr uint64_t EMPTY_KEY = UINT64_MAX;
+
+    struct Entry {
+        explicit Entry(uint64_t k) : key(k), miles(0), length(0), referenced(false) {}
+        uint64_t key;                       // start << 32 | end, or EMPTY_KEY for an unused slot
+        double miles;
+        uint32_t length;
+        std::unique_ptr<EdgeId[]> edges;
+        std::atomic<bool> referenced;
+    };
+
+        // Each shard is one clock: its entries are the slots the hand sweeps over
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+        std::deque<Entry> slots;                        // a deque, so slots never move once made
+        std::vector<uint32_t> freeSlots;
+        std::unordered_map<uint64_t, uint32_t> index;   // key -> slot
+        size_t hand = 0;
+        size_t bytes = 0;
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+        size_t insertions = 0;
+        size_t evictions = 0;
+    };
+
+    size_t m_byteBudget;
+    size_t m_shardBudget;
+    mutable Shard m_shards[SHARD_COUNT];     // stats() locks them too
+    std::atomic<uint64_t> m_generation;
+    std::mutex m_invalidateMutex;
+    std::atomic<size_t> m_invalidations;
+
+        // Auxiliary Functions
+    Shard& shardFor(uint64_t key);
+    void checkGeneration(const StreetGraph& graph);
+    void clearShards();
+    static size_t entryBytes(size_t length);
+    void evictOne(Shard& shard);
+};
+
+#endif // ROUTECACHE_INCLUDED
@@ -0,0 +1,180 @@
+// SearchWorkspace.h
+
+// Scratch space for searches over a StreetGraph, reused from one query to the next so that a query
+// allocates nothing once the workspace has grown to fit. Each thread has its own (see forThread()),
+// so routers on different threads never share or lock anything.
+//
+//  - Each direction of a search (a SearchSpace) keeps its per node state in one array of NodeStates, as big
+//    as the largest graph the thread has searched. Every entry records the generation of the search that
+//    wrote it, and beginSearch() starts a new generation, which makes everything earlier searches left
+//    behind stale without clearing the array.
+//  - Each direction's open set is an IndexedHeap over the same NodeIds, and is emptied in time proportional
+//    to what is left in it.
+//  - The arena hands out scratch arrays that last until the next beginSearch().
+//
+// A workspace holds one search at a time: a search must not start another on the same thread before it's done.
+
+#ifndef SEARCHWORKSPACE_INCLUDED
+#define SEARCHWORKSPACE_INCLUDED
+
+#include "StreetGraph.h"
+#include "IndexedHeap.h"
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+    // A bump allocator for arrays of trivial types. reset() takes everything back at once and keeps the memory,
+    //      so after the first few searches allocate() is just a pointer increment
+class SearchArena
+{
+public:
+    SearchArena() : m_used(0), m_spilled(0) {}
+
+        // Uninitialised space for n Ts, valid until the next reset()
+    template<typename T>
+    T* allocate(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+        size_t start = (m_used + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (start + n * sizeof(T) > m_block.size()) {
+                // Doesn't fit; give this request its own block, and remember to make the main block bigger
+            m_overflow.emplace_back(new unsigned char[n * sizeof(T) + alignof(T)]);
+            m_spilled += n * sizeof(T) + alignof(T);
+            void* raw = m_overflow.back().get();
+            size_t space = n * sizeof(T) + alignof(T);
+            return static_cast<T*>(std::align(alignof(T), n * sizeof(T), raw, space));
+        }
+        m_used = start + n * sizeof(T);
+        return reinterpret_cast<T*>(m_block.data() + start);
+    }
+
+        // Frees everything allocated since the last reset; if the block overflowed, it grows to fit it all next time
+    void reset() {
+        if (m_spilled != 0) {
+            m_block.resize(2 * (m_block.size() + m_spilled));
+            m_overflow.clear();
+            m_spilled = 0;
+        }
+        m_used = 0;
+    }
+
+    size_t memoryUsage() const { return m_block.capacity(); }
+
+private:
+    std::vector<unsigned char> m_block;
+    size_t m_used;
+    std::vector<std::unique_ptr<unsigned char[]>> m_overflow;
+    size_t m_spilled;
+};
+
+class SearchWorkspace;
+
+    // The per node state and open set of one direction of a search
+class SearchSpace
+{
+public:
+    struct NodeState {
+        double gCost;           // length of the shortest path found so far from where this direction started
+        EdgeId parentEdge;      // the edge that path arrives along (leaves along, for a backward search)
+        uint32_t reached;       // generation in which gCost and parentEdge were last set
+        uint32_t closed;        // generation in which the node's shortest path was settled
+    };
+    
+        // Whether n has been reached (so its gCost and parentEdge mean something) in this search
+    bool reached(NodeId n) const { return m_nodes[n].reached == *m_generation; }
+        // Whether n's shortest path is settled, i.e. it has been taken off the open set
+    bool closed(NodeId n) const { return m_nodes[n].closed == *m_generation; }
+    
+    const NodeState& node(NodeId n) const { return m_nodes[n]; }
+    void reach(NodeId n, double gCost, EdgeId parentEdge) {
+        NodeState& state = m_nodes[n];
+        state.gCost = gCost;
+        state.parentEdge = parentEdge;
+        state.reached = *m_generation;
+    }
+    void close(NodeId n) { m_nodes[n].closed = *m_generation; }
+    
+        // The open set, ordered by fCost
+    IndexedHeap<double>& openSet() { return m_openSet; }
+    
+    size_t memoryUsage() const { return m_nodes.capacity() * sizeof(NodeState) + m_openSet.memoryUsage(); }
+    
+private:
+    friend class SearchWorkspace;
+    
+    explicit SearchSpace(const uint32_t* generation) : m_generation(generation) {}
+    
+        // Grows (never shrinks) to cover nodeCount nodes; new entries start out stale
+    void fit(size_t nodeCount) {
+        if (m_nodes.size() < nodeCount) {
+            m_openSet.clear();
+            m_nodes.resize(nodeCount, NodeState{0, NO_EDGE, 0, 0});
+            m_openSet.resize(nodeCount);
+        }
+    }
+    
+    void forget() {
+        for (NodeState& state : m_nodes) {
+            state.reached = state.closed = 0;
+        }
+    }
+    
+    std::vector<NodeState> m_nodes;
+    const uint32_t* m_generation;       // the workspace's
+    IndexedHeap<double> m_openSet;
+};
+
+class SearchWorkspace
+{
+public:
+        // The calling thread's workspace, made big enough for graph
+    static SearchWorkspace& forThread(const StreetGraph& graph) {
+        thread_local SearchWorkspace workspace;
+        workspace.m_nodeCount = graph.nodeCount();
+        workspace.m_forward.fit(workspace.m_nodeCount);
+        return workspace;
+    }
+    
+        // Starts a new search, forgetting everything about the last one
+    void beginSearch() {
+        m_forward.m_openSet.clear();
+        m_backward.m_openSet.clear();
+        m_arena.reset();
+        if (++m_generation == 0) {
+                // The generation wrapped around, so old stamps could look current again
+            m_forward.forget();
+            m_backward.forget();
+            m_generation = 1;
+        }
+    }
+    
+        // The search from the start, and the search back from the destination (only grown when first used)
+    SearchSpace& forward() { return m_forward; }
+    SearchSpace& backward() {
+        m_backward.fit(m_nodeCount);
+        return m_backward;
+    }
+    
+    SearchArena& arena() { return m_arena; }
+    
+        // What the route being generated on this thread (or the last one generated) took; the router fills this in
+    RouteStats& stats() { return m_stats; }
+    
+    size_t memoryUsage() const { return m_forward.memoryUsage() + m_backward.memoryUsage() + m_arena.memoryUsage(); }
+    
+        // C++11 syntax for preventing copying and assignment
+    SearchWorkspace(const SearchWorkspace&) = delete;
+    SearchWorkspace& operator=(const SearchWorkspace&) = delete;
+    
+private:
+    SearchWorkspace() : m_generation(0), m_nodeCount(0), m_forward(&m_generation), m_backward(&m_generation), m_stats() {}
+    
+    uint32_t m_generation;
+    size_t m_nodeCount;
+    SearchSpace m_forward;
+    SearchSpace m_backward;
+    SearchArena m_arena;
+    RouteStats m_stats;
+};
+
+#endif // SEARCHWORKSPACE_INCLUDED
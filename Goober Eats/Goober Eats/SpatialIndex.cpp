@@ -0,0 +1,369 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+using namespace std;
+
+SpatialIndex::SpatialIndex()
+ : m_graph(nullptr), m_originLatitude(0), m_originLongitude(0), m_milesPerLatitude(0), m_milesPerLongitude(0),
+   m_cellMiles(1), m_columns(0), m_rows(0)
+{}
+
+void SpatialIndex::build(const StreetGraph& graph)
+{
+    m_graph = &graph;
+    size_t nNodes = graph.nodeCount();
+    if (nNodes == 0) {
+        m_columns = m_rows = 0;
+        m_nodeCellOffsets.assign(1, 0);
+        m_segmentCellOffsets.assign(1, 0);
+        m_points.clear();
+        m_segments.clear();
+        m_emptyNodeRings.clear();
+        m_emptySegmentRings.clear();
+        return;
+    }
+
+        // Project about the middle latitude of the map, from its south west corner
+    double minLatitude = graph.latitude(0), maxLatitude = graph.latitude(0);
+    double minLongitude = graph.longitude(0), maxLongitude = graph.longitude(0);
+    for (NodeId n = 1; n < nNodes; n++) {
+        minLatitude = min(minLatitude, graph.latitude(n));
+        maxLatitude = max(maxLatitude, graph.latitude(n));
+        minLongitude = min(minLongitude, graph.longitude(n));
+        maxLongitude = max(maxLongitude, graph.longitude(n));
+    }
+    const double earthRadiusMiles = 6371.0 / 1.609344;
+    m_originLatitude = minLatitude;
+    m_originLongitude = minLongitude;
+    m_milesPerLatitude = deg2rad(1) * earthRadiusMiles;
+    m_milesPerLongitude = m_milesPerLatitude * cos(deg2rad((minLatitude + maxLatitude) / 2));
+
+    vector<double> xs(nNodes);
+    vector<double> ys(nNodes);
+    for (NodeId n = 0; n < nNodes; n++) {
+        project(graph.latitude(n), graph.longitude(n), xs[n], ys[n]);
+    }
+
+        // About two nodes to a cell
+    double width = (maxLongitude - minLongitude) * m_milesPerLongitude;
+    double height = (maxLatitude - minLatitude) * m_milesPerLatitude;
+    double cells = max(1.0, nNodes / 2.0);
+    m_cellMiles = sqrt(width * height / cells);
+    if (!(m_cellMiles > 0)) {
+        m_cellMiles = max(max(width, height) / cells, 1e-6);     // every node is on one line
+    }
+    m_columns = static_cast<int>(width / m_cellMiles) + 1;
+    m_rows = static_cast<int>(height / m_cellMiles) + 1;
+    size_t nCells = static_cast<size_t>(m_columns) * m_rows;
+
+        // Sort the nodes into their cells, like the edges of a CSR graph
+    vector<uint32_t> nodeCells(nNodes);
+    m_nodeCellOffsets.assign(nCells + 1, 0);
+    for (NodeId n = 0; n < nNodes; n++) {
+        nodeCells[n] = static_cast<uint32_t>(row(ys[n]) * m_columns + column(xs[n]));
+        m_nodeCellOffsets[nodeCells[n] + 1]++;
+    }
+    for (size_t c = 0; c < nCells; c++) {
+        m_nodeCellOffsets[c + 1] += m_nodeCellOffsets[c];
+    }
+    m_points.resize(nNodes);
+    vector<uint32_t> nextSlot(m_nodeCellOffsets.begin(), m_nodeCellOffsets.end() - 1);
+    for (NodeId n = 0; n < nNodes; n++) {
+        m_points[nextSlot[nodeCells[n]]++] = Point{ xs[n], ys[n], n };
+    }
+
+        // Then the segments into every cell their bounding box touches; segments are short, so that's rarely more than two
+        // A segment whose reverse is in the map too is only indexed once
+    vector<pair<uint32_t, EdgeId>> segmentCells;
+    for (EdgeId e = 0; e < graph.edgeCount(); e++) {
+        NodeId from = graph.edgeSource(e);
+        NodeId to = graph.edgeTarget(e);
+        if (from > to) {
+            bool reversed = false;
+            for (EdgeId r = graph.edgeBegin(to); r != graph.edgeEnd(to) && !reversed; r++) {
+                reversed = graph.edgeTarget(r) == from;
+            }
+            if (reversed) {
+                continue;
+            }
+        }
+        int firstColumn = column(min(xs[from], xs[to])), lastColumn = column(max(xs[from], xs[to]));
+        int firstRow = row(min(ys[from], ys[to])), lastRow = row(max(ys[from], ys[to]));
+        for (int r = firstRow; r <= lastRow; r++) {
+            for (int c = firstColumn; c <= lastColumn; c++) {
+                segmentCells.push_back(make_pair(static_cast<uint32_t>(r * m_columns + c), e));
+            }
+        }
+    }
+    m_segmentCellOffsets.assign(nCells + 1, 0);
+    for (const auto& [cell, e] : segmentCells) {
+        m_segmentCellOffsets[cell + 1]++;
+    }
+    for (size_t c = 0; c < nCells; c++) {
+        m_segmentCellOffsets[c + 1] += m_segmentCellOffsets[c];
+    }
+    m_segments.resize(segmentCells.size());
+    nextSlot.assign(m_segmentCellOffsets.begin(), m_segmentCellOffsets.end() - 1);
+    for (const auto& [cell, e] : segmentCells) {
+        m_segments[nextSlot[cell]++] = Segment{ xs[graph.edgeSource(e)], ys[graph.edgeSource(e)], xs[graph.edgeTarget(e)], ys[graph.edgeTarget(e)], e };
+    }
+    
+    countEmptyRings(m_nodeCellOffsets, m_emptyNodeRings);
+    countEmptyRings(m_segmentCellOffsets, m_emptySegmentRings);
+}
+
+NodeId SpatialIndex::nearestNode(double latitude, double longitude, double* miles) const
+{
+    double x, y;
+    project(latitude, longitude, x, y);
+    NodeId best = NO_NODE;
+    double bestSquared = numeric_limits<double>::infinity();
+    searchRings(x, y, m_emptyNodeRings, [&](uint32_t cell) {
+        for (uint32_t i = m_nodeCellOffsets[cell]; i != m_nodeCellOffsets[cell + 1]; i++) {
+            double dx = m_points[i].x - x, dy = m_points[i].y - y;
+            double squared = dx * dx + dy * dy;
+            if (squared < bestSquared) {
+                bestSquared = squared;
+                best = m_points[i].node;
+            }
+        }
+    }, [&]() { return bestSquared; });
+
+    if (miles != nullptr) {
+        *miles = (best == NO_NODE) ? numeric_limits<double>::infinity()
+                                   : distanceEarthMiles(latitude, longitude, m_graph->latitude(best), m_graph->longitude(best));
+    }
+    return best;
+}
+
+void SpatialIndex::nearestNodes(double latitude, double longitude, size_t k, vector<NodeId>& nodes) const
+{
+    nodes.clear();
+    if (k == 0) {
+        return;
+    }
+    double x, y;
+    project(latitude, longitude, x, y);
+
+        // A max heap of the k nearest found so far, so the farthest of them is the one to beat
+    vector<pair<double, NodeId>> best;
+    searchRings(x, y, m_emptyNodeRings, [&](uint32_t cell) {
+        for (uint32_t i = m_nodeCellOffsets[cell]; i != m_nodeCellOffsets[cell + 1]; i++) {
+            double dx = m_points[i].x - x, dy = m_points[i].y - y;
+            double squared = dx * dx + dy * dy;
+            if (best.size() < k) {
+                best.push_back(make_pair(squared, m_points[i].node));
+                push_heap(best.begin(), best.end());
+            } else if (squared < best.front().first) {
+                pop_heap(best.begin(), best.end());
+                best.back() = make_pair(squared, m_points[i].node);
+                push_heap(best.begin(), best.end());
+            }
+        }
+    }, [&]() { return best.size() < k ? numeric_limits<double>::infinity() : best.front().first; });
+
+    sort_heap(best.begin(), best.end());
+    for (const auto& [squared, node] : best) {
+        nodes.push_back(node);
+    }
+}
+
+SegmentSnap SpatialIndex::nearestSegment(double latitude, double longitude) const
+{
+    double x, y;
+    project(latitude, longitude, x, y);
+    SegmentSnap snap;
+    double bestSquared = numeric_limits<double>::infinity();
+    searchRings(x, y, m_emptySegmentRings, [&](uint32_t cell) {
+        for (uint32_t i = m_segmentCellOffsets[cell]; i != m_segmentCellOffsets[cell + 1]; i++) {
+                // The nearest point of the segment is the query's projection onto its line, kept between its ends
+            const Segment& segment = m_segments[i];
+            double ax = segment.fromX, ay = segment.fromY;
+            double ex = segment.toX - ax, ey = segment.toY - ay;
+            double length2 = ex * ex + ey * ey;
+            double t = (length2 == 0) ? 0 : max(0.0, min(1.0, ((x - ax) * ex + (y - ay) * ey) / length2));
+            double dx = ax + t * ex - x, dy = ay + t * ey - y;
+            double squared = dx * dx + dy * dy;
+            if (squared < bestSquared) {
+                bestSquared = squared;
+                snap.edge = segment.edge;
+                snap.fraction = t;
+            }
+        }
+    }, [&]() { return bestSquared; });
+
+    if (snap.edge != NO_EDGE) {
+        NodeId from = m_graph->edgeSource(snap.edge), to = m_graph->edgeTarget(snap.edge);
+        snap.latitude = m_graph->latitude(from) + snap.fraction * (m_graph->latitude(to) - m_graph->latitude(from));
+        snap.longitude = m_graph->longitude(from) + snap.fraction * (m_graph->longitude(to) - m_graph->longitude(from));
+        snap.miles = distanceEarthMiles(latitude, longitude, snap.latitude, snap.longitude);
+    }
+    return snap;
+}
+
+NodeId SpatialIndex::snap(const GeoCoord& gc, double maxMiles) const
+{
+    NodeId node = m_graph->findNode(gc);
+    if (node != NO_NODE) {
+        return node;
+    }
+    SegmentSnap nearest = nearestSegment(gc);
+    if (nearest.edge == NO_EDGE || nearest.miles > maxMiles) {
+        return NO_NODE;
+    }
+    return (nearest.fraction <= 0.5) ? m_graph->edgeSource(nearest.edge) : m_graph->edgeTarget(nearest.edge);
+}
+
+void SpatialIndex::nearestNodes(const vector<GeoCoord>& points, vector<NodeId>& nodes) const
+{
+    nodes.resize(points.size());
+    for (const BatchQuery& query : cellOrder(points)) {
+        nodes[query.point] = nearestNode(query.latitude, query.longitude);
+    }
+}
+
+void SpatialIndex::nearestSegments(const vector<GeoCoord>& points, vector<SegmentSnap>& snaps) const
+{
+    snaps.resize(points.size());
+    for (const BatchQuery& query : cellOrder(points)) {
+        snaps[query.point] = nearestSegment(query.latitude, query.longitude);
+    }
+}
+
+size_t SpatialIndex::memoryUsage() const
+{
+    return m_nodeCellOffsets.capacity() * sizeof(uint32_t) + m_points.capacity() * sizeof(Point)
+         + m_segmentCellOffsets.capacity() * sizeof(uint32_t) + m_segments.capacity() * sizeof(Segment)
+         + (m_emptyNodeRings.capacity() + m_emptySegmentRings.capacity()) * sizeof(uint32_t);
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+void SpatialIndex::project(double latitude, double longitude, double& x, double& y) const {
+    x = (longitude - m_originLongitude) * m_milesPerLongitude;
+    y = (latitude - m_originLatitude) * m_milesPerLatitude;
+}
+
+    // The column and row a point falls in; points off the edge of the grid are put in its nearest cell
+int SpatialIndex::column(double x) const {
+    return static_cast<int>(max(0.0, min(static_cast<double>(m_columns - 1), floor(x / m_cellMiles))));
+}
+
+int SpatialIndex::row(double y) const {
+    return static_cast<int>(max(0.0, min(static_cast<double>(m_rows - 1), floor(y / m_cellMiles))));
+}
+
+uint32_t SpatialIndex::cellOf(double latitude, double longitude) const {
+    double x, y;
+    project(latitude, longitude, x, y);
+    return static_cast<uint32_t>(row(y) * m_columns + column(x));
+}
+
+    // The number of empty rings around each cell is its chessboard distance to the nearest cell with anything in it,
+    //      which two passes over the grid work out exactly: one from the top left, and one back from the bottom right
+void SpatialIndex::countEmptyRings(const vector<uint32_t>& cellOffsets, vector<uint32_t>& emptyRings) const {
+    const uint32_t FAR = UINT32_MAX / 2;
+    emptyRings.assign(static_cast<size_t>(m_columns) * m_rows, FAR);
+    for (size_t c = 0; c < emptyRings.size(); c++) {
+        if (cellOffsets[c] != cellOffsets[c + 1]) {
+            emptyRings[c] = 0;
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        int step = (pass == 0) ? 1 : -1;
+        int firstRow = (pass == 0) ? 0 : m_rows - 1;
+        int firstColumn = (pass == 0) ? 0 : m_columns - 1;
+        for (int r = firstRow; r >= 0 && r < m_rows; r += step) {
+            for (int c = firstColumn; c >= 0 && c < m_columns; c += step) {
+                    // The neighbours already passed: the row behind, and the cell before in this row
+                uint32_t& rings = emptyRings[static_cast<size_t>(r) * m_columns + c];
+                int behind = r - step;
+                for (int dc = -1; dc <= 1; dc++) {
+                    if (behind >= 0 && behind < m_rows && c + dc >= 0 && c + dc < m_columns) {
+                        rings = min(rings, emptyRings[static_cast<size_t>(behind) * m_columns + c + dc] + 1);
+                    }
+                }
+                if (c - step >= 0 && c - step < m_columns) {
+                    rings = min(rings, emptyRings[static_cast<size_t>(r) * m_columns + c - step] + 1);
+                }
+            }
+        }
+    }
+}
+
+/**
+* Visits the cells of the grid in rings of growing radius around the cell (x, y) falls in, until none could hold anything nearer
+* @param emptyRings How many rings around each cell are empty; those are skipped over
+* @param visitCell Called with each cell visited
+* @param threshold Returns the squared distance that anything still to be found has to beat
+* After ring r, the only cells left lie beyond one of the sides of the square of rings 0 to r that hasn't reached the edge of
+*   the grid yet; the nearest any of them can be is the distance from (x, y) to the nearest such side
+*/
+template<typename VisitCell, typename Threshold>
+void SpatialIndex::searchRings(double x, double y, const vector<uint32_t>& emptyRings, VisitCell visitCell, Threshold threshold) const {
+    if (m_columns == 0) {
+        return;
+    }
+    int centreColumn = column(x);
+    int centreRow = row(y);
+    int firstRing = static_cast<int>(min<uint32_t>(emptyRings[centreRow * m_columns + centreColumn], max(m_columns, m_rows)));
+    for (int r = firstRing; ; r++) {
+        int firstRow = max(0, centreRow - r), lastRow = min(m_rows - 1, centreRow + r);
+        for (int currRow = firstRow; currRow <= lastRow; currRow++) {
+            uint32_t rowStart = static_cast<uint32_t>(currRow * m_columns);
+            if (currRow == centreRow - r || currRow == centreRow + r) {
+                    // The top and bottom of the ring are whole rows
+                for (int c = max(0, centreColumn - r); c <= min(m_columns - 1, centreColumn + r); c++) {
+                    visitCell(rowStart + c);
+                }
+            } else {
+                if (centreColumn - r >= 0) {
+                    visitCell(rowStart + centreColumn - r);
+                }
+                if (centreColumn + r < m_columns) {
+                    visitCell(rowStart + centreColumn + r);
+                }
+            }
+        }
+
+        double bound = numeric_limits<double>::infinity();
+        if (centreColumn - r > 0) {
+            bound = min(bound, max(0.0, x - (centreColumn - r) * m_cellMiles));
+        }
+        if (centreColumn + r < m_columns - 1) {
+            bound = min(bound, max(0.0, (centreColumn + r + 1) * m_cellMiles - x));
+        }
+        if (centreRow - r > 0) {
+            bound = min(bound, max(0.0, y - (centreRow - r) * m_cellMiles));
+        }
+        if (centreRow + r < m_rows - 1) {
+            bound = min(bound, max(0.0, (centreRow + r + 1) * m_cellMiles - y));
+        }
+        if (bound == numeric_limits<double>::infinity() || bound * bound >= threshold()) {
+            return;
+        }
+    }
+}
+
+    // The coordinates of points, sorted by the cell each falls in (with a counting sort, like the grid itself)
+    // Copying the coordinates out means the queries don't have to go back to the GeoCoords, which are large and
+    //      would be read in no particular order
+vector<SpatialIndex::BatchQuery> SpatialIndex::cellOrder(const vector<GeoCoord>& points) const {
+    size_t nCells = static_cast<size_t>(m_columns) * m_rows;
+    vector<uint32_t> cells(points.size(), 0);
+    vector<uint32_t> cellOffsets(nCells + 1, 0);
+    for (size_t i = 0; i < points.size() && nCells != 0; i++) {
+        cells[i] = cellOf(points[i].latitude, points[i].longitude);
+        cellOffsets[cells[i] + 1]++;
+    }
+    for (size_t c = 0; c < nCells; c++) {
+        cellOffsets[c + 1] += cellOffsets[c];
+    }
+    vector<BatchQuery> order(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        order[cellOffsets[cells[i]]++] = BatchQuery{ points[i].latitude, points[i].longitude, static_cast<uint32_t>(i) };
+    }
+    return order;
+}
@@ -0,0 +1,124 @@
+// SpatialIndex.h
+
+// A uniform grid over a StreetGraph, for finding the nodes and segments nearest to coordinates that
+// aren't in the map themselves, like the GPS fix of an order. StreetMap builds one whenever it loads
+// a map (see StreetMap::getSpatialIndex()).
+//
+// The map is projected onto a flat plane in miles (equirectangular, about the middle of the map),
+// and cut into square cells sized so that each holds a couple of nodes. Each cell's nodes are stored
+// together, with their projected coordinates, and so are the segments passing through it, so a query
+// reads a few short contiguous runs of memory. A query searches rings of cells outwards from the one
+// it falls in, and stops once nothing in the next ring could be nearer than what it has found.
+//
+// Distances are compared in the plane, which for a city-sized map is within a few parts in a million
+// of the haversine; the miles reported are distanceEarthMiles() to whatever was found.
+
+#ifndef SPATIALINDEX_INCLUDED
+#define SPATIALINDEX_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+    // The point on a segment nearest to some coordinates
+struct SegmentSnap
+{
+    EdgeId edge = NO_EDGE;      // NO_EDGE if the map has no segments
+    double fraction = 0;        // how far along the edge the point is, from 0 at its start to 1 at its end
+    double latitude = 0;
+    double longitude = 0;
+    double miles = std::numeric_limits<double>::infinity();     // from the coordinates to the point
+};
+
+class SpatialIndex
+{
+public:
+    SpatialIndex();
+
+        // Indexes graph's nodes and segments, replacing whatever was indexed before
+        // A segment and its reverse are indexed once, as whichever of the two starts at the lower NodeId
+    void build(const StreetGraph& graph);
+
+        // The node nearest to the coordinates, or NO_NODE if the map is empty; miles, if passed, is set to how far it is
+    NodeId nearestNode(double latitude, double longitude, double* miles = nullptr) const;
+    NodeId nearestNode(const GeoCoord& gc, double* miles = nullptr) const { return nearestNode(gc.latitude, gc.longitude, miles); }
+        // The k nodes nearest to the coordinates, nearest first (fewer if the map has fewer)
+    void nearestNodes(double latitude, double longitude, size_t k, std::vector<NodeId>& nodes) const;
+        // The point on any segment nearest to the coordinates
+    SegmentSnap nearestSegment(double latitude, double longitude) const;
+    SegmentSnap nearestSegment(const GeoCoord& gc) const { return nearestSegment(gc.latitude, gc.longitude); }
+
+        // The node a route to or from gc should use: gc's own node if it is in the map, or else the nearer end of the
+        //      nearest segment, as long as that segment passes within maxMiles of gc; NO_NODE otherwise
+    NodeId snap(const GeoCoord& gc, double maxMiles) const;
+
+        // The same queries for many points at once, as when a batch of orders comes in
+        // The points are answered in the order of the cells they fall in, so that neighbouring queries share the cells
+        //      they read, but the answers come back in the points' own order
+    void nearestNodes(const std::vector<GeoCoord>& points, std::vector<NodeId>& nodes) const;
+    void nearestSegments(const std::vector<GeoCoord>& points, std::vector<SegmentSnap>& snaps) const;
+
+        // Approximate number of bytes of heap memory held
+    size_t memoryUsage() const;
+
+        // C++11 syntax for preventing copying and assignment
+    SpatialIndex(const SpatialIndex&) = delete;
+    SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+private:
+    struct Point {
+        double x;
+        double y;
+        NodeId node;
+    };
+    struct Segment {
+        double fromX;
+        double fromY;
+        double toX;
+        double toY;
+        EdgeId edge;
+    };
+    struct BatchQuery {
+        double latitude;
+        double longitude;
+        uint32_t point;         // its index in the batch
+    };
+
+    const StreetGraph* m_graph;
+
+        // The projection: x and y are miles east and north of the grid's south west corner
+    double m_originLatitude;
+    double m_originLongitude;
+    double m_milesPerLatitude;
+    double m_milesPerLongitude;
+    double m_cellMiles;
+    int m_columns;
+    int m_rows;
+
+        // Per cell, in row major order: the nodes in cell c are m_points[m_nodeCellOffsets[c], m_nodeCellOffsets[c + 1]),
+        //      and the segments passing through it m_segments[m_segmentCellOffsets[c], m_segmentCellOffsets[c + 1])
+        // A segment is copied into every cell it passes through
+    std::vector<uint32_t> m_nodeCellOffsets;
+    std::vector<Point> m_points;
+    std::vector<uint32_t> m_segmentCellOffsets;
+    std::vector<Segment> m_segments;        // with their ends' projected coordinates, so a query never reads the graph
+
+        // Per cell, how many rings around it have no nodes (or segments) in them at all, so a query starting there
+        //      can go straight to the first ring with something in it; this is what keeps queries far from any
+        //      road (in a park, or off the edge of the map) from visiting hundreds of empty cells
+    std::vector<uint32_t> m_emptyNodeRings;
+    std::vector<uint32_t> m_emptySegmentRings;
+
+        // Auxiliary Functions
+    void project(double latitude, double longitude, double& x, double& y) const;
+    int column(double x) const;
+    int row(double y) const;
+    uint32_t cellOf(double latitude, double longitude) const;
+    void countEmptyRings(const std::vector<uint32_t>& cellOffsets, std::vector<uint32_t>& emptyRings) const;
+    template<typename VisitCell, typename Threshold>
+    void searchRings(double x, double y, const std::vector<uint32_t>& emptyRings, VisitCell visitCell, Threshold threshold) const;
+    std::vector<BatchQuery> cellOrder(const std::vector<GeoCoord>& points) const;
+};
+
+#endif // SPATIALINDEX_INCLUDED
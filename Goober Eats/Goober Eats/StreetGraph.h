@@ -0,0 +1,349 @@
+// StreetGraph.h
+
+// A compact, read-only road graph stored in compressed sparse row (CSR) form.
+// Every distinct GeoCoord in the map data becomes a node with a dense NodeId,
+// and every directed StreetSegment becomes an edge with a dense EdgeId.
+// The edges leaving node n are the contiguous range [edgeBegin(n), edgeEnd(n)),
+// so walking the neighbours of a node is a linear scan over a few small arrays
+// instead of a hash lookup plus a copy of a vector of StreetSegments.
+//
+// The graph is built by StreetMapImpl::load(), or attached to a memory-mapped
+// snapshot file by StreetMapImpl::loadSnapshot(); everything else only reads it.
+
+#ifndef STREETGRAPH_INCLUDED
+#define STREETGRAPH_INCLUDED
+
+#include "provided.h"
+#include "FlatHashMap.h"
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+typedef uint32_t NodeId;
+typedef uint32_t EdgeId;
+typedef uint32_t StreetNameId;
+typedef uint32_t ComponentId;
+
+const NodeId NO_NODE = UINT32_MAX;
+const EdgeId NO_EDGE = UINT32_MAX;
+
+    // The map data uses 7 decimal places, so internally coordinates are integers in units of 1e-7 degrees
+const int COORD_DECIMALS = 7;
+const double COORD_SCALE = 1e7;
+
+    // The key the graph looks GeoCoords up by: latitude and longitude as fixed point 32-bit integers,
+    //      packed into one 64-bit value so hashing and comparing never touch a string
+    // Text-form GeoCoords are converted to a CoordKey once, when they come in through the StreetMap API
+struct CoordKey {
+    CoordKey() : packed(0) {}
+    CoordKey(int32_t lat, int32_t lon)
+     : packed((static_cast<uint64_t>(static_cast<uint32_t>(lat)) << 32) | static_cast<uint32_t>(lon))
+    {}
+    
+    int32_t lat() const { return static_cast<int32_t>(static_cast<uint32_t>(packed >> 32)); }
+    int32_t lon() const { return static_cast<int32_t>(static_cast<uint32_t>(packed)); }
+    
+    uint64_t packed;
+};
+
+inline bool operator==(const CoordKey& lhs, const CoordKey& rhs)
+{
+    return lhs.packed == rhs.packed;
+}
+
+    // splitmix64 finaliser, folded down to 32 bits; every bit of the packed key affects every bit of the hash
+inline unsigned int hasher(const CoordKey& k)
+{
+    uint64_t h = k.packed;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return static_cast<unsigned int>(h ^ (h >> 32));
+}
+
+    // Same formula as distanceEarthMiles() in provided.h, but taking the raw degrees
+    //      so we don't have to construct GeoCoords (and their strings) to use it
+inline double distanceEarthMiles(double lat1d, double lon1d, double lat2d, double lon2d) {
+    static const double earthRadiusKm = 6371.0;
+    const double milesPerKm = 1 / 1.609344;
+    double lat1r = deg2rad(lat1d);
+    double lon1r = deg2rad(lon1d);
+    double lat2r = deg2rad(lat2d);
+    double lon2r = deg2rad(lon2d);
+    double u = std::sin((lat2r - lat1r) / 2);
+    double v = std::sin((lon2r - lon1r) / 2);
+    return 2.0 * earthRadiusKm * std::asin(std::sqrt(u * u + std::cos(lat1r) * std::cos(lat2r) * v * v)) * milesPerKm;
+}
+
+    // One of the StreetGraph's arrays. The elements either live in a vector the graph owns
+    //      (after StreetMap::load) or in a read-only mapping of a snapshot file (after StreetMap::loadSnapshot)
+template<typename T>
+class GraphArray
+{
+public:
+    GraphArray() : m_data(nullptr), m_size(0) {}
+    
+    size_t size() const { return m_size; }
+    const T* data() const { return m_data; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+    
+        // While the graph is being built, elements are added to the owned vector; seal() then publishes them
+    std::vector<T>& owned() { return m_owned; }
+    void seal() { m_data = m_owned.data(); m_size = m_owned.size(); }
+    
+        // Points the array at memory it doesn't own, freeing anything it did own
+    void attach(const T* data, size_t size) {
+        std::vector<T>().swap(m_owned);
+        m_data = data;
+        m_size = size;
+    }
+    
+    size_t ownedBytes() const { return m_owned.capacity() * sizeof(T); }
+    
+        // Exchanges contents with other; a vector's elements don't move when it is swapped, so both stay valid
+    void swap(GraphArray& other) {
+        m_owned.swap(other.m_owned);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+    
+private:
+    std::vector<T> m_owned;
+    const T* m_data;
+    size_t m_size;
+};
+
+    // How the map splits into connected components, for checking a map for islands of streets cut off from the rest
+struct ComponentStats
+{
+    size_t weakComponents = 0;          // pieces of the map with no street at all between them
+    size_t strongComponents = 0;        // pieces in which every GeoCoord can reach every other
+    size_t largestWeakComponent = 0;    // GeoCoords in the biggest of each
+    size_t largestStrongComponent = 0;
+    size_t isolatedNodes = 0;           // GeoCoords in a strong component on their own (dead ends of one-way streets)
+};
+
+class StreetGraph;
+
+    // A lightweight stand-in for a StreetSegment: a reference to one directed edge of a StreetGraph
+    // Nothing is copied; the name and coordinates are read from the graph when asked for
+class SegmentRef
+{
+public:
+    SegmentRef(const StreetGraph* graph, EdgeId e) : m_graph(graph), m_edge(e) {}
+    
+    EdgeId id() const { return m_edge; }
+    inline NodeId startNode() const;
+    inline NodeId endNode() const;
+    inline double length() const;       // in miles
+    inline std::string_view name() const;
+    
+        // Builds the full StreetSegment, strings and all, for callers that really need one
+    inline StreetSegment toStreetSegment() const;
+    
+private:
+    const StreetGraph* m_graph;
+    EdgeId m_edge;
+};
+
+    // A read-only view of the segments that start at one node, valid for as long as the StreetMap is
+    // Iterating it yields SegmentRefs, so walking a node's neighbours allocates nothing
+class SegmentRange
+{
+public:
+    class iterator
+    {
+    public:
+        iterator(const StreetGraph* graph, EdgeId e) : m_graph(graph), m_edge(e) {}
+        SegmentRef operator*() const { return SegmentRef(m_graph, m_edge); }
+        iterator& operator++() { m_edge++; return *this; }
+        bool operator==(const iterator& other) const { return m_edge == other.m_edge; }
+        bool operator!=(const iterator& other) const { return m_edge != other.m_edge; }
+    private:
+        const StreetGraph* m_graph;
+        EdgeId m_edge;
+    };
+    
+    SegmentRange() : m_graph(nullptr), m_begin(0), m_end(0) {}
+    SegmentRange(const StreetGraph* graph, EdgeId begin, EdgeId end) : m_graph(graph), m_begin(begin), m_end(end) {}
+    
+    iterator begin() const { return iterator(m_graph, m_begin); }
+    iterator end() const { return iterator(m_graph, m_end); }
+    size_t size() const { return m_end - m_begin; }
+    bool empty() const { return m_begin == m_end; }
+    SegmentRef operator[](size_t i) const { return SegmentRef(m_graph, m_begin + static_cast<EdgeId>(i)); }
+    
+private:
+    const StreetGraph* m_graph;
+    EdgeId m_begin;
+    EdgeId m_end;
+};
+
+class StreetGraph
+{
+public:
+    StreetGraph();
+
+        // Number of distinct GeoCoords (nodes) and directed StreetSegments (edges)
+    size_t nodeCount() const { return m_latitudes.size(); }
+    size_t edgeCount() const { return m_targets.size(); }
+
+        // Different for every graph load() or loadSnapshot() builds, so anything worked out from an earlier graph
+        //      (a cached route, say) can tell it is out of date
+    uint64_t generation() const { return m_generation; }
+
+        // Returns the NodeId of the passed in GeoCoord, or NO_NODE if it is not in the map
+    NodeId findNode(const GeoCoord& gc) const;
+
+        // Node data
+    double latitude(NodeId n) const { return m_latitudes[n]; }
+    double longitude(NodeId n) const { return m_longitudes[n]; }
+    GeoCoord nodeCoord(NodeId n) const;
+
+        // A lower bound on distanceEarthMiles() between two nodes, from an equirectangular projection of the map
+        //      rather than the haversine formula: two multiplies per axis and a square root, and no trig at all
+        // The projection's scales are worked out once per graph (see computeDistanceBound()) so that it never
+        //      overestimates; A* stays exact with it, and is consistent, since it is a straight line distance in the plane
+    double distanceBound(NodeId a, NodeId b) const {
+        double dy = (m_latitudes[a] - m_latitudes[b]) * m_latitudeScale;
+        double dx = (m_longitudes[a] - m_longitudes[b]) * m_longitudeScale;
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+        // Adjacency: the edges leaving n are [edgeBegin(n), edgeEnd(n))
+    EdgeId edgeBegin(NodeId n) const { return m_offsets[n]; }
+    EdgeId edgeEnd(NodeId n) const { return m_offsets[n + 1]; }
+    SegmentRange segmentsFrom(NodeId n) const { return SegmentRange(this, m_offsets[n], m_offsets[n + 1]); }
+
+        // Reverse adjacency: inEdge(i) for i in [inEdgeBegin(n), inEdgeEnd(n)) are the edges arriving at n
+        // load() adds both directions of every segment, but nothing that walks the graph backwards relies on that
+    uint32_t inEdgeBegin(NodeId n) const { return m_inOffsets[n]; }
+    uint32_t inEdgeEnd(NodeId n) const { return m_inOffsets[n + 1]; }
+    EdgeId inEdge(uint32_t i) const { return m_inEdges[i]; }
+
+        // Edge data
+    NodeId edgeSource(EdgeId e) const { return m_sources[e]; }
+    NodeId edgeTarget(EdgeId e) const { return m_targets[e]; }
+    double edgeLength(EdgeId e) const { return m_edgeLengths[e]; }      // in miles
+    StreetNameId edgeStreet(EdgeId e) const { return m_edgeStreets[e]; }
+
+        // Landmarks (see Landmarks.h), if the map has any: distancesFromLandmarks(n)[i] is the length of the shortest path
+        //      from landmark i to n, and distancesToLandmarks(n)[i] from n to landmark i, or infinity if there isn't one
+    size_t landmarkCount() const { return m_landmarks.size(); }
+    NodeId landmark(size_t i) const { return m_landmarks[i]; }
+    const double* distancesFromLandmarks(NodeId n) const { return m_landmarkFrom.data() + n * m_landmarks.size(); }
+    const double* distancesToLandmarks(NodeId n) const { return m_landmarkTo.data() + n * m_landmarks.size(); }
+
+        // Connected components, worked out when the map is loaded
+        // A route from a to b can only exist if they are in the same weak component (joined by streets, ignoring their
+        //      direction), so mayReach() rules out an impossible route in O(1), before any search. In the same strong
+        //      component, there is certainly a route both ways. While every street is two-way the two are the same
+    ComponentId weakComponent(NodeId n) const { return m_weakComponents[n]; }
+    ComponentId strongComponent(NodeId n) const { return m_strongComponents[n]; }
+    size_t weakComponentCount() const { return m_weakComponentSizes.size(); }
+    size_t strongComponentCount() const { return m_strongComponentSizes.size(); }
+    size_t weakComponentSize(ComponentId c) const { return m_weakComponentSizes[c]; }
+    size_t strongComponentSize(ComponentId c) const { return m_strongComponentSizes[c]; }
+    bool mayReach(NodeId a, NodeId b) const { return m_weakComponents[a] == m_weakComponents[b]; }
+    bool surelyReaches(NodeId a, NodeId b) const { return m_strongComponents[a] == m_strongComponents[b]; }
+    ComponentStats componentStats() const;
+
+        // Street names are stored once each, and referenced by edges through their StreetNameId
+    size_t streetCount() const { return m_streetNameOffsets.size() == 0 ? 0 : m_streetNameOffsets.size() - 1; }
+    std::string_view streetName(StreetNameId s) const {
+        return std::string_view(m_streetNames.data() + m_streetNameOffsets[s], m_streetNameOffsets[s + 1] - m_streetNameOffsets[s]);
+    }
+
+        // Builds the legacy StreetSegment (with all of its strings) for an edge
+    StreetSegment segment(EdgeId e) const;
+
+        // Approximate number of bytes of heap memory held by the graph arrays (not counting the node index)
+        // A graph attached to a snapshot holds almost none; its arrays live in the shared file mapping
+    size_t memoryUsage() const;
+
+        // C++11 syntax for preventing copying and assignment
+    StreetGraph(const StreetGraph&) = delete;
+    StreetGraph& operator=(const StreetGraph&) = delete;
+
+private:
+    friend class StreetMapImpl;
+
+        // Per node
+    GraphArray<double> m_latitudes;
+    GraphArray<double> m_longitudes;
+    GraphArray<uint32_t> m_coordTextOffsets;    // latitude text of n is [2n, 2n+1), longitude text is [2n+1, 2n+2)
+    GraphArray<char> m_coordText;
+    GraphArray<EdgeId> m_offsets;               // nodeCount() + 1 entries
+
+        // Per edge
+    GraphArray<NodeId> m_sources;
+    GraphArray<NodeId> m_targets;
+    GraphArray<double> m_edgeLengths;
+    GraphArray<StreetNameId> m_edgeStreets;
+    GraphArray<uint32_t> m_inOffsets;           // nodeCount() + 1 entries
+    GraphArray<EdgeId> m_inEdges;               // every edge, grouped by its end node
+
+        // Per landmark, and per node per landmark
+    GraphArray<NodeId> m_landmarks;
+    GraphArray<double> m_landmarkFrom;
+    GraphArray<double> m_landmarkTo;
+
+        // Per node, and per component
+    GraphArray<ComponentId> m_weakComponents;
+    GraphArray<ComponentId> m_strongComponents;
+    GraphArray<uint32_t> m_weakComponentSizes;
+    GraphArray<uint32_t> m_strongComponentSizes;
+
+        // Per street
+    GraphArray<uint32_t> m_streetNameOffsets;   // streetCount() + 1 entries
+    GraphArray<char> m_streetNames;
+
+        // Lookup from the fixed point form of a GeoCoord to its node
+    FlatHashMap<CoordKey, NodeId> m_nodeIndex;
+
+    uint64_t m_generation;
+
+        // Miles per degree of latitude and of longitude in distanceBound()
+    double m_latitudeScale;
+    double m_longitudeScale;
+
+    void computeDistanceBound();
+    void swap(StreetGraph& other);
+    std::string_view coordText(uint32_t i) const {
+        return std::string_view(m_coordText.data() + m_coordTextOffsets[i], m_coordTextOffsets[i + 1] - m_coordTextOffsets[i]);
+    }
+};
+
+//******************** SegmentRef functions ***********************************
+
+inline NodeId SegmentRef::startNode() const
+{
+    return m_graph->edgeSource(m_edge);
+}
+
+inline NodeId SegmentRef::endNode() const
+{
+    return m_graph->edgeTarget(m_edge);
+}
+
+inline double SegmentRef::length() const
+{
+    return m_graph->edgeLength(m_edge);
+}
+
+inline std::string_view SegmentRef::name() const
+{
+    return m_graph->streetName(m_graph->edgeStreet(m_edge));
+}
+
+inline StreetSegment SegmentRef::toStreetSegment() const
+{
+    return m_graph->segment(m_edge);
+}
+
+#endif // STREETGRAPH_INCLUDED
@@ -3,16 +3,263 @@
 #include <vector>
 #include <functional>
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include "ExpandableHashMap.h"
+#include "FlatHashMap.h"
+#include "StreetGraph.h"
+#include "ContractionHierarchy.h"
+#include "Landmarks.h"
+#include "SpatialIndex.h"
 using namespace std;
 
-unsigned int hasher(const GeoCoord& g)
+/////////////////////////////////////////////////
+// Map file parsing
+/////////////////////////////////////////////////
+    // A coordinate exactly as it appears in the mapped map file, plus its parsed value
+    // Coordinates are parsed straight into integers in units of 1e-7 degrees (see CoordKey)
+struct ParsedCoord {
+    const char* latText;
+    const char* lonText;
+    uint32_t latLength;
+    uint32_t lonLength;
+    int32_t lat;
+    int32_t lon;
+    double latDegrees;
+    double lonDegrees;
+    bool exact;         // false if either number had more than 7 decimal places, and so was cut short in lat or lon
+};
+
+    // One line of segment data, read by a worker thread
+struct ParsedSegment {
+    ParsedCoord start;
+    ParsedCoord end;
+    StreetNameId street;
+    double length;
+};
+
+    // One street of the map file: its name line, and the range of its segment lines
+struct StreetRecord {
+    const char* segsBegin;
+    const char* segsEnd;
+    int nSegs;
+};
+
+    // No latitude or longitude is bigger than this; it also keeps every coordinate's fixed point value well inside an int32_t
+    //      (which holds up to about 214.7 degrees), so that nothing can wrap around onto another node's CoordKey
+const int64_t MAX_DEGREES = 180;
+
+    // Parses a decimal number such as -118.4794734 in place, without building a string
+    //      value gets the number in fixed point (1e-7 units); exact is false if it had more than 7 decimal places
+    // Returns a pointer to the first character after the number, or nullptr if there was no number (or it was more than
+    //      MAX_DEGREES whole degrees)
+const char* parseFixedPoint(const char* p, const char* end, int32_t& value, bool& exact)
+{
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    
+    int64_t whole = 0;
+    const char* digitsStart = p;
+    while (p != end && *p >= '0' && *p <= '9') {
+        if (whole <= MAX_DEGREES) {     // past that it's no coordinate anyway, and mustn't overflow
+            whole = whole * 10 + (*p - '0');
+        }
+        p++;
+    }
+    
+    int64_t fraction = 0;
+    int decimals = 0;
+    exact = true;
+    if (p != end && *p == '.') {
+        p++;
+        while (p != end && *p >= '0' && *p <= '9') {
+            if (decimals < COORD_DECIMALS) {
+                fraction = fraction * 10 + (*p - '0');
+                decimals++;
+            } else if (*p != '0') {
+                exact = false;
+            }
+            p++;
+        }
+    }
+    if (p == digitsStart || whole > MAX_DEGREES) {      // no digits, or not a coordinate
+        return nullptr;
+    }
+    
+    for (; decimals < COORD_DECIMALS; decimals++) {
+        fraction *= 10;
+    }
+    int64_t scaled = whole * static_cast<int64_t>(COORD_SCALE) + fraction;
+    value = static_cast<int32_t>(negative ? -scaled : scaled);
+    return p;
+}
+
+    // Parses one coordinate token, skipping any blanks before it
+    //      exact is left alone if the number fitted in 7 decimal places, and set to false if it didn't
+const char* parseCoordToken(const char* p, const char* end, const char*& text, uint32_t& length, int32_t& value, double& degrees, bool& allExact)
+{
+    while (p != end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    text = p;
+    bool exact;
+    p = parseFixedPoint(p, end, value, exact);
+    allExact = allExact && exact;
+    if (p == nullptr) {
+        return nullptr;
+    }
+    length = static_cast<uint32_t>(p - text);
+    
+        // A fixed point value divided by 1e7 is the same double std::stod would give, as long as nothing was cut off
+    degrees = exact ? value / COORD_SCALE : strtod(string(text, length).c_str(), nullptr);
+    return p;
+}
+
+    // Parses the segment lines of a range of streets; each worker thread runs this on its own share of the file
+bool parseStreetRecords(const StreetRecord* records, size_t nRecords, StreetNameId firstStreet, vector<ParsedSegment>& segments)
+{
+    for (size_t r = 0; r < nRecords; r++) {
+        const char* p = records[r].segsBegin;
+        const char* end = records[r].segsEnd;
+        
+        for (int n = 0; n < records[r].nSegs; n++) {
+            ParsedSegment seg;
+            seg.street = firstStreet + static_cast<StreetNameId>(r);
+            
+            seg.start.exact = seg.end.exact = true;
+            p = parseCoordToken(p, end, seg.start.latText, seg.start.latLength, seg.start.lat, seg.start.latDegrees, seg.start.exact);
+            if (p != nullptr) p = parseCoordToken(p, end, seg.start.lonText, seg.start.lonLength, seg.start.lon, seg.start.lonDegrees, seg.start.exact);
+            if (p != nullptr) p = parseCoordToken(p, end, seg.end.latText, seg.end.latLength, seg.end.lat, seg.end.latDegrees, seg.end.exact);
+            if (p != nullptr) p = parseCoordToken(p, end, seg.end.lonText, seg.end.lonLength, seg.end.lon, seg.end.lonDegrees, seg.end.exact);
+            if (p == nullptr) {
+                return false;
+            }
+            
+            seg.length = distanceEarthMiles(seg.start.latDegrees, seg.start.lonDegrees, seg.end.latDegrees, seg.end.lonDegrees);
+            segments.push_back(seg);
+            
+                // On to the next line
+            p = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = (p == nullptr) ? end : p + 1;
+        }
+    }
+    return true;
+}
+
+    // Converts the text of a GeoCoord to its CoordKey
+    //      exact is false if either number had more than 7 decimal places (and so was cut short)
+    // Returns false if the text isn't a pair of numbers
+bool makeCoordKey(string_view latText, string_view lonText, CoordKey& key, bool& exact)
+{
+    int32_t lat;
+    int32_t lon;
+    bool latExact;
+    bool lonExact;
+    const char* latEnd = latText.data() + latText.size();
+    const char* lonEnd = lonText.data() + lonText.size();
+    
+    if (parseFixedPoint(latText.data(), latEnd, lat, latExact) != latEnd || parseFixedPoint(lonText.data(), lonEnd, lon, lonExact) != lonEnd) {
+        return false;
+    }
+    key = CoordKey(lat, lon);
+    exact = latExact && lonExact;
+    return true;
+}
+
+/////////////////////////////////////////////////
+// Snapshot file format
+/////////////////////////////////////////////////
+    // A snapshot is a binary image of a loaded StreetGraph:
+    //      a SnapshotHeader, then a table of SnapshotSections, then the raw contents of each graph array
+    // Every section starts on an 8 byte boundary, so once the file is mapped into memory the graph's
+    //      arrays can point straight into it. The checksum covers everything after the header.
+    // Snapshots are written in the byte order of the machine that wrote them; the magic number
+    //      doubles as an endianness check.
+const char SNAPSHOT_MAGIC[8] = { 'G', 'O', 'O', 'B', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION = 4;    // 2 added the reverse adjacency, 3 the landmarks, 4 the components
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct SnapshotSection {
+    uint32_t id;
+    uint32_t elementSize;
+    uint64_t offset;        // from the start of the file
+    uint64_t count;         // number of elements
+};
+
+enum SnapshotSectionId {
+    SECTION_LATITUDES, SECTION_LONGITUDES, SECTION_COORD_TEXT_OFFSETS, SECTION_COORD_TEXT, SECTION_OFFSETS,
+    SECTION_SOURCES, SECTION_TARGETS, SECTION_EDGE_LENGTHS, SECTION_EDGE_STREETS,
+    SECTION_STREET_NAME_OFFSETS, SECTION_STREET_NAMES, SECTION_IN_OFFSETS, SECTION_IN_EDGES,
+    SECTION_LANDMARKS, SECTION_LANDMARK_FROM, SECTION_LANDMARK_TO,
+    SECTION_WEAK_COMPONENTS, SECTION_STRONG_COMPONENTS, SECTION_WEAK_COMPONENT_SIZES, SECTION_STRONG_COMPONENT_SIZES,
+    SECTION_COUNT
+};
+
+const uint32_t SECTION_ELEMENT_SIZES[SECTION_COUNT] = {
+    sizeof(double), sizeof(double), sizeof(uint32_t), sizeof(char), sizeof(EdgeId),
+    sizeof(NodeId), sizeof(NodeId), sizeof(double), sizeof(StreetNameId),
+    sizeof(uint32_t), sizeof(char), sizeof(uint32_t), sizeof(EdgeId),
+    sizeof(NodeId), sizeof(double), sizeof(double),
+    sizeof(ComponentId), sizeof(ComponentId), sizeof(uint32_t), sizeof(uint32_t)
+};
+
+    // Hands out StreetGraph::generation()s; every graph built or mapped in by any StreetMap gets a new one
+atomic<uint64_t> nextGraphGeneration(1);
+
+    // The distance along a Hilbert curve through a 65536 x 65536 grid of the cell (x, y)
+    // The curve visits every cell of each quadrant before moving on to the next, at every scale, and each step is to a
+    //      neighbouring cell, so cells close together on the curve are close together on the map (the Z order of a Morton
+    //      curve makes big jumps between quadrants instead)
+uint64_t hilbertIndex(uint32_t x, uint32_t y)
 {
-    return std::hash<string>()(g.latitudeText + g.longitudeText);
+    const uint32_t n = 1u << 16;
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+            // Rotate the quadrant so the curve within it starts and ends at the right corners
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            swap(x, y);
+        }
+    }
+    return d;
+}
+
+    // 64-bit FNV-1a hash, used as the snapshot checksum
+uint64_t fnv1a(const char* data, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
 }
 
 class StreetMapImpl
@@ -21,55 +268,197 @@ public:
     StreetMapImpl();
     ~StreetMapImpl();
     bool load(string mapFile);
+    bool saveSnapshot(string snapshotFile) const;
+    bool loadSnapshot(string snapshotFile);
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    bool getSegmentsThatStartWith(const GeoCoord& gc, SegmentRange& segs) const;
+    const StreetGraph& getStreetGraph() const;
+    void buildContractionHierarchy();
+    bool saveContractionHierarchy(string hierarchyFile) const;
+    bool loadContractionHierarchy(string hierarchyFile);
+    const ContractionHierarchy* getContractionHierarchy() const;
+    void buildLandmarks(int count, LandmarkSelection selection);
+    const SpatialIndex& getSpatialIndex() const;
+    void setNodeOrder(NodeOrder order);
     
 private:
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> streetMapData;
+    StreetGraph m_graph;
+    NodeOrder m_nodeOrder;
+    
+        // Rebuilt whenever the graph changes
+    SpatialIndex m_spatialIndex;
+    
+        // Only ever describes the current m_graph; dropped whenever the graph changes
+    unique_ptr<ContractionHierarchy> m_hierarchy;
+    
+        // The read-only mapping of the snapshot file the graph is attached to, if any
+    void* m_mapping;
+    size_t m_mappingSize;
+    
+        // Edges are collected here while the map file is read, then packed into m_graph
+    vector<NodeId> m_rawSources;
+    vector<NodeId> m_rawTargets;
+    vector<StreetNameId> m_rawStreets;
+    vector<double> m_rawLengths;
     
         // Auxiliary Functions
-    void addStreetSeg(const GeoCoord& gc, const StreetSegment& ss);
-    void getGeoCoordData(istream& is, string& startLat, string& startLon, string& endLat, string& endLon);
+    bool findStreetRecords(const char* data, size_t size, vector<StreetRecord>& records);
+    NodeId addNode(const ParsedCoord& pc);
+    StreetNameId addStreetName(const string& name);
+    void addStreetSeg(NodeId start, NodeId end, StreetNameId street, double length);
+    void clearRawEdges();
+    void renumberNodes();
+    void buildAdjacency();
+    void buildComponents();
+    void buildNodeIndex();
+    template<typename T> void attachSection(GraphArray<T>& array, const SnapshotSection& section);
 };
 
-StreetMapImpl::StreetMapImpl()
+StreetMapImpl::StreetMapImpl() : m_nodeOrder(HILBERT_ORDER), m_mapping(nullptr), m_mappingSize(0)
 {}
 
 StreetMapImpl::~StreetMapImpl()
-{}
+{
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
 
 bool StreetMapImpl::load(string mapFile)
 {
-    // Scan each coord line
-    //      Take first GeoCoord and push_back the exact line (the StreetSegment Sn) to the vector associated with it
-    //      Take the second GeoCoord and push_back the line with the coords reversed (the StreetSegment S(n-1)) to the vector associated with it
-    ifstream mapData(mapFile);
-    if (!mapData) {
+    // We map the file into memory and work on it in place, instead of reading it line by line into strings
+    //      First find where each street's record (name line, count line, segment lines) is; this is just a scan for newlines
+    //      Then split the streets between worker threads, each of which parses its share of the segment lines
+    //          into fixed point coordinates
+    //      Finally merge the workers' segments in file order, giving each GeoCoord we haven't seen before the next NodeId,
+    //          and recording the edge start -> end (the StreetSegment Sn) and the edge end -> start (the StreetSegment S(n-1))
+    // Once everything is merged, renumber the nodes along a Hilbert curve (unless asked not to), then pack the edges into
+    //      the compressed sparse row arrays of m_graph
+    int fd = open(mapFile.c_str(), O_RDONLY);
+    if (fd < 0) {
         cerr << "Cannot open Map Data file!" << endl;
         return false;
     }
-
     
-    while (mapData.peek() != EOF) {
-            // We know a street name always comes first
-        string streetName;
-        getline(mapData, streetName);
-        
-            // Then the number of street segments comes next
-        int nSegs;
-        mapData >> nSegs;
-        mapData.ignore(10'000, '\n');
-        
-            // Add the GeoCoord associations
-            // We'll go line by line, adding Sn and Rev(Sn) to the hashmap
-        for (int n = 1; n <= nSegs; n++) {
-            string startLat, startLon, endLat, endLon;
-            getGeoCoordData(mapData, startLat, startLon, endLat, endLon);
-            
-                // Add Sn
-            addStreetSeg(GeoCoord(startLat, startLon), StreetSegment(GeoCoord(startLat, startLon), GeoCoord(endLat, endLon), streetName));
-                // Add Rev(Sn)
-            addStreetSeg(GeoCoord(endLat, endLon), StreetSegment(GeoCoord(endLat, endLon), GeoCoord(startLat, startLon), streetName));
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        cerr << "Cannot open Map Data file!" << endl;
+        close(fd);
+        return false;
+    }
+    
+    size_t size = info.st_size;
+    const char* data = nullptr;
+    void* mapping = nullptr;
+    if (size != 0) {
+        mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            cerr << "Cannot map Map Data file!" << endl;
+            close(fd);
+            return false;
         }
+        data = static_cast<const char*>(mapping);
+    }
+    close(fd);
+    
+        // The new graph is built in an empty one, with the old one kept aside until we know the file is good
+    StreetGraph previous;
+    m_graph.swap(previous);
+    clearRawEdges();
+    
+    vector<StreetRecord> records;
+    bool parsed = findStreetRecords(data, size, records);
+    
+        // Share the streets out so that each worker gets about the same number of segment lines
+    size_t totalSegs = 0;
+    for (const StreetRecord& record : records) {
+        totalSegs += record.nSegs;
+    }
+    
+    size_t nWorkers = max(1u, thread::hardware_concurrency());
+    nWorkers = min(nWorkers, records.size() / 64 + 1);     // not worth a thread for fewer streets than this
+    
+    vector<size_t> firstRecord(nWorkers + 1, records.size());
+    firstRecord[0] = 0;
+    size_t segsSoFar = 0;
+    size_t worker = 1;
+    for (size_t r = 0; r < records.size() && worker < nWorkers; r++) {
+        if (segsSoFar >= totalSegs * worker / nWorkers) {
+            firstRecord[worker++] = r;
+        }
+        segsSoFar += records[r].nSegs;
+    }
+    
+    vector<vector<ParsedSegment>> fragments(nWorkers);
+    vector<char> workerParsed(nWorkers, true);
+    auto parseShare = [&] (size_t w) {
+        workerParsed[w] = parseStreetRecords(records.data() + firstRecord[w], firstRecord[w + 1] - firstRecord[w],
+                                             static_cast<StreetNameId>(firstRecord[w]), fragments[w]);
+    };
+    
+    if (parsed) {
+        vector<thread> workers;
+        for (size_t w = 1; w < nWorkers; w++) {
+            workers.emplace_back(parseShare, w);
+        }
+        parseShare(0);      // this thread takes the first share
+        for (thread& t : workers) {
+            t.join();
+        }
+        for (char ok : workerParsed) {
+            parsed = parsed && ok;
+        }
+    }
+    
+        // Merge the fragments in order, so NodeIds (before any renumbering) and each node's segments come out in file order
+    if (parsed) {
+        m_graph.m_nodeIndex.reserve(totalSegs);
+        for (const vector<ParsedSegment>& fragment : fragments) {
+            for (const ParsedSegment& seg : fragment) {
+                NodeId start = addNode(seg.start);
+                NodeId end = addNode(seg.end);
+                if (start == NO_NODE || end == NO_NODE) {
+                    parsed = false;
+                    break;
+                }
+                
+                    // Add Sn
+                addStreetSeg(start, end, seg.street, seg.length);
+                    // Add Rev(Sn)
+                addStreetSeg(end, start, seg.street, seg.length);
+            }
+            if (!parsed) {
+                break;
+            }
+        }
+    }
+    
+        // Everything we need has been copied out of the file by now
+    if (mapping != nullptr) {
+        munmap(mapping, size);
+    }
+    if (!parsed) {
+        cerr << "Map Data file is badly formatted!" << endl;
+        m_graph.swap(previous);
+        clearRawEdges();
+        return false;
+    }
+    
+    if (m_nodeOrder == HILBERT_ORDER) {
+        renumberNodes();
+    }
+    buildAdjacency();
+    buildComponents();
+    m_graph.computeDistanceBound();
+    m_spatialIndex.build(m_graph);
+    m_graph.m_generation = nextGraphGeneration++;
+    m_hierarchy.reset();
+    
+        // Nothing points into a snapshot we were attached to any more
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
     }
     
     return true;    // loading successful
@@ -77,40 +466,800 @@ bool StreetMapImpl::load(string mapFile)
 
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    const vector<StreetSegment>* segsOfGc = streetMapData.find(gc);
+    SegmentRange range;
+    
+    if (!getSegmentsThatStartWith(gc, range)) {
+        return false;   // gc not found in the graph
+    }
+    
+    segs.clear();
+    for (SegmentRef seg : range) {
+        segs.push_back(seg.toStreetSegment());
+    }
+    return true;
+}
+
+bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, SegmentRange& segs) const
+{
+    NodeId node = m_graph.findNode(gc);
     
-    if (segsOfGc == nullptr) {
-        return false;   // gc not found in streetMapData
+    if (node == NO_NODE) {
+        return false;   // gc not found in the graph
     }
     
-    segs = *segsOfGc;
+    segs = m_graph.segmentsFrom(node);
     return true;
 }
 
+const StreetGraph& StreetMapImpl::getStreetGraph() const
+{
+    return m_graph;
+}
+
+    // Writes the loaded graph out as a snapshot file that loadSnapshot() can map back in
+bool StreetMapImpl::saveSnapshot(string snapshotFile) const
+{
+    struct Array { const void* data; uint32_t elementSize; uint64_t count; };
+    Array arrays[SECTION_COUNT] = {
+        { m_graph.m_latitudes.data(), sizeof(double), m_graph.m_latitudes.size() },
+        { m_graph.m_longitudes.data(), sizeof(double), m_graph.m_longitudes.size() },
+        { m_graph.m_coordTextOffsets.data(), sizeof(uint32_t), m_graph.m_coordTextOffsets.size() },
+        { m_graph.m_coordText.data(), sizeof(char), m_graph.m_coordText.size() },
+        { m_graph.m_offsets.data(), sizeof(EdgeId), m_graph.m_offsets.size() },
+        { m_graph.m_sources.data(), sizeof(NodeId), m_graph.m_sources.size() },
+        { m_graph.m_targets.data(), sizeof(NodeId), m_graph.m_targets.size() },
+        { m_graph.m_edgeLengths.data(), sizeof(double), m_graph.m_edgeLengths.size() },
+        { m_graph.m_edgeStreets.data(), sizeof(StreetNameId), m_graph.m_edgeStreets.size() },
+        { m_graph.m_streetNameOffsets.data(), sizeof(uint32_t), m_graph.m_streetNameOffsets.size() },
+        { m_graph.m_streetNames.data(), sizeof(char), m_graph.m_streetNames.size() },
+        { m_graph.m_inOffsets.data(), sizeof(uint32_t), m_graph.m_inOffsets.size() },
+        { m_graph.m_inEdges.data(), sizeof(EdgeId), m_graph.m_inEdges.size() },
+        { m_graph.m_landmarks.data(), sizeof(NodeId), m_graph.m_landmarks.size() },
+        { m_graph.m_landmarkFrom.data(), sizeof(double), m_graph.m_landmarkFrom.size() },
+        { m_graph.m_landmarkTo.data(), sizeof(double), m_graph.m_landmarkTo.size() },
+        { m_graph.m_weakComponents.data(), sizeof(ComponentId), m_graph.m_weakComponents.size() },
+        { m_graph.m_strongComponents.data(), sizeof(ComponentId), m_graph.m_strongComponents.size() },
+        { m_graph.m_weakComponentSizes.data(), sizeof(uint32_t), m_graph.m_weakComponentSizes.size() },
+        { m_graph.m_strongComponentSizes.data(), sizeof(uint32_t), m_graph.m_strongComponentSizes.size() },
+    };
+    
+        // Lay the sections out one after another, each starting on an 8 byte boundary
+    SnapshotSection sections[SECTION_COUNT];
+    uint64_t offset = sizeof(SnapshotHeader) + sizeof(sections);
+    for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+        sections[i].id = i;
+        sections[i].elementSize = arrays[i].elementSize;
+        sections[i].offset = offset;
+        sections[i].count = arrays[i].count;
+        offset = (offset + arrays[i].elementSize * arrays[i].count + 7) / 8 * 8;
+    }
+    
+    string image(offset, '\0');
+    memcpy(&image[sizeof(SnapshotHeader)], sections, sizeof(sections));
+    for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+        if (arrays[i].count != 0) {
+            memcpy(&image[sections[i].offset], arrays[i].data, arrays[i].elementSize * arrays[i].count);
+        }
+    }
+    
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.sectionCount = SECTION_COUNT;
+    header.fileSize = image.size();
+    header.checksum = fnv1a(image.data() + sizeof(SnapshotHeader), image.size() - sizeof(SnapshotHeader));
+    memcpy(&image[0], &header, sizeof(header));
+    
+        // Processes may have the old snapshot mapped, and truncating it under them would take their pages away, so the new
+        //      one is written alongside it and renamed over it; whoever has the old one mapped keeps the old file
+    string tempFile = snapshotFile + ".tmp";
+    ofstream out(tempFile, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "Cannot open snapshot file for writing!" << endl;
+        return false;
+    }
+    out.write(image.data(), image.size());
+    out.close();
+    if (!out || rename(tempFile.c_str(), snapshotFile.c_str()) != 0) {
+        cerr << "Cannot write snapshot file!" << endl;
+        remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+    // Maps a snapshot file written by saveSnapshot() read-only, and points the graph's arrays into it
+    // Nothing is parsed or copied, and several processes loading the same snapshot share one physical copy of the map;
+    //      what isn't in the file is worked out again each time: the GeoCoord lookup index, the distance bound's scales
+    //      (a pass over every node) and the SpatialIndex (a pass over every node and edge)
+bool StreetMapImpl::loadSnapshot(string snapshotFile)
+{
+    int fd = open(snapshotFile.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot open snapshot file!" << endl;
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader)) {
+        cerr << "Snapshot file is truncated!" << endl;
+        close(fd);
+        return false;
+    }
+    
+    size_t size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);      // the mapping stays valid after the descriptor is closed
+    if (mapping == MAP_FAILED) {
+        cerr << "Cannot map snapshot file!" << endl;
+        return false;
+    }
+    
+        // Check the header, then that the section table and every section lie inside the file, then the checksum
+    const char* base = static_cast<const char*>(mapping);
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    
+    bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0
+              && header.version == SNAPSHOT_VERSION
+              && header.sectionCount == SECTION_COUNT
+              && header.fileSize == size
+              && size >= sizeof(SnapshotHeader) + SECTION_COUNT * sizeof(SnapshotSection);
+    
+    const SnapshotSection* sections = reinterpret_cast<const SnapshotSection*>(base + sizeof(SnapshotHeader));
+    for (uint32_t i = 0; valid && i < SECTION_COUNT; i++) {
+        valid = sections[i].id == i && sections[i].elementSize == SECTION_ELEMENT_SIZES[i] && sections[i].offset % 8 == 0 && sections[i].offset <= size
+             && sections[i].count <= (size - sections[i].offset) / sections[i].elementSize;
+    }
+    
+    if (valid) {
+            // Landmark distances are looked up as node * landmarks + i, so the tables have to be exactly that big
+        uint64_t tableSize = sections[SECTION_LATITUDES].count * sections[SECTION_LANDMARKS].count;
+        valid = sections[SECTION_LANDMARK_FROM].count == tableSize && sections[SECTION_LANDMARK_TO].count == tableSize;
+    }
+    if (valid) {
+            // And every node has a component of each kind
+        valid = sections[SECTION_WEAK_COMPONENTS].count == sections[SECTION_LATITUDES].count
+             && sections[SECTION_STRONG_COMPONENTS].count == sections[SECTION_LATITUDES].count;
+    }
+    if (valid) {
+        valid = fnv1a(base + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) == header.checksum;
+    }
+    
+    if (!valid) {
+        cerr << "Snapshot file is corrupt or from a different version!" << endl;
+        munmap(mapping, size);
+        return false;
+    }
+    
+        // Replace whatever graph we had with the mapped one, starting from an empty graph so that nothing owned by the
+        //      old one (the leading 0s of its offsets included) is left half cleared
+    StreetGraph previous;
+    m_graph.swap(previous);
+    clearRawEdges();
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_mappingSize);
+    }
+    m_mapping = mapping;
+    m_mappingSize = size;
+    
+    attachSection(m_graph.m_latitudes, sections[SECTION_LATITUDES]);
+    attachSection(m_graph.m_longitudes, sections[SECTION_LONGITUDES]);
+    attachSection(m_graph.m_coordTextOffsets, sections[SECTION_COORD_TEXT_OFFSETS]);
+    attachSection(m_graph.m_coordText, sections[SECTION_COORD_TEXT]);
+    attachSection(m_graph.m_offsets, sections[SECTION_OFFSETS]);
+    attachSection(m_graph.m_sources, sections[SECTION_SOURCES]);
+    attachSection(m_graph.m_targets, sections[SECTION_TARGETS]);
+    attachSection(m_graph.m_edgeLengths, sections[SECTION_EDGE_LENGTHS]);
+    attachSection(m_graph.m_edgeStreets, sections[SECTION_EDGE_STREETS]);
+    attachSection(m_graph.m_streetNameOffsets, sections[SECTION_STREET_NAME_OFFSETS]);
+    attachSection(m_graph.m_streetNames, sections[SECTION_STREET_NAMES]);
+    attachSection(m_graph.m_inOffsets, sections[SECTION_IN_OFFSETS]);
+    attachSection(m_graph.m_inEdges, sections[SECTION_IN_EDGES]);
+    attachSection(m_graph.m_landmarks, sections[SECTION_LANDMARKS]);
+    attachSection(m_graph.m_landmarkFrom, sections[SECTION_LANDMARK_FROM]);
+    attachSection(m_graph.m_landmarkTo, sections[SECTION_LANDMARK_TO]);
+    attachSection(m_graph.m_weakComponents, sections[SECTION_WEAK_COMPONENTS]);
+    attachSection(m_graph.m_strongComponents, sections[SECTION_STRONG_COMPONENTS]);
+    attachSection(m_graph.m_weakComponentSizes, sections[SECTION_WEAK_COMPONENT_SIZES]);
+    attachSection(m_graph.m_strongComponentSizes, sections[SECTION_STRONG_COMPONENT_SIZES]);
+    
+    buildNodeIndex();
+    m_graph.computeDistanceBound();
+    m_spatialIndex.build(m_graph);
+    m_graph.m_generation = nextGraphGeneration++;
+    m_hierarchy.reset();
+    return true;
+}
+
+    // Preprocessing takes a while (seconds on mapdata.txt), so it's only done when asked for, and saved for next time
+void StreetMapImpl::buildContractionHierarchy()
+{
+    m_hierarchy.reset(new ContractionHierarchy);
+    m_hierarchy->build(m_graph);
+}
+
+bool StreetMapImpl::saveContractionHierarchy(string hierarchyFile) const
+{
+    if (m_hierarchy == nullptr) {
+        cerr << "No hierarchy has been built for this map!" << endl;
+        return false;
+    }
+    return m_hierarchy->save(hierarchyFile);
+}
+
+bool StreetMapImpl::loadContractionHierarchy(string hierarchyFile)
+{
+    unique_ptr<ContractionHierarchy> hierarchy(new ContractionHierarchy);
+    if (!hierarchy->load(hierarchyFile, m_graph)) {
+        return false;
+    }
+    m_hierarchy = move(hierarchy);
+    return true;
+}
+
+const ContractionHierarchy* StreetMapImpl::getContractionHierarchy() const
+{
+    return m_hierarchy.get();
+}
+
+    // Two Dijkstra searches over the whole map per landmark, so this is also only done when asked for
+    // If the graph is attached to a snapshot, its other arrays stay there, and only the landmarks are owned
+void StreetMapImpl::buildLandmarks(int count, LandmarkSelection selection)
+{
+    vector<NodeId> landmarks;
+    vector<double> fromLandmarks;
+    vector<double> toLandmarks;
+    ::buildLandmarks(m_graph, count, selection, landmarks, fromLandmarks, toLandmarks);
+    
+    m_graph.m_landmarks.owned().swap(landmarks);
+    m_graph.m_landmarkFrom.owned().swap(fromLandmarks);
+    m_graph.m_landmarkTo.owned().swap(toLandmarks);
+    m_graph.m_landmarks.seal();
+    m_graph.m_landmarkFrom.seal();
+    m_graph.m_landmarkTo.seal();
+}
+
+const SpatialIndex& StreetMapImpl::getSpatialIndex() const
+{
+    return m_spatialIndex;
+}
+
+void StreetMapImpl::setNodeOrder(NodeOrder order)
+{
+    m_nodeOrder = order;
+}
+
 /////////////////////////////////////////////////
 // Auxiliary Functions
 /////////////////////////////////////////////////
-    // Retrieves the startLat, startLon, endLat, and endLon functions from the next line of a passed in istream
-void StreetMapImpl::getGeoCoordData(istream& is, string& startLat, string& startLon, string& endLat, string& endLon) {
-    string geoCoordLine;
-    getline(is, geoCoordLine);
-    istringstream iss(geoCoordLine);
+    // Finds the record of each street in the passed in map file data, and stores the street names
+    // Returns false if the data ends in the middle of a record
+bool StreetMapImpl::findStreetRecords(const char* data, size_t size, vector<StreetRecord>& records) {
+    const char* p = data;
+    const char* end = data + size;
+    
+    while (p != end) {
+            // Stop at trailing blank lines
+        const char* q = p;
+        while (q != end && isspace(static_cast<unsigned char>(*q))) {
+            q++;
+        }
+        if (q == end) {
+            break;
+        }
+        
+            // We know a street name always comes first
+        const char* nameEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (nameEnd == nullptr) {
+            return false;
+        }
+        string streetName(p, nameEnd - p);
+        if (!streetName.empty() && streetName.back() == '\r') {
+            streetName.pop_back();
+        }
+        p = nameEnd + 1;
+        
+            // Then the number of street segments comes next
+        while (p != end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        int nSegs = 0;
+        const char* digitsStart = p;
+        while (p != end && *p >= '0' && *p <= '9') {
+            nSegs = nSegs * 10 + (*p - '0');
+            p++;
+        }
+        if (p == digitsStart) {
+            return false;
+        }
+        p = static_cast<const char*>(memchr(p, '\n', end - p));
+        p = (p == nullptr) ? end : p + 1;
+        
+            // Then one line per segment, which the worker threads will parse
+        StreetRecord record;
+        record.segsBegin = p;
+        record.nSegs = nSegs;
+        for (int n = 0; n < nSegs; n++) {
+            if (p == end) {
+                return false;
+            }
+            p = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = (p == nullptr) ? end : p + 1;
+        }
+        record.segsEnd = p;
+        
+        records.push_back(record);
+        addStreetName(streetName);
+    }
+    return true;
+}
+
+    // Returns the NodeId of the passed in coordinate, giving it the next NodeId if we haven't seen it yet
+    // Nodes are told apart by their CoordKeys, so two coordinates that only differ past the 7th decimal place would be
+    //      one node, which findNode() could then only find by the first one's text; returns NO_NODE for the second,
+    //      rather than merging them
+NodeId StreetMapImpl::addNode(const ParsedCoord& pc) {
+    CoordKey key(pc.lat, pc.lon);
+    pair<NodeId*, bool> slot = m_graph.m_nodeIndex.try_emplace(key, static_cast<NodeId>(m_graph.m_latitudes.owned().size()));
+    
+    vector<char>& coordText = m_graph.m_coordText.owned();
+    vector<uint32_t>& coordTextOffsets = m_graph.m_coordTextOffsets.owned();
+    if (!slot.second) {
+            // The same key from different text is the same place if both texts are exact, as 34.05 and 34.0500000 are
+        NodeId node = *slot.first;
+        const char* latText = coordText.data() + coordTextOffsets[2 * node];
+        const char* lonText = coordText.data() + coordTextOffsets[2 * node + 1];
+        uint32_t latLength = coordTextOffsets[2 * node + 1] - coordTextOffsets[2 * node];
+        uint32_t lonLength = coordTextOffsets[2 * node + 2] - coordTextOffsets[2 * node + 1];
+        bool sameText = string_view(latText, latLength) == string_view(pc.latText, pc.latLength)
+                     && string_view(lonText, lonLength) == string_view(pc.lonText, pc.lonLength);
+        if (!sameText) {
+            CoordKey storedKey;
+            bool storedExact;
+            makeCoordKey(string_view(latText, latLength), string_view(lonText, lonLength), storedKey, storedExact);
+            if (!pc.exact || !storedExact) {
+                return NO_NODE;
+            }
+        }
+        return node;
+    }
+    
+    
+    NodeId node = *slot.first;
+    m_graph.m_latitudes.owned().push_back(pc.latDegrees);
+    m_graph.m_longitudes.owned().push_back(pc.lonDegrees);
+    coordText.insert(coordText.end(), pc.latText, pc.latText + pc.latLength);
+    coordTextOffsets.push_back(static_cast<uint32_t>(coordText.size()));
+    coordText.insert(coordText.end(), pc.lonText, pc.lonText + pc.lonLength);
+    coordTextOffsets.push_back(static_cast<uint32_t>(coordText.size()));
+    return node;
+}
+
+    // Stores a street name, returning the StreetNameId the edges of that street should refer to
+StreetNameId StreetMapImpl::addStreetName(const string& name) {
+    vector<char>& streetNames = m_graph.m_streetNames.owned();
+    vector<uint32_t>& streetNameOffsets = m_graph.m_streetNameOffsets.owned();
+    
+    StreetNameId street = static_cast<StreetNameId>(streetNameOffsets.size() - 1);
+    streetNames.insert(streetNames.end(), name.begin(), name.end());
+    streetNameOffsets.push_back(static_cast<uint32_t>(streetNames.size()));
+    return street;
+}
+
+    // Records the directed edge start -> end until buildAdjacency() packs it into the graph
+void StreetMapImpl::addStreetSeg(NodeId start, NodeId end, StreetNameId street, double length) {
+    m_rawSources.push_back(start);
+    m_rawTargets.push_back(end);
+    m_rawStreets.push_back(street);
+    m_rawLengths.push_back(length);
+}
+
+    // Frees the edges recorded by addStreetSeg()
+void StreetMapImpl::clearRawEdges() {
+    vector<NodeId>().swap(m_rawSources);
+    vector<NodeId>().swap(m_rawTargets);
+    vector<StreetNameId>().swap(m_rawStreets);
+    vector<double>().swap(m_rawLengths);
+}
+
+    // The map file lists its streets alphabetically, so in file order the GeoCoords of one intersection's neighbours are
+    //      scattered all over the node arrays, and so (once buildAdjacency() groups them by start node) are their edges
+    // Renumbering the nodes in the order a Hilbert curve over the map visits them puts nodes that are near each other
+    //      on the map near each other in memory, so a search's next node is usually in a cache line it has just used
+    // Has to run before buildAdjacency(), while the edges are still the raw lists; each node keeps its own edges in file order
+void StreetMapImpl::renumberNodes() {
+    vector<double>& latitudes = m_graph.m_latitudes.owned();
+    vector<double>& longitudes = m_graph.m_longitudes.owned();
+    size_t nNodes = latitudes.size();
+    if (nNodes == 0) {
+        return;
+    }
+    
+    double minLatitude = *min_element(latitudes.begin(), latitudes.end());
+    double maxLatitude = *max_element(latitudes.begin(), latitudes.end());
+    double minLongitude = *min_element(longitudes.begin(), longitudes.end());
+    double maxLongitude = *max_element(longitudes.begin(), longitudes.end());
+    double latitudeScale = (maxLatitude > minLatitude) ? 65535 / (maxLatitude - minLatitude) : 0;
+    double longitudeScale = (maxLongitude > minLongitude) ? 65535 / (maxLongitude - minLongitude) : 0;
+    
+        // Sort the nodes by their distance along the curve; nodes in the same cell keep their file order
+    vector<pair<uint64_t, NodeId>> curveOrder(nNodes);
+    for (NodeId n = 0; n < nNodes; n++) {
+        uint32_t x = static_cast<uint32_t>((longitudes[n] - minLongitude) * longitudeScale);
+        uint32_t y = static_cast<uint32_t>((latitudes[n] - minLatitude) * latitudeScale);
+        curveOrder[n] = make_pair(hilbertIndex(x, y), n);
+    }
+    sort(curveOrder.begin(), curveOrder.end());
+    
+        // Then lay every per node array out again in that order
+    vector<NodeId> newId(nNodes);
+    vector<double> newLatitudes(nNodes);
+    vector<double> newLongitudes(nNodes);
+    const vector<char>& coordText = m_graph.m_coordText.owned();
+    const vector<uint32_t>& coordTextOffsets = m_graph.m_coordTextOffsets.owned();
+    vector<char> newCoordText;
+    vector<uint32_t> newCoordTextOffsets(1, 0);
+    newCoordText.reserve(coordText.size());
+    newCoordTextOffsets.reserve(coordTextOffsets.size());
+    for (NodeId i = 0; i < nNodes; i++) {
+        NodeId old = curveOrder[i].second;
+        newId[old] = i;
+        newLatitudes[i] = latitudes[old];
+        newLongitudes[i] = longitudes[old];
+        newCoordText.insert(newCoordText.end(), coordText.begin() + coordTextOffsets[2 * old], coordText.begin() + coordTextOffsets[2 * old + 2]);
+        newCoordTextOffsets.push_back(newCoordTextOffsets.back() + (coordTextOffsets[2 * old + 1] - coordTextOffsets[2 * old]));
+        newCoordTextOffsets.push_back(static_cast<uint32_t>(newCoordText.size()));
+    }
+    latitudes.swap(newLatitudes);
+    longitudes.swap(newLongitudes);
+    m_graph.m_coordText.owned().swap(newCoordText);
+    m_graph.m_coordTextOffsets.owned().swap(newCoordTextOffsets);
+    
+    for (NodeId& source : m_rawSources) {
+        source = newId[source];
+    }
+    for (NodeId& target : m_rawTargets) {
+        target = newId[target];
+    }
+    
+        // The index has to find the nodes under their new numbers
+    m_graph.m_latitudes.seal();
+    m_graph.m_longitudes.seal();
+    m_graph.m_coordText.seal();
+    m_graph.m_coordTextOffsets.seal();
+    buildNodeIndex();
+}
+
+    // Packs the recorded edges into CSR form, grouping them by their start node, then publishes all the graph's arrays
+    // Edges keep the order they were read in, so each node's segments come out in file order
+void StreetMapImpl::buildAdjacency() {
+    size_t nNodes = m_graph.m_latitudes.owned().size();
+    size_t nEdges = m_rawSources.size();
+    
+        // Count the edges leaving each node, then turn the counts into offsets
+    vector<EdgeId>& offsets = m_graph.m_offsets.owned();
+    offsets.assign(nNodes + 1, 0);
+    for (NodeId source : m_rawSources) {
+        offsets[source + 1]++;
+    }
+    for (size_t n = 0; n < nNodes; n++) {
+        offsets[n + 1] += offsets[n];
+    }
+    
+        // Drop each edge into the next free slot of its start node
+    vector<EdgeId> nextSlot(offsets.begin(), offsets.end() - 1);
+    vector<NodeId>& sources = m_graph.m_sources.owned();
+    vector<NodeId>& targets = m_graph.m_targets.owned();
+    vector<StreetNameId>& edgeStreets = m_graph.m_edgeStreets.owned();
+    vector<double>& edgeLengths = m_graph.m_edgeLengths.owned();
+    sources.resize(nEdges);
+    targets.resize(nEdges);
+    edgeStreets.resize(nEdges);
+    edgeLengths.resize(nEdges);
+    
+    for (size_t i = 0; i < nEdges; i++) {
+        EdgeId e = nextSlot[m_rawSources[i]]++;
+        sources[e] = m_rawSources[i];
+        targets[e] = m_rawTargets[i];
+        edgeStreets[e] = m_rawStreets[i];
+        edgeLengths[e] = m_rawLengths[i];
+    }
+    
+        // Then the same again by end node, for searches that walk the graph backwards
+        //      Going through the edges in EdgeId order keeps each node's incoming edges in order too
+    vector<uint32_t>& inOffsets = m_graph.m_inOffsets.owned();
+    vector<EdgeId>& inEdges = m_graph.m_inEdges.owned();
+    inOffsets.assign(nNodes + 1, 0);
+    for (NodeId target : targets) {
+        inOffsets[target + 1]++;
+    }
+    for (size_t n = 0; n < nNodes; n++) {
+        inOffsets[n + 1] += inOffsets[n];
+    }
+    nextSlot.assign(inOffsets.begin(), inOffsets.end() - 1);
+    inEdges.resize(nEdges);
+    for (EdgeId e = 0; e < nEdges; e++) {
+        inEdges[nextSlot[targets[e]]++] = e;
+    }
+    
+        // We don't need the raw edges any more
+    clearRawEdges();
+    
+    m_graph.m_latitudes.seal();
+    m_graph.m_longitudes.seal();
+    m_graph.m_coordTextOffsets.seal();
+    m_graph.m_coordText.seal();
+    m_graph.m_offsets.seal();
+    m_graph.m_sources.seal();
+    m_graph.m_targets.seal();
+    m_graph.m_edgeLengths.seal();
+    m_graph.m_edgeStreets.seal();
+    m_graph.m_streetNameOffsets.seal();
+    m_graph.m_streetNames.seal();
+    m_graph.m_inOffsets.seal();
+    m_graph.m_inEdges.seal();
     
-    iss >> startLat >> startLon >> endLat >> endLon;
+        // A freshly loaded map has no landmarks until buildLandmarks() is called
+    vector<NodeId>().swap(m_graph.m_landmarks.owned());
+    vector<double>().swap(m_graph.m_landmarkFrom.owned());
+    vector<double>().swap(m_graph.m_landmarkTo.owned());
+    m_graph.m_landmarks.seal();
+    m_graph.m_landmarkFrom.seal();
+    m_graph.m_landmarkTo.seal();
 }
 
-    // Adds the passed in StreetSegment to the vector of StreetSegments associated with each GeoCoord in streetMapData
-void StreetMapImpl::addStreetSeg(const GeoCoord& gc, const StreetSegment& ss) {
-    vector<StreetSegment>* streetSegVector = streetMapData.find(gc);
+    // Labels every node with its weak and strong component, numbering each kind from 0 in order of their lowest NodeId
+    // Weak components are a breadth first search along edges both ways; strong components are Tarjan's algorithm,
+    //      with an explicit stack rather than recursion, since a long street would otherwise overflow the call stack
+    // Both are O(V + E), and take a few milliseconds on mapdata.txt
+void StreetMapImpl::buildComponents() {
+    size_t nNodes = m_graph.nodeCount();
+    const ComponentId NO_COMPONENT = UINT32_MAX;
     
-    if (streetSegVector == nullptr) {
-        vector<StreetSegment> additions;
-        additions.push_back(ss);
-        streetMapData.associate(gc, additions);
+    vector<ComponentId>& weak = m_graph.m_weakComponents.owned();
+    vector<uint32_t>& weakSizes = m_graph.m_weakComponentSizes.owned();
+    weak.assign(nNodes, NO_COMPONENT);
+    weakSizes.clear();
+    vector<NodeId> queue;
+    for (NodeId root = 0; root < nNodes; root++) {
+        if (weak[root] != NO_COMPONENT) {
+            continue;
+        }
+        ComponentId c = static_cast<ComponentId>(weakSizes.size());
+        weak[root] = c;
+        queue.assign(1, root);
+        for (size_t head = 0; head < queue.size(); head++) {
+            NodeId n = queue[head];
+            for (EdgeId e = m_graph.edgeBegin(n); e != m_graph.edgeEnd(n); e++) {
+                if (weak[m_graph.edgeTarget(e)] == NO_COMPONENT) {
+                    weak[m_graph.edgeTarget(e)] = c;
+                    queue.push_back(m_graph.edgeTarget(e));
+                }
+            }
+            for (uint32_t i = m_graph.inEdgeBegin(n); i != m_graph.inEdgeEnd(n); i++) {
+                NodeId source = m_graph.edgeSource(m_graph.inEdge(i));
+                if (weak[source] == NO_COMPONENT) {
+                    weak[source] = c;
+                    queue.push_back(source);
+                }
+            }
+        }
+        weakSizes.push_back(static_cast<uint32_t>(queue.size()));
+    }
+    
+        // Tarjan's: index is the order nodes are first visited in, and low the smallest index reachable from a node's
+        //      subtree that is still on the stack. A node whose low is its own index is the root of a strong component,
+        //      which is everything above it on the stack
+    vector<ComponentId>& strong = m_graph.m_strongComponents.owned();
+    vector<uint32_t>& strongSizes = m_graph.m_strongComponentSizes.owned();
+    strong.assign(nNodes, NO_COMPONENT);
+    strongSizes.clear();
+    vector<uint32_t> index(nNodes, UINT32_MAX);
+    vector<uint32_t> low(nNodes, 0);
+    vector<NodeId> stack;
+    vector<pair<NodeId, EdgeId>> path;       // the depth first search's path, and the next edge to follow from each node
+    uint32_t nextIndex = 0;
+    for (NodeId root = 0; root < nNodes; root++) {
+        if (index[root] != UINT32_MAX) {
+            continue;
+        }
+        index[root] = low[root] = nextIndex++;
+        stack.push_back(root);
+        path.push_back(make_pair(root, m_graph.edgeBegin(root)));
+        while (!path.empty()) {
+            NodeId n = path.back().first;
+            EdgeId& e = path.back().second;
+            if (e != m_graph.edgeEnd(n)) {
+                NodeId child = m_graph.edgeTarget(e++);
+                if (index[child] == UINT32_MAX) {
+                    index[child] = low[child] = nextIndex++;
+                    stack.push_back(child);
+                    path.push_back(make_pair(child, m_graph.edgeBegin(child)));
+                } else if (strong[child] == NO_COMPONENT) {
+                    low[n] = min(low[n], index[child]);     // child is still on the stack
+                }
+                continue;
+            }
+            
+                // Every edge out of n has been followed
+            path.pop_back();
+            if (!path.empty()) {
+                low[path.back().first] = min(low[path.back().first], low[n]);
+            }
+            if (low[n] == index[n]) {
+                ComponentId c = static_cast<ComponentId>(strongSizes.size());
+                uint32_t size = 0;
+                NodeId member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    strong[member] = c;
+                    size++;
+                } while (member != n);
+                strongSizes.push_back(size);
+            }
+        }
+    }
+    
+    m_graph.m_weakComponents.seal();
+    m_graph.m_weakComponentSizes.seal();
+    m_graph.m_strongComponents.seal();
+    m_graph.m_strongComponentSizes.seal();
+}
+
+    // Rebuilds the GeoCoord lookup index from the graph's nodes, for a graph that didn't come from load()
+void StreetMapImpl::buildNodeIndex() {
+    m_graph.m_nodeIndex.reset();
+    m_graph.m_nodeIndex.reserve(m_graph.nodeCount());
+    for (NodeId n = 0; n < m_graph.nodeCount(); n++) {
+        CoordKey key;
+        bool exact;
+        makeCoordKey(m_graph.coordText(2 * n), m_graph.coordText(2 * n + 1), key, exact);
+        m_graph.m_nodeIndex.associate(key, n);
+    }
+}
+
+    // Points one of the graph's arrays at its section of the mapped snapshot file
+template<typename T>
+void StreetMapImpl::attachSection(GraphArray<T>& array, const SnapshotSection& section) {
+    array.attach(reinterpret_cast<const T*>(static_cast<const char*>(m_mapping) + section.offset), section.count);
+}
+
+//******************** StreetGraph functions **********************************
+
+StreetGraph::StreetGraph() : m_generation(0), m_latitudeScale(0), m_longitudeScale(0)
+{
+        // An empty graph still has the leading 0 of each offsets array
+    m_coordTextOffsets.owned().push_back(0);
+    m_coordTextOffsets.seal();
+    m_offsets.owned().push_back(0);
+    m_offsets.seal();
+    m_inOffsets.owned().push_back(0);
+    m_inOffsets.seal();
+    m_streetNameOffsets.owned().push_back(0);
+    m_streetNameOffsets.seal();
+}
+
+    // This is where text-form GeoCoords turn into CoordKeys; no strings are built or hashed
+NodeId StreetGraph::findNode(const GeoCoord& gc) const
+{
+    CoordKey key;
+    bool exact;
+    if (!makeCoordKey(gc.latitudeText, gc.longitudeText, key, exact)) {
+        return NO_NODE;
+    }
+    
+    const NodeId* node = m_nodeIndex.find(key);
+    if (node == nullptr) {
+        return NO_NODE;
+    }
+    
+        // Text with more than 7 decimal places only matches a node with exactly the same text
+    if (!exact && (coordText(2 * *node) != gc.latitudeText || coordText(2 * *node + 1) != gc.longitudeText)) {
+        return NO_NODE;
+    }
+    return *node;
+}
+
+    // Rebuilds a GeoCoord from the stored text and degrees, without re-parsing the text
+GeoCoord StreetGraph::nodeCoord(NodeId n) const
+{
+    GeoCoord gc;
+    gc.latitudeText = coordText(2 * n);
+    gc.longitudeText = coordText(2 * n + 1);
+    gc.latitude = m_latitudes[n];
+    gc.longitude = m_longitudes[n];
+    return gc;
+}
+
+StreetSegment StreetGraph::segment(EdgeId e) const
+{
+    return StreetSegment(nodeCoord(m_sources[e]), nodeCoord(m_targets[e]), string(streetName(m_edgeStreets[e])));
+}
+
+    // Projects each degree of longitude as cos(phi) degrees of latitude, with phi the latitude farthest from the equator of
+    //      any node, so that east-west distances are never stretched; then shrinks both axes by the most that replacing
+    //      the haversine's sines with their arguments can gain. With delta the largest difference in latitude or longitude
+    //      between two nodes (in radians), sin(delta / 2) >= (delta / 2)(1 - delta^2 / 24), so shrinking by delta^2 / 24
+    //      (plus a little for rounding) leaves the projected distance no longer than the haversine one
+    // The margin is about 1e-5 for a city-sized map, so the bound is as tight as the haversine for routing purposes
+void StreetGraph::computeDistanceBound()
+{
+    if (nodeCount() == 0) {
+        m_latitudeScale = m_longitudeScale = 0;
         return;
     }
+    double minLatitude = m_latitudes[0], maxLatitude = m_latitudes[0];
+    double minLongitude = m_longitudes[0], maxLongitude = m_longitudes[0];
+    for (NodeId n = 1; n < nodeCount(); n++) {
+        minLatitude = min(minLatitude, m_latitudes[n]);
+        maxLatitude = max(maxLatitude, m_latitudes[n]);
+        minLongitude = min(minLongitude, m_longitudes[n]);
+        maxLongitude = max(maxLongitude, m_longitudes[n]);
+    }
     
-    streetSegVector->push_back(ss);
+    const double earthRadiusMiles = 6371.0 / 1.609344;
+    double delta = deg2rad(max(maxLatitude - minLatitude, maxLongitude - minLongitude));
+    double margin = 1 - delta * delta / 24 - 1e-9;
+    m_latitudeScale = deg2rad(1) * earthRadiusMiles * margin;
+    m_longitudeScale = m_latitudeScale * cos(deg2rad(max(abs(minLatitude), abs(maxLatitude))));
+}
+
+    // Exchanges everything with other; StreetMapImpl builds a new graph in an empty one and swaps it in, so that
+    //      nothing is left over from the graph before it, and so that the StreetGraph everyone points to stays put
+void StreetGraph::swap(StreetGraph& other)
+{
+    m_latitudes.swap(other.m_latitudes);
+    m_longitudes.swap(other.m_longitudes);
+    m_coordTextOffsets.swap(other.m_coordTextOffsets);
+    m_coordText.swap(other.m_coordText);
+    m_offsets.swap(other.m_offsets);
+    m_sources.swap(other.m_sources);
+    m_targets.swap(other.m_targets);
+    m_edgeLengths.swap(other.m_edgeLengths);
+    m_edgeStreets.swap(other.m_edgeStreets);
+    m_inOffsets.swap(other.m_inOffsets);
+    m_inEdges.swap(other.m_inEdges);
+    m_landmarks.swap(other.m_landmarks);
+    m_landmarkFrom.swap(other.m_landmarkFrom);
+    m_landmarkTo.swap(other.m_landmarkTo);
+    m_weakComponents.swap(other.m_weakComponents);
+    m_strongComponents.swap(other.m_strongComponents);
+    m_weakComponentSizes.swap(other.m_weakComponentSizes);
+    m_strongComponentSizes.swap(other.m_strongComponentSizes);
+    m_streetNameOffsets.swap(other.m_streetNameOffsets);
+    m_streetNames.swap(other.m_streetNames);
+    m_nodeIndex.swap(other.m_nodeIndex);
+    std::swap(m_generation, other.m_generation);
+    std::swap(m_latitudeScale, other.m_latitudeScale);
+    std::swap(m_longitudeScale, other.m_longitudeScale);
+}
+
+ComponentStats StreetGraph::componentStats() const
+{
+    ComponentStats stats;
+    stats.weakComponents = weakComponentCount();
+    stats.strongComponents = strongComponentCount();
+    for (ComponentId c = 0; c < weakComponentCount(); c++) {
+        stats.largestWeakComponent = max(stats.largestWeakComponent, weakComponentSize(c));
+    }
+    for (ComponentId c = 0; c < strongComponentCount(); c++) {
+        stats.largestStrongComponent = max(stats.largestStrongComponent, strongComponentSize(c));
+        stats.isolatedNodes += strongComponentSize(c) == 1;
+    }
+    return stats;
+}
+
+size_t StreetGraph::memoryUsage() const
+{
+    return m_latitudes.ownedBytes() + m_longitudes.ownedBytes() + m_coordTextOffsets.ownedBytes() + m_coordText.ownedBytes()
+         + m_offsets.ownedBytes() + m_sources.ownedBytes() + m_targets.ownedBytes() + m_edgeLengths.ownedBytes()
+         + m_edgeStreets.ownedBytes() + m_streetNameOffsets.ownedBytes() + m_streetNames.ownedBytes()
+         + m_inOffsets.ownedBytes() + m_inEdges.ownedBytes()
+         + m_landmarks.ownedBytes() + m_landmarkFrom.ownedBytes() + m_landmarkTo.ownedBytes()
+         + m_weakComponents.ownedBytes() + m_strongComponents.ownedBytes()
+         + m_weakComponentSizes.ownedBytes() + m_strongComponentSizes.ownedBytes();
 }
 
 //******************** StreetMap functions ************************************
@@ -133,7 +1282,62 @@ bool StreetMap::load(string mapFile)
     return m_impl->load(mapFile);
 }
 
+bool StreetMap::saveSnapshot(string snapshotFile) const
+{
+    return m_impl->saveSnapshot(snapshotFile);
+}
+
+bool StreetMap::loadSnapshot(string snapshotFile)
+{
+    return m_impl->loadSnapshot(snapshotFile);
+}
+
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
+
+bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, SegmentRange& segs) const
+{
+   return m_impl->getSegmentsThatStartWith(gc, segs);
+}
+
+const StreetGraph& StreetMap::getStreetGraph() const
+{
+    return m_impl->getStreetGraph();
+}
+
+void StreetMap::buildContractionHierarchy()
+{
+    m_impl->buildContractionHierarchy();
+}
+
+bool StreetMap::saveContractionHierarchy(string hierarchyFile) const
+{
+    return m_impl->saveContractionHierarchy(hierarchyFile);
+}
+
+bool StreetMap::loadContractionHierarchy(string hierarchyFile)
+{
+    return m_impl->loadContractionHierarchy(hierarchyFile);
+}
+
+const ContractionHierarchy* StreetMap::getContractionHierarchy() const
+{
+    return m_impl->getContractionHierarchy();
+}
+
+void StreetMap::buildLandmarks(int count, LandmarkSelection selection)
+{
+    m_impl->buildLandmarks(count, selection);
+}
+
+void StreetMap::setNodeOrder(NodeOrder order)
+{
+    m_impl->setNodeOrder(order);
+}
+
+const SpatialIndex& StreetMap::getSpatialIndex() const
+{
+    return m_impl->getSpatialIndex();
+}
@@ -0,0 +1,329 @@
+#include "TimeWindowImprover.h"
+#include "TourImprover.h"
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+    // A move has to improve the tour's score by more than this much of it, so rounding can't have two moves undo each other
+    //      forever; with time warp in it, a score runs to hundreds of thousands
+const double MIN_GAIN = 1e-12;
+    // How much a minute of waiting between two stops counts against them being neighbours, next to a minute of time warp
+const double WAIT_WEIGHT = 0.2;
+
+TimeWindowImprover::TimeWindowImprover(const double* distances, size_t count, double minutesPerMile, double serviceMinutes,
+                                       const double* earliest, const double* latest)
+ : m_distances(distances), m_count(count), m_minutesPerMile(minutesPerMile), m_serviceMinutes(serviceMinutes),
+   m_earliest(earliest), m_latest(latest), m_neighbourCount(min(NEIGHBOURS, count == 0 ? 0 : count - 1)), m_span(min(MAX_SPAN, count))
+{
+    buildNeighbours();
+}
+
+TimeWindowCost TimeWindowImprover::improve(vector<uint32_t>& tour, double maxMilliseconds, size_t maxIterations)
+{
+    auto start = chrono::steady_clock::now();
+    m_stats = TimeWindowSearchStats();
+        // With two locations or fewer, there is only one order
+    if (m_count < 3) {
+        return evaluate(tour);
+    }
+
+    m_tour = tour;
+    m_position.resize(m_count);
+    for (size_t i = 0; i < m_count; i++) {
+        m_position[m_tour[i]] = static_cast<uint32_t>(i);
+    }
+    m_prefix.resize(m_count);
+    m_suffix.resize(m_count + 1);
+    m_forward.resize(m_count * m_span);
+    m_backward.resize(m_count * m_span);
+    updateSegments(0, m_count - 1);
+    m_active.assign(m_tour.begin() + 1, m_tour.end());
+    m_queued.assign(m_count, true);
+
+    size_t head = 0;
+    while (head < m_active.size() && m_stats.iterations < maxIterations) {
+        if (m_stats.iterations % 16 == 0 && maxMilliseconds != numeric_limits<double>::infinity()
+            && chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= maxMilliseconds) {
+            break;
+        }
+        uint32_t a = m_active[head++];
+        m_queued[a] = false;
+        m_stats.iterations++;
+        double current = scoreOf(m_suffix[0]);
+        if (tryTwoOpt(a, current) || tryOrOpt(a, current) || trySwap(a, current)) {
+            activate(a);        // there may be more to gain around a
+        }
+
+            // Drop the stops already looked at once they're most of the queue
+        if (head > m_count && 2 * head > m_active.size()) {
+            m_active.erase(m_active.begin(), m_active.begin() + head);
+            head = 0;
+        }
+    }
+
+    tour = m_tour;
+    m_stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return evaluate(tour);
+}
+
+TimeWindowCost TimeWindowImprover::evaluate(const vector<uint32_t>& tour) const
+{
+    TimeWindowCost cost;
+    if (tour.empty()) {
+        return cost;
+    }
+    Segment whole = single(tour[0]);
+    for (size_t i = 1; i < tour.size(); i++) {
+        whole = join(whole, single(tour[i]));
+    }
+    whole = join(whole, depotReturn());
+    cost.miles = whole.miles;
+    cost.timeWarp = whole.timeWarp;
+    return cost;
+}
+
+size_t TimeWindowImprover::schedule(const vector<uint32_t>& tour, vector<double>& arrivals) const
+{
+    arrivals.assign(tour.size(), 0);
+    size_t late = 0;
+    double time = 0;
+    for (size_t i = 1; i < tour.size(); i++) {
+        uint32_t location = tour[i];
+        time += distance(tour[i - 1], location) * m_minutesPerMile;
+        arrivals[i] = time;
+        if (time > m_latest[location]) {
+            late++;
+        }
+        time = max(time, m_earliest[location]) + m_serviceMinutes;
+    }
+    return late;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // The Segment of just location: its delivery, which can start any time in its window
+    // The depot's is leaving it, at time 0
+TimeWindowImprover::Segment TimeWindowImprover::single(uint32_t location) const {
+    if (location == 0) {
+        return { 0, 0, 0, 0, 0, 0, 0 };
+    }
+    return { location, location, 0, m_serviceMinutes, 0, m_earliest[location], m_latest[location] };
+}
+
+    // The Segment of getting back to the depot, whenever that is
+TimeWindowImprover::Segment TimeWindowImprover::depotReturn() const {
+    return { 0, 0, 0, 0, 0, 0, numeric_limits<double>::infinity() };
+}
+
+    // The Segment of driving a and then b, straight from a's last location to b's first
+    // Starting a as late as it can (a.latest) and driving on, b starts at a.latest + delta at the earliest: if that's
+    //      before b.earliest the courier waits, and if it's after b.latest there's time warp
+TimeWindowImprover::Segment TimeWindowImprover::join(const Segment& a, const Segment& b) const {
+    double miles = distance(a.last, b.first);
+    double delta = a.duration - a.timeWarp + miles * m_minutesPerMile;
+    double wait = max(b.earliest - delta - a.latest, 0.0);
+    double warp = max(a.earliest + delta - b.latest, 0.0);
+    return { a.first, b.last, a.miles + miles + b.miles, a.duration + b.duration + miles * m_minutesPerMile + wait,
+             a.timeWarp + b.timeWarp + warp, max(b.earliest - delta, a.earliest) - wait, min(b.latest - delta, a.latest) + warp };
+}
+
+    // The Segment of the tour from position from to position to, fewer than m_span apart, or of the same backwards
+TimeWindowImprover::Segment TimeWindowImprover::stretch(size_t from, size_t to, bool reversed) const {
+    return reversed ? m_backward[from * m_span + (to - from)] : m_forward[from * m_span + (to - from)];
+}
+
+    // Each location's nearest others, by distance plus how badly their windows fit one straight after the other: the
+    //      time warp or waiting that would take, whichever way round is better, in the miles it could be driving instead
+void TimeWindowImprover::buildNeighbours() {
+    vector<double> proximity(m_distances, m_distances + m_count * m_count);
+    for (uint32_t i = 1; i < m_count; i++) {
+        for (uint32_t j = 1; j < m_count; j++) {
+            if (i == j) {
+                continue;
+            }
+            double travel = distance(i, j) * m_minutesPerMile;
+            double gaps[2];
+            for (int way = 0; way < 2; way++) {
+                uint32_t from = (way == 0) ? i : j;
+                uint32_t to = (way == 0) ? j : i;
+                double warp = max(m_earliest[from] + m_serviceMinutes + travel - m_latest[to], 0.0);
+                double wait = max(m_earliest[to] - m_latest[from] - m_serviceMinutes - travel, 0.0);
+                gaps[way] = warp + WAIT_WEIGHT * wait;
+            }
+            proximity[i * m_count + j] += min(gaps[0], gaps[1]) / m_minutesPerMile;
+        }
+    }
+    TourImprover::nearestNeighbours(proximity.data(), m_count, m_neighbourCount, m_neighbours);
+}
+
+bool TimeWindowImprover::improves(const Segment& tour, double current) const {
+    return scoreOf(tour) < current - MIN_GAIN * (1 + current);
+}
+
+void TimeWindowImprover::activate(uint32_t location) {
+    if (location != 0 && !m_queued[location]) {
+        m_queued[location] = true;
+        m_active.push_back(location);
+    }
+}
+
+    // Tries reversing the stretch of tour between a and each of its neighbours b, so that a and b end up next to each other
+bool TimeWindowImprover::tryTwoOpt(uint32_t a, double current) {
+    size_t i = m_position[a];
+    for (size_t n = 0; n < m_neighbourCount; n++) {
+        uint32_t b = m_neighbours[a * m_neighbourCount + n];
+        if (b == 0) {
+            continue;
+        }
+        size_t j = m_position[b];
+            // After a, reverse up to b; or before a, reverse from b
+        size_t from = (i < j) ? i + 1 : j;
+        size_t to = (i < j) ? j : i - 1;
+        if (to <= from || to - from >= m_span) {
+            continue;
+        }
+        m_stats.evaluations++;
+        Segment tour = join(join(m_prefix[from - 1], stretch(from, to, true)), m_suffix[to + 1]);
+        if (improves(tour, current)) {
+            reverse(m_tour.begin() + from, m_tour.begin() + to + 1);
+            applied(from, to);
+            m_stats.twoOptMoves++;
+            return true;
+        }
+    }
+    return false;
+}
+
+    // Tries moving each run of one to MAX_SEGMENT stops that starts or ends at a
+bool TimeWindowImprover::tryOrOpt(uint32_t a, double current) {
+    size_t i = m_position[a];
+    for (size_t length = 1; length <= MAX_SEGMENT; length++) {
+        for (size_t e = 0; e < (length == 1 ? 1 : 2); e++) {
+            if (e == 1 && i < length) {
+                continue;
+            }
+            size_t start = (e == 0) ? i : i + 1 - length;
+            if (start + length > m_count) {
+                continue;
+            }
+            if (tryMoveSegment(start, length, current)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+    // Tries moving the run of length stops at start to just after or just before a neighbour of either of its ends,
+    //      either way round
+bool TimeWindowImprover::tryMoveSegment(size_t start, size_t length, double current) {
+    size_t end = start + length - 1;
+    for (size_t e = 0; e < (length == 1 ? 1 : 2); e++) {
+        uint32_t endpoint = m_tour[(e == 0) ? start : end];
+        for (size_t n = 0; n < m_neighbourCount; n++) {
+            uint32_t b = m_neighbours[endpoint * m_neighbourCount + n];
+                // Insert after target: after b, or before it (after the depot's last stop, if b is the depot)
+            size_t targets[2] = { m_position[b], (b == 0) ? m_count - 1 : m_position[b] - 1 };
+            for (size_t target : targets) {
+                if (target + 1 >= start && target <= end) {
+                    continue;       // in the run, or just before it already
+                }
+                bool forwards = target > end;
+                size_t middleFrom = forwards ? end + 1 : target + 1;
+                size_t middleTo = forwards ? target : start - 1;
+                if (middleTo - middleFrom >= m_span) {
+                    continue;
+                }
+                for (bool reversed : { false, true }) {
+                    m_stats.evaluations++;
+                    Segment run = stretch(start, end, reversed);
+                    Segment tour = forwards
+                        ? join(join(join(m_prefix[start - 1], stretch(middleFrom, middleTo, false)), run), m_suffix[target + 1])
+                        : join(join(join(m_prefix[target], run), stretch(middleFrom, middleTo, false)), m_suffix[end + 1]);
+                    if (improves(tour, current)) {
+                        if (forwards) {
+                            rotate(m_tour.begin() + start, m_tour.begin() + end + 1, m_tour.begin() + target + 1);
+                            if (reversed) {
+                                reverse(m_tour.begin() + target + 1 - length, m_tour.begin() + target + 1);
+                            }
+                            applied(start, target);
+                        } else {
+                            rotate(m_tour.begin() + target + 1, m_tour.begin() + start, m_tour.begin() + end + 1);
+                            if (reversed) {
+                                reverse(m_tour.begin() + target + 1, m_tour.begin() + target + 1 + length);
+                            }
+                            applied(target + 1, end);
+                        }
+                        m_stats.orOptMoves++;
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+    // Tries exchanging a with each of its neighbours b, each taking the other's place
+bool TimeWindowImprover::trySwap(uint32_t a, double current) {
+    for (size_t n = 0; n < m_neighbourCount; n++) {
+        uint32_t b = m_neighbours[a * m_neighbourCount + n];
+        if (b == 0) {
+            continue;
+        }
+        size_t lo = min(m_position[a], m_position[b]);
+        size_t hi = max(m_position[a], m_position[b]);
+            // Swapping next-door stops is moving one of them, which Or-opt has already tried
+        if (hi == lo + 1 || hi - lo - 1 > m_span) {
+            continue;
+        }
+        m_stats.evaluations++;
+        Segment tour = join(join(join(join(m_prefix[lo - 1], single(m_tour[hi])), stretch(lo + 1, hi - 1, false)),
+                                 single(m_tour[lo])), m_suffix[hi + 1]);
+        if (improves(tour, current)) {
+            swap(m_tour[lo], m_tour[hi]);
+            applied(lo, hi);
+            m_stats.swapMoves++;
+            return true;
+        }
+    }
+    return false;
+}
+
+    // After a move has changed the tour at positions [from, to]: brings everything about the tour up to date, and
+    //      looks again at the stops the move touched and either side of it
+void TimeWindowImprover::applied(size_t from, size_t to) {
+    for (size_t p = from; p <= to; p++) {
+        m_position[m_tour[p]] = static_cast<uint32_t>(p);
+    }
+    updateSegments(from, to);
+    for (size_t p = from - 1; p <= min(to + 1, m_count - 1); p++) {
+        activate(m_tour[p]);
+    }
+}
+
+    // Rebuilds the Segments that include any of positions [from, to]: every prefix from from on, every suffix up to to,
+    //      and the stretches that overlap them
+void TimeWindowImprover::updateSegments(size_t from, size_t to) {
+    m_prefix[0] = single(m_tour[0]);
+    for (size_t i = max(from, size_t(1)); i < m_count; i++) {
+        m_prefix[i] = join(m_prefix[i - 1], single(m_tour[i]));
+    }
+    m_suffix[m_count] = depotReturn();
+    for (size_t i = min(to, m_count - 1) + 1; i-- > 0; ) {
+        m_suffix[i] = join(single(m_tour[i]), m_suffix[i + 1]);
+    }
+        // A stretch that ends before from is as it was
+    for (size_t i = (from + 1 > m_span) ? from + 1 - m_span : 0; i <= to; i++) {
+        Segment* forward = &m_forward[i * m_span];
+        Segment* backward = &m_backward[i * m_span];
+        if (i >= from) {
+            forward[0] = backward[0] = single(m_tour[i]);
+        }
+        for (size_t k = (i >= from) ? 1 : from - i; k < m_span && i + k < m_count; k++) {
+            forward[k] = join(forward[k - 1], single(m_tour[i + k]));
+            backward[k] = join(single(m_tour[i + k]), backward[k - 1]);
+        }
+    }
+}
@@ -0,0 +1,140 @@
+// TimeWindowImprover.h
+
+// Local search over the order of a delivery tour whose stops have time windows: each stop's delivery has to
+// start between an earliest and a latest time, in minutes after the courier leaves the depot. A courier who
+// gets somewhere early waits; one who gets there late is late. DeliveryOptimizer uses it in place of
+// TourImprover as soon as any delivery in a batch has a window.
+//
+//  - A tour is scored by its length plus a big penalty per minute of time warp: how far back in time the
+//    courier would have to go to make every stop on time (Vidal et al.'s time-warp model). A tour with no
+//    time warp has every stop on time; a tour with some is at least that late somewhere. So the search
+//    first gets as few minutes late as it can, then gets shorter without getting any later.
+//  - A move is scored without walking the tour: every stretch of the tour is summed up in a Segment (its
+//    length, duration, time warp, and the window its first delivery can start in without adding waiting
+//    or time warp), and two Segments can be joined into the Segment of both in O(1). The tour before each
+//    position and after it are kept as Segments, as is every stretch of up to MAX_SPAN (128) stops, both
+//    ways round. A move's tour is then at most four Segments joined end to end, so checking whether a move
+//    keeps every stop on time costs the same whatever the tour's length.
+//  - The moves are 2-opt (reverse a stretch), Or-opt and relocate (move a run of one to three stops
+//    elsewhere, either way round) and swap (exchange two stops), towards each stop's nearest few others by
+//    distance and by how well their windows follow each other. Every move has to stay within MAX_SPAN
+//    stops, which in a tour with windows is where nearly all the good ones are; keeping the stretches up
+//    to date after a move costs O(MAX_SPAN^2), which is what makes a span much wider not worth it.
+//
+// Like TourImprover, it works from a precomputed, symmetric distance matrix with the depot as location 0,
+// and keeps the depot at position 0 of the tour.
+
+#ifndef TIMEWINDOWIMPROVER_INCLUDED
+#define TIMEWINDOWIMPROVER_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+    // What the last improve() did
+struct TimeWindowSearchStats
+{
+    size_t iterations = 0;          // stops looked at for a move
+    size_t evaluations = 0;         // moves scored
+    size_t twoOptMoves = 0;
+    size_t orOptMoves = 0;          // runs of one to three stops moved
+    size_t swapMoves = 0;
+    double milliseconds = 0;
+};
+
+    // How a tour does: its length, and how many minutes of time warp it has (0 if every stop is on time)
+struct TimeWindowCost
+{
+    double miles = 0;
+    double timeWarp = 0;
+};
+
+class TimeWindowImprover
+{
+public:
+        // distances is the count x count matrix, row by row, of the distances between the locations, minutesPerMile how
+        //      long a mile of it takes, and serviceMinutes how long each delivery takes; delivery at location l has to start
+        //      in [earliest[l], latest[l]], and the courier leaves location 0 at time 0 (earliest[0] and latest[0] are
+        //      ignored); all the arrays must outlive the TimeWindowImprover
+    TimeWindowImprover(const double* distances, size_t count, double minutesPerMile, double serviceMinutes,
+                       const double* earliest, const double* latest);
+
+        // Improves tour (location 0 followed by every other location once) until no move improves it, it has looked
+        //      at maxIterations stops, or maxMilliseconds have passed; returns how the tour it leaves does
+    TimeWindowCost improve(std::vector<uint32_t>& tour,
+                           double maxMilliseconds = std::numeric_limits<double>::infinity(),
+                           size_t maxIterations = std::numeric_limits<size_t>::max());
+    const TimeWindowSearchStats& stats() const { return m_stats; }
+
+        // How tour does, and what it's scored as: its miles plus LATE_PENALTY per minute of time warp
+    TimeWindowCost evaluate(const std::vector<uint32_t>& tour) const;
+    static double score(const TimeWindowCost& cost) { return cost.miles + LATE_PENALTY * cost.timeWarp; }
+        // Drives tour, waiting wherever the courier is early, and fills in arrivals with the minute each location is
+        //      reached, in tour order; returns how many stops are reached after their latest
+    size_t schedule(const std::vector<uint32_t>& tour, std::vector<double>& arrivals) const;
+
+        // C++11 syntax for preventing copying and assignment
+    TimeWindowImprover(const TimeWindowImprover&) = delete;
+    TimeWindowImprover& operator=(const TimeWindowImprover&) = delete;
+
+private:
+    static constexpr size_t NEIGHBOURS = 10;        // per location
+    static constexpr size_t MAX_SPAN = 128;         // most positions a move reaches across
+    static const int MAX_SEGMENT = 3;               // longest run of stops an Or-opt move takes
+    static constexpr double LATE_PENALTY = 1000;    // miles a minute of time warp is worth
+
+        // A stretch of the tour, from first to last, summed up so that two can be joined in O(1)
+    struct Segment
+    {
+        uint32_t first;
+        uint32_t last;
+        double miles;
+        double duration;        // from starting first's delivery to finishing last's, waiting included
+        double timeWarp;
+        double earliest;        // the window first's delivery can start in without waiting or time warp being added
+        double latest;
+    };
+
+    const double* m_distances;
+    size_t m_count;
+    double m_minutesPerMile;
+    double m_serviceMinutes;
+    const double* m_earliest;
+    const double* m_latest;
+    std::vector<uint32_t> m_neighbours;     // location l's nearest other locations, nearest first, at [l * m_neighbourCount, ...)
+    size_t m_neighbourCount;
+    size_t m_span;                          // MAX_SPAN, or the whole tour if that's shorter
+
+        // The tour being improved and where each location is in it, the Segments of the tour up to and from each
+        //      position (back to the depot included), and of the stretches [i, i + k] and their reverses, at i * m_span + k
+    std::vector<uint32_t> m_tour;
+    std::vector<uint32_t> m_position;
+    std::vector<Segment> m_prefix;
+    std::vector<Segment> m_suffix;
+    std::vector<Segment> m_forward;
+    std::vector<Segment> m_backward;
+        // Locations to look at, and which are already waiting to be
+    std::vector<uint32_t> m_active;
+    std::vector<char> m_queued;
+    TimeWindowSearchStats m_stats;
+
+        // Auxiliary Functions
+    double distance(uint32_t from, uint32_t to) const { return m_distances[from * m_count + to]; }
+    Segment single(uint32_t location) const;
+    Segment depotReturn() const;
+    Segment join(const Segment& a, const Segment& b) const;
+    Segment stretch(size_t from, size_t to, bool reversed) const;
+    double scoreOf(const Segment& tour) const { return tour.miles + LATE_PENALTY * tour.timeWarp; }
+    bool improves(const Segment& tour, double current) const;
+    void buildNeighbours();
+    void activate(uint32_t location);
+    bool tryTwoOpt(uint32_t a, double current);
+    bool tryOrOpt(uint32_t a, double current);
+    bool trySwap(uint32_t a, double current);
+    bool tryMoveSegment(size_t start, size_t length, double current);
+    void applied(size_t from, size_t to);
+    void updateSegments(size_t from, size_t to);
+};
+
+#endif // TIMEWINDOWIMPROVER_INCLUDED
@@ -0,0 +1,226 @@
+#include "TourAnnealer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+using namespace std;
+
+    // A round starts hot enough to take an average lengthening move with this probability, and cools to a
+    //      temperature COOLING times lower, at which point it is taking almost nothing but improvements
+const double START_ACCEPTANCE = 0.1;
+const double COOLING = 1000;
+const double MIN_GAIN = 1e-10;
+
+struct TourAnnealer::Chain
+{
+    uint64_t random;                        // splitmix64 state, so a seed gives the same numbers everywhere
+    unique_ptr<TourImprover> improver;
+    vector<uint32_t> tour;
+    vector<uint32_t> position;
+    vector<uint32_t> best;
+    double bestLength = 0;
+    size_t moves = 0;
+    size_t accepted = 0;
+
+    explicit Chain(uint64_t seed) : random(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (random += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+};
+
+TourAnnealer::TourAnnealer(const double* distances, size_t count) : m_distances(distances), m_count(count)
+{}
+
+TourAnnealer::~TourAnnealer()
+{}
+
+double TourAnnealer::anneal(vector<uint32_t>& tour, double maxMilliseconds, size_t maxRounds, unsigned int threads, uint64_t seed)
+{
+    auto start = chrono::steady_clock::now();
+    m_stats = AnnealingStats();
+    double length = TourImprover::tourLength(m_distances, m_count, tour);
+        // With four locations or fewer there is nothing local search can't find on its own
+    if (m_count < 5) {
+        return length;
+    }
+
+    size_t nChains = (threads != 0) ? threads : max(1u, thread::hardware_concurrency());
+    m_chains.clear();
+    for (size_t c = 0; c < nChains; c++) {
+        m_chains.emplace_back(new Chain(seed + c * 0x632be59bd9b4e019ULL));
+    }
+    double temperature = startingTemperature(tour, seed);
+
+    for (size_t round = 0; round < maxRounds; round++) {
+        if (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= maxMilliseconds) {
+            break;
+        }
+
+            // Every chain anneals from the best tour yet; this thread runs the first
+        vector<thread> workers;
+        for (size_t c = 1; c < nChains; c++) {
+            workers.emplace_back([&, c]() { runRound(*m_chains[c], tour, length, temperature); });
+        }
+        runRound(*m_chains[0], tour, length, temperature);
+        for (thread& t : workers) {
+            t.join();
+        }
+
+            // Then they share the best of what they found, in chain order, so that which thread finishes first never matters
+        for (const unique_ptr<Chain>& chain : m_chains) {
+            if (chain->bestLength < length - MIN_GAIN) {
+                length = chain->bestLength;
+                tour = chain->best;
+            }
+        }
+        m_stats.rounds++;
+        m_stats.roundLengths.push_back(length);
+    }
+
+    for (const unique_ptr<Chain>& chain : m_chains) {
+        m_stats.moves += chain->moves;
+        m_stats.accepted += chain->accepted;
+    }
+    m_stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return length;
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+    // How hot each round starts: tries the random 2-opt moves a chain would, on tour, to see how much a typical
+    //      lengthening one lengthens it
+double TourAnnealer::startingTemperature(const vector<uint32_t>& tour, uint64_t seed) const
+{
+    TourImprover neighbours(m_distances, m_count);
+    vector<uint32_t> position(m_count);
+    for (size_t i = 0; i < m_count; i++) {
+        position[tour[i]] = static_cast<uint32_t>(i);
+    }
+    Chain sampler(seed);
+    double uphill = 0;
+    size_t nUphill = 0;
+    for (int i = 0; i < 1000; i++) {
+        size_t lo = sampler.next() % m_count;
+        size_t hi = position[neighbours.neighbours(tour[lo])[sampler.next() % neighbours.neighbourCount()]];
+        if (lo > hi) {
+            swap(lo, hi);
+        }
+        if (hi <= lo + 1) {
+            continue;
+        }
+        uint32_t a = tour[lo], b = tour[lo + 1], c = tour[hi], d = tour[(hi + 1) % m_count];
+        double delta = m_distances[a * m_count + c] + m_distances[b * m_count + d]
+                     - m_distances[a * m_count + b] - m_distances[c * m_count + d];
+        if (delta > 0) {
+            uphill += delta;
+            nUphill++;
+        }
+    }
+    return (nUphill == 0) ? 0 : -(uphill / nUphill) / log(START_ACCEPTANCE);
+}
+
+    // One round of one chain: MOVES_PER_LOCATION moves per location from start, cooling geometrically, then local search
+    //      on the best tour the chain passed through
+    // Moves add an edge from a random location to one of its neighbours, as TourImprover's do: 2-opt three times in
+    //      four, otherwise an Or-opt move of one to three stops, either way round
+void TourAnnealer::runRound(Chain& chain, const vector<uint32_t>& start, double startLength, double temperature) const
+{
+    const double* dist = m_distances;
+    const size_t n = m_count;
+    if (!chain.improver) {
+        chain.improver.reset(new TourImprover(m_distances, m_count));
+    }
+    const TourImprover& improver = *chain.improver;
+    size_t nNeighbours = improver.neighbourCount();
+
+    vector<uint32_t>& tour = chain.tour;
+    vector<uint32_t>& position = chain.position;
+    tour = start;
+    position.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        position[tour[i]] = static_cast<uint32_t>(i);
+    }
+    chain.best = start;
+    chain.bestLength = startLength;
+    double length = startLength;
+
+    size_t nMoves = MOVES_PER_LOCATION * n;
+    double cooling = pow(1 / COOLING, 1.0 / nMoves);
+    for (size_t m = 0; m < nMoves; m++, temperature *= cooling) {
+        chain.moves++;
+        if ((chain.next() & 3) != 0) {
+                // 2-opt: join a to its neighbour c, reversing the stretch of tour between them
+            size_t i = chain.next() % n;
+            size_t j = position[improver.neighbours(tour[i])[chain.next() % nNeighbours]];
+            size_t lo = min(i, j), hi = max(i, j);
+            if (hi == lo + 1) {
+                continue;
+            }
+            uint32_t a = tour[lo], b = tour[lo + 1], c = tour[hi], d = tour[(hi + 1) % n];
+            double delta = dist[a * n + c] + dist[b * n + d] - dist[a * n + b] - dist[c * n + d];
+            if (delta > 0 && chain.uniform() >= exp(-delta / temperature)) {
+                continue;
+            }
+            reverse(tour.begin() + lo + 1, tour.begin() + hi + 1);
+            for (size_t p = lo + 1; p <= hi; p++) {
+                position[tour[p]] = static_cast<uint32_t>(p);
+            }
+            length += delta;
+        } else {
+                // Or-opt: move the run of stops at [s, s + runLength) to just after x, a neighbour of its first stop
+            size_t runLength = 1 + chain.next() % MAX_SEGMENT;
+            size_t s = 1 + chain.next() % (n - 1);
+            if (s + runLength > n) {
+                continue;
+            }
+            uint32_t first = tour[s], last = tour[s + runLength - 1];
+            uint32_t x = improver.neighbours(first)[chain.next() % nNeighbours];
+            size_t target = position[x];
+            if (target + 1 >= s && target < s + runLength) {
+                continue;       // x is in the run, or just before it already
+            }
+            uint32_t before = tour[s - 1], after = tour[(s + runLength) % n], y = tour[(target + 1) % n];
+            bool reversed = (chain.next() & 1) != 0;
+            uint32_t nearX = reversed ? last : first, nearY = reversed ? first : last;
+            double delta = dist[before * n + after] - dist[before * n + first] - dist[last * n + after]
+                         + dist[x * n + nearX] + dist[nearY * n + y] - dist[x * n + y];
+            if (delta > 0 && chain.uniform() >= exp(-delta / temperature)) {
+                continue;
+            }
+            size_t begin, end, runBegin;
+            if (target > s) {
+                rotate(tour.begin() + s, tour.begin() + s + runLength, tour.begin() + target + 1);
+                begin = s;
+                end = target + 1;
+                runBegin = target + 1 - runLength;
+            } else {
+                rotate(tour.begin() + target + 1, tour.begin() + s, tour.begin() + s + runLength);
+                begin = target + 1;
+                end = s + runLength;
+                runBegin = target + 1;
+            }
+            if (reversed) {
+                reverse(tour.begin() + runBegin, tour.begin() + runBegin + runLength);
+            }
+            for (size_t p = begin; p < end; p++) {
+                position[tour[p]] = static_cast<uint32_t>(p);
+            }
+            length += delta;
+        }
+
+        chain.accepted++;
+        if (length < chain.bestLength - MIN_GAIN) {
+            chain.bestLength = length;
+            chain.best = tour;
+        }
+    }
+
+    chain.bestLength = chain.improver->improve(chain.best);
+}
@@ -0,0 +1,75 @@
+// TourAnnealer.h
+
+// Parallel multi-start simulated annealing over the order of a delivery tour, for batches big enough (a
+// catering day's hundreds of drops) that a local optimum from TourImprover leaves miles on the table and
+// spending a few hundred milliseconds more is worth it.
+//
+//  - Each thread runs its own chain with its own random numbers. In each round, every chain starts from
+//    the best tour found so far and makes a fixed number of random 2-opt and Or-opt moves. It takes every
+//    move that shortens its tour, and moves that lengthen it with a probability that falls as the chain
+//    cools. Then TourImprover takes the chain's best tour to a local optimum.
+//  - Between rounds the chains share: the shortest of their tours (the lowest numbered chain's, on a
+//    tie) becomes everyone's starting point for the next round. So each round re-anneals around the best
+//    tour yet.
+//  - A round does the same work however long it takes, so the tour found depends only on the seed, the
+//    number of threads and the number of rounds run. The time budget is only checked between rounds. A
+//    run that was stopped by time can be repeated exactly by asking for the same number of rounds (see
+//    AnnealingStats::rounds).
+//
+// Like TourImprover, it works from a precomputed, symmetric distance matrix, and keeps the depot at
+// position 0.
+
+#ifndef TOURANNEALER_INCLUDED
+#define TOURANNEALER_INCLUDED
+
+#include "TourImprover.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+    // What the last anneal() did
+struct AnnealingStats
+{
+    size_t rounds = 0;
+    size_t moves = 0;               // over every chain
+    size_t accepted = 0;
+    double milliseconds = 0;
+    std::vector<double> roundLengths;       // the best tour's length after each round
+};
+
+class TourAnnealer
+{
+public:
+        // distances is the count x count matrix, row by row, of the distances between the locations; it must outlive
+        //      the TourAnnealer
+    TourAnnealer(const double* distances, size_t count);
+    ~TourAnnealer();
+
+        // Anneals tour (location 0 followed by every other location once), on threads chains at once (0 means one per
+        //      core), for maxRounds rounds or until maxMilliseconds have passed, whichever comes first; tour becomes
+        //      the best tour found, and its length is returned
+    double anneal(std::vector<uint32_t>& tour, double maxMilliseconds, size_t maxRounds, unsigned int threads, uint64_t seed);
+    const AnnealingStats& stats() const { return m_stats; }
+
+        // C++11 syntax for preventing copying and assignment
+    TourAnnealer(const TourAnnealer&) = delete;
+    TourAnnealer& operator=(const TourAnnealer&) = delete;
+
+private:
+    static const size_t MOVES_PER_LOCATION = 200;   // per chain per round
+    static const int MAX_SEGMENT = 3;               // longest run of stops an Or-opt move takes
+
+    struct Chain;
+
+    const double* m_distances;
+    size_t m_count;
+    std::vector<std::unique_ptr<Chain>> m_chains;
+    AnnealingStats m_stats;
+
+        // Auxiliary Functions
+    double startingTemperature(const std::vector<uint32_t>& tour, uint64_t seed) const;
+    void runRound(Chain& chain, const std::vector<uint32_t>& start, double startLength, double temperature) const;
+};
+
+#endif // TOURANNEALER_INCLUDED
@@ -0,0 +1,242 @@
+#include "TourImprover.h"
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+    // A move has to shorten the tour by more than this, so rounding can't have two moves undo each other forever
+const double MIN_GAIN = 1e-10;
+
+TourImprover::TourImprover(const double* distances, size_t count)
+ : m_distances(distances), m_count(count), m_neighbourCount(min(NEIGHBOURS, count == 0 ? 0 : count - 1))
+{
+    nearestNeighbours(m_distances, m_count, m_neighbourCount, m_neighbours);
+}
+
+double TourImprover::improve(vector<uint32_t>& tour, double maxMilliseconds, size_t maxIterations)
+{
+    auto start = chrono::steady_clock::now();
+    m_stats = TourSearchStats();
+        // With three locations or fewer, every order is the same tour
+    if (m_count < 4) {
+        return tourLength(m_distances, m_count, tour);
+    }
+
+    m_tour = tour;
+    m_position.resize(m_count);
+    updatePositions(0, m_count);
+    m_active.assign(m_tour.begin(), m_tour.end());
+    m_queued.assign(m_count, true);
+
+    size_t head = 0;
+    while (head < m_active.size() && m_stats.iterations < maxIterations) {
+        if (m_stats.iterations % 16 == 0 && maxMilliseconds != numeric_limits<double>::infinity()
+            && chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= maxMilliseconds) {
+            break;
+        }
+        uint32_t a = m_active[head++];
+        m_queued[a] = false;
+        m_stats.iterations++;
+        if (tryTwoOpt(a) || tryOrOpt(a)) {
+            activate(a);        // there may be more to gain around a
+        }
+
+            // Drop the stops already looked at once they're most of the queue
+        if (head > m_count && 2 * head > m_active.size()) {
+            m_active.erase(m_active.begin(), m_active.begin() + head);
+            head = 0;
+        }
+    }
+
+    tour = m_tour;
+    m_stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return tourLength(m_distances, m_count, tour);
+}
+
+double TourImprover::tourLength(const double* distances, size_t count, const vector<uint32_t>& tour)
+{
+    double length = 0;
+    for (size_t i = 0; i < tour.size(); i++) {
+        length += distances[tour[i] * count + tour[(i + 1) % tour.size()]];
+    }
+    return length;
+}
+
+void TourImprover::nearestNeighbours(const double* distances, size_t count, size_t k, vector<uint32_t>& neighbours)
+{
+    neighbours.resize(count * k);
+    vector<uint32_t> others;
+    for (uint32_t l = 0; l < count; l++) {
+        const double* from = &distances[l * count];
+        others.clear();
+        for (uint32_t o = 0; o < count; o++) {
+            if (o != l) {
+                others.push_back(o);
+            }
+        }
+        partial_sort(others.begin(), others.begin() + k, others.end(),
+                     [from] (uint32_t o1, uint32_t o2) { return from[o1] < from[o2]; });
+        copy_n(others.begin(), k, neighbours.begin() + l * k);
+    }
+}
+
+/////////////////////////////////////////////////
+// Auxiliary Functions
+/////////////////////////////////////////////////
+void TourImprover::activate(uint32_t location)
+{
+    if (!m_queued[location]) {
+        m_queued[location] = true;
+        m_active.push_back(location);
+    }
+}
+
+    // Looks for a 2-opt move that swaps out one of a's edges for an edge from a to one of its neighbours c, and applies
+    //      the first that shortens the tour
+    // Taking a's edge to b, and c's edge on the same side to d, the tour a b ... c d becomes a c ... b d
+    // The new edge a c must be shorter than a b for the move to gain anything, and neighbours come nearest first, so
+    //      the search along them stops at the first that isn't
+bool TourImprover::tryTwoOpt(uint32_t a)
+{
+    const uint32_t* neighbours = &m_neighbours[a * m_neighbourCount];
+    for (int side = 0; side < 2; side++) {
+        uint32_t b = (side == 0) ? next(a) : prev(a);
+        double ab = distance(a, b);
+        for (size_t i = 0; i < m_neighbourCount; i++) {
+            uint32_t c = neighbours[i];
+            double gain = ab - distance(a, c);
+            if (gain <= MIN_GAIN) {
+                break;
+            }
+            uint32_t d = (side == 0) ? next(c) : prev(c);
+            if (c == b || d == a) {
+                continue;
+            }
+            if (gain + distance(c, d) - distance(b, d) > MIN_GAIN) {
+                if (side == 0) {
+                    reversePath(b, c);
+                } else {
+                    reversePath(a, d);
+                }
+                activate(b);
+                activate(c);
+                activate(d);
+                m_stats.twoOptMoves++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+    // Looks for a run of one to three stops, starting or ending at a, that can be moved somewhere shorter
+bool TourImprover::tryOrOpt(uint32_t a)
+{
+    size_t position = m_position[a];
+    for (size_t length = 1; length <= MAX_SEGMENT && length + 3 <= m_count; length++) {
+            // The depot never moves, so a run can't include position 0
+        if (position != 0 && position + length <= m_count
+            && tryMoveSegment(a, m_tour[position + length - 1], length)) {
+            return true;
+        }
+        if (length > 1 && position >= length
+            && tryMoveSegment(m_tour[position - length + 1], a, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+    // Tries moving the run first ... last (length stops) to lie, either way round, between one of first's or last's
+    //      neighbours and the location before or after it; applies the first move that shortens the tour
+bool TourImprover::tryMoveSegment(uint32_t first, uint32_t last, size_t length)
+{
+    uint32_t before = prev(first);
+    uint32_t after = next(last);
+    double removeGain = distance(before, first) + distance(last, after) - distance(before, after);
+    if (removeGain <= MIN_GAIN) {
+        return false;
+    }
+    size_t start = m_position[first];
+    auto inSegment = [this, start, length] (uint32_t l) { return m_position[l] - start < length; };
+
+    for (int e = 0; e < (length == 1 ? 1 : 2); e++) {
+        uint32_t end = (e == 0) ? first : last;
+        const uint32_t* neighbours = &m_neighbours[end * m_neighbourCount];
+        for (size_t i = 0; i < m_neighbourCount; i++) {
+            uint32_t c = neighbours[i];
+            if (inSegment(c)) {
+                continue;
+            }
+                // Into the edge after c, or the edge before it, with end next to c
+            for (int side = 0; side < 2; side++) {
+                uint32_t x = (side == 0) ? c : prev(c);
+                uint32_t y = (side == 0) ? next(c) : c;
+                if (inSegment(x) || inSegment(y)) {
+                    continue;
+                }
+                bool reversed = (side == 0) != (end == first);
+                double added = distance(x, reversed ? last : first) + distance(reversed ? first : last, y) - distance(x, y);
+                if (removeGain - added > MIN_GAIN) {
+                    moveSegment(start, length, x, reversed);
+                    activate(before);
+                    activate(after);
+                    activate(first);
+                    activate(last);
+                    activate(x);
+                    activate(y);
+                    if (length == 1) {
+                        m_stats.relocateMoves++;
+                    } else {
+                        m_stats.orOptMoves++;
+                    }
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+    // Reverses the path that runs forwards through the tour from from to to
+    // If that path passes through the depot, the rest of the tour is reversed instead, which makes the same tour
+    //      (run the other way round) and leaves the depot at position 0
+void TourImprover::reversePath(uint32_t from, uint32_t to)
+{
+    size_t i = m_position[from];
+    size_t j = m_position[to];
+    if (i == 0 || i > j) {
+        i = m_position[next(to)];
+        j = m_position[prev(from)];
+    }
+    reverse(m_tour.begin() + i, m_tour.begin() + j + 1);
+    updatePositions(i, j + 1);
+}
+
+    // Moves the length stops at m_tour[start, start + length) to just after the location after, reversing them if asked
+void TourImprover::moveSegment(size_t start, size_t length, uint32_t after, bool reversed)
+{
+    size_t target = m_position[after];
+    size_t begin, end, segmentBegin;
+    if (target > start) {
+        rotate(m_tour.begin() + start, m_tour.begin() + start + length, m_tour.begin() + target + 1);
+        begin = start;
+        end = target + 1;
+        segmentBegin = target + 1 - length;
+    } else {
+        rotate(m_tour.begin() + target + 1, m_tour.begin() + start, m_tour.begin() + start + length);
+        begin = target + 1;
+        end = start + length;
+        segmentBegin = target + 1;
+    }
+    if (reversed) {
+        reverse(m_tour.begin() + segmentBegin, m_tour.begin() + segmentBegin + length);
+    }
+    updatePositions(begin, end);
+}
+
+void TourImprover::updatePositions(size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        m_position[m_tour[i]] = static_cast<uint32_t>(i);
+    }
+}
@@ -0,0 +1,95 @@
+// TourImprover.h
+
+// Local search over the order of a delivery tour: the depot, then every stop once, then back to the depot.
+// DeliveryOptimizer starts it from its greedy order, and it keeps applying moves that shorten the tour until
+// none does (a local optimum) or it runs out of budget.
+//
+//  - Distances come from a precomputed, symmetric matrix over the locations, with the depot as location 0,
+//    so the change in length a move would make is a handful of lookups, however long the tour is.
+//  - The moves are 2-opt (replace two edges with the two that join their ends the other way, reversing the
+//    path between them), Or-opt (move a run of two or three consecutive stops elsewhere in the tour, either
+//    way round) and relocate (move one stop).
+//  - Only moves that add an edge from a stop to one of its nearest few locations (its neighbour list) are
+//    tried; long edges almost never belong in a short tour.
+//  - Don't-look bits: a stop from which no move improved the tour isn't looked at again until one of its
+//    edges changes. Once the tour is nearly optimal, a pass only looks at the few stops near the last moves.
+//
+// The depot always stays at position 0 of the tour.
+
+#ifndef TOURIMPROVER_INCLUDED
+#define TOURIMPROVER_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+    // What the last improve() did
+struct TourSearchStats
+{
+    size_t iterations = 0;          // stops looked at for a move
+    size_t twoOptMoves = 0;
+    size_t orOptMoves = 0;          // runs of two or three stops moved
+    size_t relocateMoves = 0;       // single stops moved
+    double milliseconds = 0;
+};
+
+class TourImprover
+{
+public:
+        // distances is the count x count matrix, row by row, of the distances between the locations; it must outlive
+        //      the TourImprover
+    TourImprover(const double* distances, size_t count);
+
+        // Shortens tour (location 0 followed by every other location once) until no move improves it, it has looked
+        //      at maxIterations stops, or maxMilliseconds have passed; returns its length, back to location 0 included
+    double improve(std::vector<uint32_t>& tour,
+                   double maxMilliseconds = std::numeric_limits<double>::infinity(),
+                   size_t maxIterations = std::numeric_limits<size_t>::max());
+    const TourSearchStats& stats() const { return m_stats; }
+
+        // location's nearest other locations, nearest first; there are neighbourCount() of them
+    const uint32_t* neighbours(uint32_t location) const { return &m_neighbours[location * m_neighbourCount]; }
+    size_t neighbourCount() const { return m_neighbourCount; }
+
+        // The length of tour, back to its start included
+    static double tourLength(const double* distances, size_t count, const std::vector<uint32_t>& tour);
+        // Fills in neighbours with each location's k nearest other locations, nearest first: location l's are at
+        //      [l * k, (l + 1) * k); k must be less than count
+    static void nearestNeighbours(const double* distances, size_t count, size_t k, std::vector<uint32_t>& neighbours);
+
+        // C++11 syntax for preventing copying and assignment
+    TourImprover(const TourImprover&) = delete;
+    TourImprover& operator=(const TourImprover&) = delete;
+
+private:
+    static constexpr size_t NEIGHBOURS = 10;    // per location
+    static const int MAX_SEGMENT = 3;           // longest run of stops an Or-opt move takes
+
+    const double* m_distances;
+    size_t m_count;
+    std::vector<uint32_t> m_neighbours;         // location l's nearest other locations, nearest first, at [l * m_neighbourCount, ...)
+    size_t m_neighbourCount;
+
+        // The tour being improved, and where each location is in it
+    std::vector<uint32_t> m_tour;
+    std::vector<uint32_t> m_position;
+        // Locations to look at, and which are already waiting to be
+    std::vector<uint32_t> m_active;
+    std::vector<char> m_queued;
+    TourSearchStats m_stats;
+
+        // Auxiliary Functions
+    double distance(uint32_t from, uint32_t to) const { return m_distances[from * m_count + to]; }
+    uint32_t next(uint32_t location) const { return m_tour[(m_position[location] + 1) % m_count]; }
+    uint32_t prev(uint32_t location) const { return m_tour[(m_position[location] + m_count - 1) % m_count]; }
+    void activate(uint32_t location);
+    bool tryTwoOpt(uint32_t a);
+    bool tryOrOpt(uint32_t a);
+    bool tryMoveSegment(uint32_t first, uint32_t last, size_t length);
+    void reversePath(uint32_t from, uint32_t to);
+    void moveSegment(size_t start, size_t length, uint32_t after, bool reversed);
+    void updatePositions(size_t begin, size_t end);
+};
+
+#endif // TOURIMPROVER_INCLUDED
@@ -5,17 +5,99 @@
 #include <string>
 #include <vector>
 #include <cassert>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <shared_mutex>
+#include <cstdlib>
+#include <new>
+
+#include "ExpandableHashMap.h"
+#include "FlatHashMap.h"
+#include "ConcurrentHashMap.h"
+#include "StreetGraph.h"
+#include "ContractionHierarchy.h"
+#include "RouteCache.h"
+#include "CompactRoute.h"
+#include "SpatialIndex.h"
+#include "TourImprover.h"
+#include "HeldKarp.h"
+#include "TourAnnealer.h"
+#include "FleetRouter.h"
+#include "TimeWindowImprover.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 // MARK: REMOVE
 using namespace std;
 
 bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
 bool parseDelivery(string line, string& lat, string& lon, string& item);
+int makeSnapshot(string mapFile, string snapshotFile, int landmarkCount);
+int makeHierarchy(string mapFile, string hierarchyFile);
 
 // MARK: REMOVE
 int smTest();
 int pTpRTest();
 int DPTest();
+int snapshotTest();
+int hashMapBenchmark();
+int rehashLatencyTest();
+int concurrentHashMapBenchmark();
+int routerBenchmark();
+int searchAllocationTest();
+int hierarchyBenchmark();
+int altBenchmark();
+int routeCacheBenchmark();
+int distanceMatrixBenchmark();
+int distanceKernelBenchmark();
+int compactRouteBenchmark();
+int componentBenchmark();
+int snapBenchmark();
+int nodeOrderBenchmark();
+int tourImprovementBenchmark();
+int heldKarpBenchmark();
+int annealingBenchmark();
+int fleetBenchmark();
+int timeWindowBenchmark();
+
+// MARK: REMOVE
+    // Counts the calling thread's heap allocations, for searchAllocationTest() and compactRouteBenchmark()
+    // Only a test build defines GOOBER_COUNT_ALLOCATIONS (g++ -DGOOBER_COUNT_ALLOCATIONS ...); the app itself keeps the
+    //      standard operator new and delete, and those tests then say they have nothing to count
+thread_local size_t t_allocations = 0;
+
+#ifdef GOOBER_COUNT_ALLOCATIONS
+const bool ALLOCATIONS_COUNTED = true;
+
+    // The array, nothrow, unsized and sized forms of the standard operators all come down to these; the aligned
+    //      forms are left to the standard library, which pairs its own aligned new and delete
+void* operator new(size_t size) {
+    t_allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+    // Neither is inlined into code that called new, where GCC would take the free() for a mismatched deallocation
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#else
+const bool ALLOCATIONS_COUNTED = false;
+#endif
 
 // MARK: REMOVE
 int main2() {
@@ -23,6 +105,26 @@ int main2() {
     smTest();
 //    pTpRTest();
 //    DPTest();
+//    snapshotTest();
+//    hashMapBenchmark();
+//    rehashLatencyTest();
+//    concurrentHashMapBenchmark();
+//    routerBenchmark();
+//    searchAllocationTest();
+//    hierarchyBenchmark();
+//    altBenchmark();
+//    routeCacheBenchmark();
+//    distanceMatrixBenchmark();
+//    distanceKernelBenchmark();
+//    compactRouteBenchmark();
+//    componentBenchmark();
+//    snapBenchmark();
+//    nodeOrderBenchmark();
+//    tourImprovementBenchmark();
+//    heldKarpBenchmark();
+//    annealingBenchmark();
+//    fleetBenchmark();
+//    timeWindowBenchmark();
     
     return 0;
 }
@@ -170,8 +272,940 @@ int DPTest() {
     return 0;
 }
 
+// MARK: REMOVE
+int snapshotTest() {
+    const string dir = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    
+    auto start = chrono::steady_clock::now();
+    StreetMap textMap;
+    assert(textMap.load(dir + "mapdata.txt"));
+    double textMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    
+    assert(textMap.saveSnapshot(dir + "mapdata.snapshot"));
+    
+    start = chrono::steady_clock::now();
+    StreetMap snapMap;
+    assert(snapMap.loadSnapshot(dir + "mapdata.snapshot"));
+    double snapMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    
+    cerr << "text load: " << textMs << " ms, snapshot load: " << snapMs << " ms" << endl;
+    
+        // Both maps must answer the same way
+    vector<StreetSegment> textSegs;
+    vector<StreetSegment> snapSegs;
+    GeoCoord someGC("34.0687275", "-118.4483620");
+    assert(textMap.getSegmentsThatStartWith(someGC, textSegs));
+    assert(snapMap.getSegmentsThatStartWith(someGC, snapSegs));
+    assert(textSegs.size() == snapSegs.size());
+    for (size_t i = 0; i < textSegs.size(); i++) {
+        assert(textSegs[i] == snapSegs[i] && textSegs[i].name == snapSegs[i].name);
+    }
+    
+    PointToPointRouter textRouter(&textMap);
+    PointToPointRouter snapRouter(&snapMap);
+    list<StreetSegment> textRoute;
+    list<StreetSegment> snapRoute;
+    double textDist = 0;
+    double snapDist = 0;
+    assert(textRouter.generatePointToPointRoute(GeoCoord("34.0625329", "-118.4470263"), GeoCoord("34.0712323", "-118.4505969"), textRoute, textDist) == DELIVERY_SUCCESS);
+    assert(snapRouter.generatePointToPointRoute(GeoCoord("34.0625329", "-118.4470263"), GeoCoord("34.0712323", "-118.4505969"), snapRoute, snapDist) == DELIVERY_SUCCESS);
+    assert(textRoute == snapRoute && textDist == snapDist);
+    cerr << "snapshot routing succeeded." << endl;
+    
+        // One StreetMap going from the text file to the snapshot and back must end up with the same map
+    StreetMap reloadMap;
+    assert(reloadMap.load(dir + "mapdata.txt"));
+    assert(reloadMap.loadSnapshot(dir + "mapdata.snapshot"));
+    assert(reloadMap.load(dir + "mapdata.txt"));
+    assert(reloadMap.getStreetGraph().nodeCount() == textMap.getStreetGraph().nodeCount());
+    assert(reloadMap.getStreetGraph().edgeCount() == textMap.getStreetGraph().edgeCount());
+    vector<StreetSegment> reloadSegs;
+    assert(reloadMap.getSegmentsThatStartWith(someGC, reloadSegs));
+    assert(reloadSegs.size() == textSegs.size());
+    for (size_t i = 0; i < textSegs.size(); i++) {
+        assert(reloadSegs[i] == textSegs[i] && reloadSegs[i].name == textSegs[i].name);
+    }
+    PointToPointRouter reloadRouter(&reloadMap);
+    list<StreetSegment> reloadRoute;
+    double reloadDist = 0;
+    assert(reloadRouter.generatePointToPointRoute(GeoCoord("34.0625329", "-118.4470263"), GeoCoord("34.0712323", "-118.4505969"), reloadRoute, reloadDist) == DELIVERY_SUCCESS);
+    assert(reloadRoute == textRoute && reloadDist == textDist);
+    cerr << "reloading after a snapshot succeeded." << endl;
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Compares ExpandableHashMap with FlatHashMap on the real map's GeoCoord keys
+template<typename Map>
+void timeHashMap(const char* name, const vector<CoordKey>& keys, const vector<CoordKey>& lookups, const vector<CoordKey>& misses) {
+    auto start = chrono::steady_clock::now();
+    Map map;
+    for (size_t i = 0; i < keys.size(); i++) {
+        map.associate(keys[i], static_cast<NodeId>(i));
+    }
+    double insertNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / keys.size();
+    
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for (const CoordKey& key : lookups) {
+        found += map.find(key) != nullptr;
+    }
+    double hitNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / lookups.size();
+    assert(found == lookups.size());
+    
+    start = chrono::steady_clock::now();
+    for (const CoordKey& key : misses) {
+        found += map.find(key) != nullptr;
+    }
+    double missNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / misses.size();
+    assert(found == lookups.size());
+    
+    cerr << name << ": insert " << insertNs << " ns, hit " << hitNs << " ns, miss " << missNs << " ns, "
+         << static_cast<double>(map.memoryUsage()) / keys.size() << " bytes/entry" << endl;
+}
+
+int hashMapBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    
+    vector<CoordKey> keys;
+    vector<CoordKey> misses;
+    for (NodeId n = 0; n < graph.nodeCount(); n++) {
+        int32_t lat = static_cast<int32_t>(llround(graph.latitude(n) * COORD_SCALE));
+        int32_t lon = static_cast<int32_t>(llround(graph.longitude(n) * COORD_SCALE));
+        keys.push_back(CoordKey(lat, lon));
+        misses.push_back(CoordKey(lat, lon + 1));
+    }
+    
+        // Look every key up 50 times, in random order
+    mt19937 rng(32);
+    vector<CoordKey> lookups;
+    for (int round = 0; round < 50; round++) {
+        lookups.insert(lookups.end(), keys.begin(), keys.end());
+    }
+    shuffle(lookups.begin(), lookups.end(), rng);
+    shuffle(misses.begin(), misses.end(), rng);
+    
+    cerr << keys.size() << " keys" << endl;
+    timeHashMap<ExpandableHashMap<CoordKey, NodeId>>("ExpandableHashMap", keys, lookups, misses);
+    timeHashMap<FlatHashMap<CoordKey, NodeId>>("FlatHashMap", keys, lookups, misses);
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Records the slowest single associate() while an ExpandableHashMap grows from 8 buckets to millions
+void timeGrowth(ExpandableHashMap<CoordKey, vector<StreetSegment>>& map, const char* name, const vector<CoordKey>& keys) {
+    double worstUs = 0;
+    size_t rehashingOps = 0;
+    auto total = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto start = chrono::steady_clock::now();
+        map.associate(keys[i], vector<StreetSegment>());
+        worstUs = max(worstUs, chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        rehashingOps += map.isRehashing();
+        
+            // Whichever table they are in at the moment, earlier keys must still be found
+        assert(map.find(keys[i]) != nullptr && map.find(keys[i / 2]) != nullptr);
+    }
+    double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - total).count();
+    
+    assert(map.size() == static_cast<int>(keys.size()));
+    for (const CoordKey& key : keys) {
+        assert(map.find(key) != nullptr);
+    }
+    
+        // Updating an association must not add a second one
+    map.associate(keys[0], vector<StreetSegment>(1));
+    assert(map.size() == static_cast<int>(keys.size()) && map.find(keys[0])->size() == 1);
+    
+    cerr << name << ": worst associate " << worstUs << " us, " << totalMs << " ms for " << keys.size()
+         << " associates, " << rehashingOps << " of them left a rehash under way" << endl;
+}
+
+int rehashLatencyTest() {
+    vector<CoordKey> keys;
+    for (size_t i = 0; i < (1 << 21); i++) {
+        keys.push_back(CoordKey(static_cast<int32_t>(i / 2048), static_cast<int32_t>(i % 2048)));
+    }
+    
+        // Both maps stay alive until the end, so freeing the first one's items can't stall the second's allocations
+    ExpandableHashMap<CoordKey, vector<StreetSegment>> allAtOnce;
+    ExpandableHashMap<CoordKey, vector<StreetSegment>> incremental(0.5, true);
+    timeGrowth(allAtOnce, "all at once", keys);
+    timeGrowth(incremental, "incremental", keys);
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // A value whose halves must always agree, so a reader that copied a half written value would notice
+struct CheckedValue {
+    uint64_t value;     // the key's index in the low 32 bits, the writer's count in the high 32
+    uint64_t check;     // always ~value
+};
+
+    // What you'd do without ConcurrentHashMap: an ExpandableHashMap behind a readers-writer lock
+struct LockedHashMap {
+    void associate(const CoordKey& key, const CheckedValue& value) {
+        unique_lock<shared_mutex> lock(mutex);
+        map.associate(key, value);
+    }
+    bool find(const CoordKey& key, CheckedValue& value) const {
+        shared_lock<shared_mutex> lock(mutex);
+        const CheckedValue* found = map.find(key);
+        if (found != nullptr) {
+            value = *found;
+        }
+        return found != nullptr;
+    }
+    int size() const {
+        shared_lock<shared_mutex> lock(mutex);
+        return map.size();
+    }
+    
+    ExpandableHashMap<CoordKey, CheckedValue> map;
+    mutable shared_mutex mutex;
+};
+
+    // Every thread does 95% finds and 5% associates, half of them updates and half new keys (so the map keeps growing)
+template<typename Map>
+void timeConcurrentMap(const char* name, const vector<CoordKey>& keys, unsigned int threadCount) {
+    const size_t opsPerThread = 1000000;
+    const size_t prefilled = keys.size() / 2;
+    
+    Map map;
+    for (size_t i = 0; i < prefilled; i++) {
+        map.associate(keys[i], CheckedValue{i, ~static_cast<uint64_t>(i)});
+    }
+    
+    auto work = [&](unsigned int t) {
+        mt19937 rng(t);
+        size_t nextNew = prefilled + t;     // threads insert disjoint sets of new keys
+        for (size_t op = 0; op < opsPerThread; op++) {
+            unsigned int r = rng();
+            size_t i = (r >> 8) % prefilled;
+            if (r % 40 == 0 && nextNew < keys.size()) {
+                map.associate(keys[nextNew], CheckedValue{nextNew, ~static_cast<uint64_t>(nextNew)});
+                nextNew += threadCount;
+            } else if (r % 40 == 1) {
+                uint64_t value = i | (static_cast<uint64_t>(op) << 32);
+                map.associate(keys[i], CheckedValue{value, ~value});
+            } else {
+                CheckedValue found;
+                assert(map.find(keys[i], found));
+                assert(found.check == ~found.value && (found.value & 0xFFFFFFFF) == i);
+            }
+        }
+    };
+    
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threads.emplace_back(work, t);
+    }
+    for (thread& th : threads) {
+        th.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    cerr << name << ", " << threadCount << " threads: " << threadCount * opsPerThread / seconds / 1e6 << " Mops/s, "
+         << map.size() << " keys at the end" << endl;
+}
+
+int concurrentHashMapBenchmark() {
+    vector<CoordKey> keys;
+    for (size_t i = 0; i < (1 << 20); i++) {
+        keys.push_back(CoordKey(static_cast<int32_t>(i / 1024), static_cast<int32_t>(i % 1024)));
+    }
+    
+    unsigned int cores = max(1u, thread::hardware_concurrency());
+    for (unsigned int threadCount = 1; ; threadCount = min(threadCount * 2, cores)) {
+        timeConcurrentMap<LockedHashMap>("ExpandableHashMap + shared_mutex", keys, threadCount);
+        timeConcurrentMap<ConcurrentHashMap<CoordKey, CheckedValue>>("ConcurrentHashMap", keys, threadCount);
+        if (threadCount == cores) {
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Times PointToPointRouter on random origin-destination pairs of mapdata.txt's GeoCoords with each RouteAlgorithm,
+    //      checking every route actually joins its two ends, and is as short as plain A*'s
+int routerBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    PointToPointRouter ptpr(&sm);
+    
+    mt19937 rng(9);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    for (int i = 0; i < 100; i++) {
+        pairs.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+    }
+    
+    const pair<RouteAlgorithm, const char*> algorithms[] = {
+        { ASTAR, "A*" },
+        { BIDIRECTIONAL_ASTAR, "bidirectional A*" },
+    };
+    vector<double> aStarMiles;
+    vector<list<StreetSegment>> aStarRoutes;
+    
+    for (const auto& [algorithm, name] : algorithms) {
+        ptpr.setAlgorithm(algorithm);
+        int found = 0;
+        int sameRoutes = 0;
+        size_t segments = 0;
+        size_t settled = 0;
+        double totalMiles = 0;
+        double worstMs = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t q = 0; q < pairs.size(); q++) {
+            const auto& [from, to] = pairs[q];
+            list<StreetSegment> route;
+            double distanceTravelled = 0;
+            DeliveryResult result = ptpr.generatePointToPointRoute(from, to, route, distanceTravelled);
+            RouteStats stats = ptpr.lastRouteStats();
+            worstMs = max(worstMs, stats.milliseconds);
+            settled += stats.settledNodes;
+            
+            if (result == DELIVERY_SUCCESS) {
+                found++;
+                segments += route.size();
+                totalMiles += distanceTravelled;
+                if (!route.empty()) {
+                    assert(route.front().start == from && route.back().end == to);
+                }
+                for (auto itr = route.begin(); itr != route.end() && next(itr) != route.end(); itr++) {
+                    assert(itr->end == next(itr)->start);
+                }
+            }
+            
+                // Every algorithm must find routes exactly as short as A*'s (if not always the very same ones)
+            if (algorithm == ASTAR) {
+                aStarMiles.push_back(result == DELIVERY_SUCCESS ? distanceTravelled : -1);
+                aStarRoutes.push_back(route);
+            } else {
+                assert(abs((result == DELIVERY_SUCCESS ? distanceTravelled : -1) - aStarMiles[q]) < 1e-9);
+                sameRoutes += (route == aStarRoutes[q]);
+            }
+        }
+        double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        
+        cerr << name << ": " << pairs.size() << " queries, " << found << " routes found, " << segments << " segments, " << totalMiles << " miles";
+        if (algorithm != ASTAR) {
+            cerr << ", " << sameRoutes << " routes identical to A*'s";
+        }
+        cerr << endl << "    average " << totalMs / pairs.size() << " ms per query, worst " << worstMs << " ms, "
+             << settled / pairs.size() << " nodes settled per query" << endl;
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Once a thread's SearchWorkspace has grown to fit, a query should allocate nothing but the route it returns,
+    //      i.e. exactly as much as copying that route does
+int searchAllocationTest() {
+    if (!ALLOCATIONS_COUNTED) {
+        cerr << "searchAllocationTest() needs a build with GOOBER_COUNT_ALLOCATIONS defined." << endl;
+        return 0;
+    }
+    
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    PointToPointRouter ptpr(&sm);
+    
+    mt19937 rng(10);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    for (int i = 0; i < 50; i++) {
+        pairs.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+    }
+    
+    auto runQueries = [&](bool check) {
+        size_t searchAllocations = 0;
+        for (const auto& [from, to] : pairs) {
+            list<StreetSegment> route;
+            double distanceTravelled = 0;
+            size_t before = t_allocations;
+            ptpr.generatePointToPointRoute(from, to, route, distanceTravelled);
+            size_t queryAllocations = t_allocations - before;
+            
+            before = t_allocations;
+            list<StreetSegment> copy = route;
+            size_t copyAllocations = t_allocations - before;
+            
+            assert(!check || queryAllocations == copyAllocations);
+            searchAllocations += queryAllocations - copyAllocations;
+        }
+        return searchAllocations;
+    };
+    
+        // The first pass grows the workspace; after that, searching allocates nothing
+    cerr << "first pass: " << runQueries(false) << " allocations besides the routes" << endl;
+    cerr << "second pass: " << runQueries(true) << " allocations besides the routes" << endl;
+    
+        // A new thread gets a workspace of its own
+    thread([&]() {
+        cerr << "new thread, first pass: " << runQueries(false) << ", second pass: " << runQueries(true) << endl;
+    }).join();
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Writes a side x side grid of streets, each block split into segmentsPerBlock segments as a real street is
+    //      between its intersections, and every point jittered so that no two routes are exactly as long
+void writeSyntheticMap(string mapFile, int side, int segmentsPerBlock) {
+    mt19937 rng(12);
+    uniform_real_distribution<double> jitter(-0.0001, 0.0001);
+    auto text = [&](double lat, double lon) {
+        ostringstream oss;
+        oss.setf(ios::fixed);
+        oss.precision(7);
+        oss << lat + jitter(rng) << " " << lon + jitter(rng);
+        return oss.str();
+    };
+    vector<vector<string>> corners(side, vector<string>(side));
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            corners[r][c] = text(34.0 + r * 0.002, -118.6 + c * 0.002);
+        }
+    }
+    
+    ofstream out(mapFile);
+    for (int horizontal = 1; horizontal >= 0; horizontal--) {
+        for (int i = 0; i < side; i++) {
+            out << (horizontal ? "Row " : "Column ") << i << (horizontal ? " Street" : " Avenue") << endl << (side - 1) * segmentsPerBlock << endl;
+            for (int j = 0; j + 1 < side; j++) {
+                string from = horizontal ? corners[i][j] : corners[j][i];
+                for (int k = 1; k <= segmentsPerBlock; k++) {
+                    double step = (j + static_cast<double>(k) / segmentsPerBlock) * 0.002;
+                    string to = (k == segmentsPerBlock) ? (horizontal ? corners[i][j + 1] : corners[j + 1][i])
+                                                        : (horizontal ? text(34.0 + i * 0.002, -118.6 + step) : text(34.0 + step, -118.6 + i * 0.002));
+                    out << from << " " << to << endl;
+                    from = to;
+                }
+            }
+        }
+    }
+}
+
+// MARK: REMOVE
+    // Preprocesses mapFile into a ContractionHierarchy, round trips it through a file, then times queries on it against
+    //      bidirectional A*, checking every route is as short and actually joins its two ends
+void timeHierarchy(string mapFile, string hierarchyFile, int nQueries) {
+    StreetMap sm;
+    assert(sm.load(mapFile));
+    const StreetGraph& graph = sm.getStreetGraph();
+    
+    auto start = chrono::steady_clock::now();
+    sm.buildContractionHierarchy();
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    const ContractionHierarchy* hierarchy = sm.getContractionHierarchy();
+    cerr << mapFile.substr(mapFile.rfind('/') + 1) << ": " << graph.nodeCount() << " nodes, " << graph.edgeCount() << " edges" << endl;
+    cerr << "    preprocessing took " << buildMs << " ms, adding " << hierarchy->shortcutCount() << " shortcuts ("
+         << hierarchy->memoryUsage() / 1024 << " KB)" << endl;
+    
+    assert(sm.saveContractionHierarchy(hierarchyFile));
+    start = chrono::steady_clock::now();
+    assert(sm.loadContractionHierarchy(hierarchyFile));
+    cerr << "    reloading it took " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    remove(hierarchyFile.c_str());
+    
+    mt19937 rng(12);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    for (int i = 0; i < nQueries; i++) {
+        pairs.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+    }
+    
+    PointToPointRouter ptpr(&sm);
+    const pair<RouteAlgorithm, const char*> algorithms[] = {
+        { BIDIRECTIONAL_ASTAR, "bidirectional A*" },
+        { CONTRACTION_HIERARCHY, "contraction hierarchy" },
+    };
+    vector<double> expectedMiles;
+    for (const auto& [algorithm, name] : algorithms) {
+        ptpr.setAlgorithm(algorithm);
+        size_t settled = 0;
+        double worstMs = 0;
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < pairs.size(); q++) {
+            const auto& [from, to] = pairs[q];
+            list<StreetSegment> route;
+            double distanceTravelled = 0;
+            DeliveryResult result = ptpr.generatePointToPointRoute(from, to, route, distanceTravelled);
+            RouteStats stats = ptpr.lastRouteStats();
+            worstMs = max(worstMs, stats.milliseconds);
+            settled += stats.settledNodes;
+            
+            if (!route.empty()) {
+                assert(route.front().start == from && route.back().end == to);
+            }
+            for (auto itr = route.begin(); itr != route.end() && next(itr) != route.end(); itr++) {
+                assert(itr->end == next(itr)->start);
+            }
+            if (algorithm == BIDIRECTIONAL_ASTAR) {
+                expectedMiles.push_back(result == DELIVERY_SUCCESS ? distanceTravelled : -1);
+            } else {
+                assert(abs((result == DELIVERY_SUCCESS ? distanceTravelled : -1) - expectedMiles[q]) < 1e-9);
+            }
+        }
+        double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "    " << name << ": average " << totalMs / pairs.size() << " ms per query, worst " << worstMs << " ms, "
+             << settled / pairs.size() << " nodes settled per query" << endl;
+    }
+}
+
+// MARK: REMOVE
+int hierarchyBenchmark() {
+    string directory = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    timeHierarchy(directory + "mapdata.txt", directory + "mapdata.ch", 1000);
+    
+    writeSyntheticMap(directory + "syntheticmap.txt", 120, 4);
+    timeHierarchy(directory + "syntheticmap.txt", directory + "syntheticmap.ch", 200);
+    remove((directory + "syntheticmap.txt").c_str());
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Builds each number of landmarks both ways on mapFile and times ALT queries against plain A*, checking every route is as
+    //      short; then checks the landmarks survive a round trip through a snapshot
+void timeLandmarks(string mapFile, string snapshotFile, int nQueries) {
+    StreetMap sm;
+    assert(sm.load(mapFile));
+    const StreetGraph& graph = sm.getStreetGraph();
+    cerr << mapFile.substr(mapFile.rfind('/') + 1) << ": " << graph.nodeCount() << " nodes, " << graph.edgeCount() << " edges, "
+         << 2 * graph.nodeCount() * sizeof(double) / 1024 << " KB of distances per landmark" << endl;
+    
+    mt19937 rng(13);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    for (int i = 0; i < nQueries; i++) {
+        pairs.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+    }
+    
+    PointToPointRouter ptpr(&sm);
+    vector<double> aStarMiles;
+    size_t aStarSettled = 0;
+        // Runs every query with the router's current algorithm, returning the total ms and adding up the nodes settled
+    auto runQueries = [&](size_t& settled) {
+        auto start = chrono::steady_clock::now();
+        for (size_t q = 0; q < pairs.size(); q++) {
+            list<StreetSegment> route;
+            double distanceTravelled = 0;
+            DeliveryResult result = ptpr.generatePointToPointRoute(pairs[q].first, pairs[q].second, route, distanceTravelled);
+            settled += ptpr.lastRouteStats().settledNodes;
+            double miles = (result == DELIVERY_SUCCESS) ? distanceTravelled : -1;
+            if (aStarMiles.size() < pairs.size()) {
+                aStarMiles.push_back(miles);
+            } else {
+                assert(abs(miles - aStarMiles[q]) < 1e-9);
+            }
+        }
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    
+    ptpr.setAlgorithm(ASTAR);
+    double aStarMs = runQueries(aStarSettled);
+    cerr << "    A*: average " << aStarMs / pairs.size() << " ms per query, " << aStarSettled / pairs.size() << " nodes settled per query" << endl;
+    
+    ptpr.setAlgorithm(ALT);
+    const pair<LandmarkSelection, const char*> selections[] = {
+        { FARTHEST_LANDMARKS, "farthest" },
+        { AVOID_LANDMARKS, "avoid" },
+    };
+    for (int count : { 4, 8, 16 }) {
+        for (const auto& [selection, name] : selections) {
+            auto start = chrono::steady_clock::now();
+            sm.buildLandmarks(count, selection);
+            double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            size_t settled = 0;
+            double totalMs = runQueries(settled);
+            cerr << "    ALT, " << graph.landmarkCount() << " " << name << " landmarks (built in " << buildMs << " ms): average "
+                 << totalMs / pairs.size() << " ms per query, " << settled / pairs.size() << " nodes settled per query ("
+                 << 100.0 * settled / aStarSettled << "% of A*'s)" << endl;
+        }
+    }
+    
+        // The last landmarks built go into the snapshot, and must route exactly as they did before
+    size_t settledBefore = 0;
+    runQueries(settledBefore);
+    assert(sm.saveSnapshot(snapshotFile));
+    StreetMap snapshot;
+    assert(snapshot.loadSnapshot(snapshotFile));
+    assert(snapshot.getStreetGraph().landmarkCount() == graph.landmarkCount());
+    PointToPointRouter snapshotRouter(&snapshot);
+    snapshotRouter.setAlgorithm(ALT);
+    size_t settledAfter = 0;
+    for (const auto& [from, to] : pairs) {
+        list<StreetSegment> route;
+        double distanceTravelled = 0;
+        snapshotRouter.generatePointToPointRoute(from, to, route, distanceTravelled);
+        settledAfter += snapshotRouter.lastRouteStats().settledNodes;
+    }
+    assert(settledAfter == settledBefore);
+    remove(snapshotFile.c_str());
+}
+
+// MARK: REMOVE
+int altBenchmark() {
+    string directory = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    timeLandmarks(directory + "mapdata.txt", directory + "mapdata.snap", 1000);
+    
+    writeSyntheticMap(directory + "syntheticmap.txt", 120, 4);
+    timeLandmarks(directory + "syntheticmap.txt", directory + "syntheticmap.snap", 200);
+    remove((directory + "syntheticmap.txt").c_str());
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Runs a repetitive workload (a few depots to a couple of hundred popular places, Zipf distributed, plus some one-off
+    //      trips) on four threads sharing one RouteCache, for a few budgets, checking every route is as long as it is
+    //      without the cache; then checks reloading the map empties the cache
+int routeCacheBenchmark() {
+    string directory = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    StreetMap sm;
+    assert(sm.load(directory + "mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    
+    const int nThreads = 4;
+    const int nQueries = 2000;     // per thread
+    mt19937 rng(14);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<NodeId> depots;
+    vector<NodeId> places;
+    vector<double> placeWeights;
+    for (int i = 0; i < 5; i++) {
+        depots.push_back(randomNode(rng));
+    }
+    for (int i = 0; i < 200; i++) {
+        places.push_back(randomNode(rng));
+        placeWeights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<size_t> randomPlace(placeWeights.begin(), placeWeights.end());
+    uniform_int_distribution<size_t> randomDepot(0, depots.size() - 1);
+    bernoulli_distribution oneOff(0.1);
+    
+    vector<vector<pair<GeoCoord, GeoCoord>>> queries(nThreads);
+    for (auto& threadQueries : queries) {
+        for (int q = 0; q < nQueries; q++) {
+            NodeId from = depots[randomDepot(rng)];
+            NodeId to = oneOff(rng) ? randomNode(rng) : places[randomPlace(rng)];
+            threadQueries.push_back(rng() % 2 ? make_pair(graph.nodeCoord(from), graph.nodeCoord(to)) : make_pair(graph.nodeCoord(to), graph.nodeCoord(from)));
+        }
+    }
+    
+        // Runs every thread's queries at once through cache (or none), checking the lengths against expected if it's filled in
+    vector<vector<double>> expected(nThreads);
+    auto runThreads = [&](RouteCache* cache) {
+        auto start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t]() {
+                PointToPointRouter ptpr(&sm);
+                ptpr.setRouteCache(cache);
+                for (size_t q = 0; q < queries[t].size(); q++) {
+                    list<StreetSegment> route;
+                    double distanceTravelled = 0;
+                    ptpr.generatePointToPointRoute(queries[t][q].first, queries[t][q].second, route, distanceTravelled);
+                    if (expected[t].size() < queries[t].size()) {
+                        expected[t].push_back(distanceTravelled);
+                    } else {
+                        assert(abs(distanceTravelled - expected[t][q]) < 1e-9);
+                    }
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    
+    double uncachedMs = runThreads(nullptr);
+    cerr << nThreads << " threads x " << nQueries << " queries without a cache: " << uncachedMs << " ms" << endl;
+    
+    for (size_t budget : { 64 * 1024, 512 * 1024, 4 * 1024 * 1024 }) {
+        RouteCache cache(budget);
+        double ms = runThreads(&cache);
+        RouteCacheStats stats = cache.stats();
+        assert(stats.bytes <= budget);
+        cerr << "    " << budget / 1024 << " KB cache: " << ms << " ms (" << uncachedMs / ms << "x), " << stats.hits << " hits, "
+             << stats.misses << " misses (" << 100.0 * stats.hits / (stats.hits + stats.misses) << "% hit rate), "
+             << stats.evictions << " evictions, " << stats.entries << " routes in " << stats.bytes / 1024 << " KB" << endl;
+    }
+    
+        // Reloading the map (even with the same contents) gives it a new generation, which empties the cache
+    RouteCache cache(4 * 1024 * 1024);
+    runThreads(&cache);
+    string snapshotFile = directory + "mapdata.cachetest.snap";
+    assert(sm.saveSnapshot(snapshotFile));
+    assert(sm.loadSnapshot(snapshotFile));
+    cache.resetStats();
+    runThreads(&cache);
+    RouteCacheStats stats = cache.stats();
+    assert(stats.invalidations == 1);
+    cerr << "    after reloading the map: " << stats.invalidations << " invalidation, " << stats.misses << " misses, " << stats.hits << " hits" << endl;
+    remove(snapshotFile.c_str());
+    
+        // Loading a different map into the same StreetMap has to empty the cache too, and the routes found afterwards
+        //      have to be the new map's: two tiny maps join the same two GeoCoords by different streets
+    string alphaFile = directory + "cachetest.alpha.txt";
+    string betaFile = directory + "cachetest.beta.txt";
+    ofstream(alphaFile) << "Alpha Street\n2\n34.0000000 -118.0000000 34.0010000 -118.0000000\n"
+                        << "34.0010000 -118.0000000 34.0020000 -118.0000000\n";
+    ofstream(betaFile) << "Beta Road\n2\n34.0000000 -118.0000000 34.0010000 -118.0010000\n"
+                       << "34.0010000 -118.0010000 34.0020000 -118.0000000\n";
+    GeoCoord from("34.0000000", "-118.0000000");
+    GeoCoord to("34.0020000", "-118.0000000");
+    StreetMap smallMap;
+    RouteCache smallCache(64 * 1024);
+    auto cachedRoute = [&](list<StreetSegment>& route) {
+        PointToPointRouter ptpr(&smallMap);
+        ptpr.setRouteCache(&smallCache);
+        double distanceTravelled = 0;
+        assert(ptpr.generatePointToPointRoute(from, to, route, distanceTravelled) == DELIVERY_SUCCESS);
+        return distanceTravelled;
+    };
+    
+    assert(smallMap.load(alphaFile));
+    list<StreetSegment> alphaRoute;
+    double alphaMiles = cachedRoute(alphaRoute);
+    cachedRoute(alphaRoute);
+    assert(smallCache.stats().hits == 1);
+    
+    assert(smallMap.load(betaFile));
+    list<StreetSegment> betaRoute;
+    double betaMiles = cachedRoute(betaRoute);
+    assert(smallCache.stats().invalidations == 1 && smallCache.stats().hits == 1);
+    assert(betaRoute.size() == 2 && betaMiles > alphaMiles);
+    for (const StreetSegment& seg : betaRoute) {
+        assert(seg.name == "Beta Road");
+    }
+    vector<StreetSegment> segs;
+    assert(!smallMap.getSegmentsThatStartWith(GeoCoord("34.0010000", "-118.0000000"), segs));     // only on the alpha map
+    cachedRoute(betaRoute);
+    assert(smallCache.stats().hits == 2);
+    cerr << "    after loading a different map: its streets, and " << smallCache.stats().invalidations << " invalidation" << endl;
+    remove(alphaFile.c_str());
+    remove(betaFile.c_str());
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Times n x n DistanceMatrix computations on random GeoCoords of mapdata.txt, with and without a ContractionHierarchy and on
+    //      one thread or all of them, checking them against each other and against point to point routes
+void timeDistanceMatrix(string mapFile, int n, int nChecks) {
+    StreetMap sm;
+    assert(sm.load(mapFile));
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(15 + n);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<GeoCoord> sources;
+    vector<GeoCoord> targets;
+    for (int i = 0; i < n; i++) {
+        sources.push_back(graph.nodeCoord(randomNode(rng)));
+        targets.push_back(graph.nodeCoord(randomNode(rng)));
+    }
+    
+    DistanceMatrix matrix(&sm);
+    vector<double> expected;
+    auto timeMatrix = [&](const char* name, unsigned int threads) {
+        vector<double> distances;
+        matrix.setThreadCount(threads);
+        auto start = chrono::steady_clock::now();
+        assert(matrix.computeDistances(sources, targets, distances) == DELIVERY_SUCCESS);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "    " << name << (threads == 1 ? ", 1 thread: " : ", all threads: ") << ms << " ms" << endl;
+        if (expected.empty()) {
+            expected = distances;
+        }
+        for (size_t i = 0; i < distances.size(); i++) {
+            assert(distances[i] == expected[i] || abs(distances[i] - expected[i]) < 1e-9);
+        }
+    };
+    
+    cerr << n << " x " << n << " matrix:" << endl;
+    timeMatrix("one Dijkstra per source", 1);
+    timeMatrix("one Dijkstra per source", 0);
+    
+        // Point to point routes for some of the pairs (all of them, for the small matrix)
+    PointToPointRouter ptpr(&sm);
+    ptpr.setAlgorithm(BIDIRECTIONAL_ASTAR);
+    auto start = chrono::steady_clock::now();
+    for (int c = 0; c < nChecks; c++) {
+        size_t i = (nChecks == n * n) ? c : rng() % expected.size();
+        list<StreetSegment> route;
+        double distanceTravelled = 0;
+        DeliveryResult result = ptpr.generatePointToPointRoute(sources[i / n], targets[i % n], route, distanceTravelled);
+        double miles = (result == DELIVERY_SUCCESS) ? distanceTravelled : numeric_limits<double>::infinity();
+        assert(miles == expected[i] || abs(miles - expected[i]) < 1e-9);
+    }
+    double p2pMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cerr << "    " << nChecks << " bidirectional A* point to point routes: " << p2pMs << " ms";
+    if (nChecks < n * n) {
+        cerr << " (" << p2pMs * n * n / nChecks << " ms for the whole matrix)";
+    }
+    cerr << endl;
+    
+    sm.buildContractionHierarchy();
+    timeMatrix("contraction hierarchy buckets", 1);
+    timeMatrix("contraction hierarchy buckets", 0);
+}
+
+// MARK: REMOVE
+int distanceMatrixBenchmark() {
+    string mapFile = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt";
+    cerr << thread::hardware_concurrency() << " threads" << endl;
+    timeDistanceMatrix(mapFile, 50, 50 * 50);
+    timeDistanceMatrix(mapFile, 500, 2000);
+    return 0;
+}
+
+// MARK: REMOVE
+    // Compares StreetGraph::distanceBound() with the haversine distance it stands in for, on random pairs of mapdata.txt's
+    //      GeoCoords: it must never be longer, and should be nearly as long, and much faster. Then counts the straight
+    //      line distances each kind of search works out per query (each was a haversine, 5 trig calls, before the bound;
+    //      adding up the route's length was another per segment), checking every route against plain Dijkstra
+int distanceKernelBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    
+    mt19937 rng(16);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<NodeId, NodeId>> nodePairs;
+    for (int i = 0; i < 1000000; i++) {
+        nodePairs.push_back(make_pair(randomNode(rng), randomNode(rng)));
+    }
+    
+    double haversineSum = 0;
+    auto start = chrono::steady_clock::now();
+    for (const auto& [a, b] : nodePairs) {
+        haversineSum += distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b));
+    }
+    double haversineNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / nodePairs.size();
+    double boundSum = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& [a, b] : nodePairs) {
+        boundSum += graph.distanceBound(a, b);
+    }
+    double boundNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / nodePairs.size();
+    
+    double worstRatio = 1;
+    for (const auto& [a, b] : nodePairs) {
+        double haversine = distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b));
+        double bound = graph.distanceBound(a, b);
+        assert(bound <= haversine);
+        if (haversine > 0) {
+            worstRatio = min(worstRatio, bound / haversine);
+        }
+    }
+        // Every segment too, since that's what keeps A* consistent
+    for (EdgeId e = 0; e < graph.edgeCount(); e++) {
+        assert(graph.distanceBound(graph.edgeSource(e), graph.edgeTarget(e)) <= graph.edgeLength(e));
+    }
+    cerr << "haversine: " << haversineNs << " ns, bound: " << boundNs << " ns (sums " << haversineSum << ", " << boundSum
+         << "); the bound is never shorter than " << worstRatio << " of the haversine distance" << endl;
+    
+    vector<GeoCoord> sources;
+    vector<GeoCoord> targets;
+    for (int i = 0; i < 200; i++) {
+        sources.push_back(graph.nodeCoord(randomNode(rng)));
+        targets.push_back(graph.nodeCoord(randomNode(rng)));
+    }
+    vector<double> exact;
+    DistanceMatrix matrix(&sm);
+    matrix.computeDistances(sources, targets, exact);
+    
+    sm.buildLandmarks(8, FARTHEST_LANDMARKS);
+    PointToPointRouter ptpr(&sm);
+    const pair<RouteAlgorithm, const char*> algorithms[] = {
+        { ASTAR, "A*" },
+        { BIDIRECTIONAL_ASTAR, "bidirectional A*" },
+        { ALT, "ALT, 8 landmarks" },
+    };
+    for (const auto& [algorithm, name] : algorithms) {
+        ptpr.setAlgorithm(algorithm);
+        size_t distances = 0;
+        size_t segments = 0;
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < sources.size(); q++) {
+            list<StreetSegment> route;
+            double distanceTravelled = 0;
+            DeliveryResult result = ptpr.generatePointToPointRoute(sources[q], targets[q], route, distanceTravelled);
+            distances += ptpr.lastRouteStats().straightLineDistances;
+            segments += route.size();
+            double expected = exact[q * targets.size() + q];
+            assert(result == DELIVERY_SUCCESS ? abs(distanceTravelled - expected) < 1e-9 : expected == numeric_limits<double>::infinity());
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / sources.size();
+        cerr << "    " << name << ": average " << ms << " ms per query, " << distances / sources.size()
+             << " straight line distances per query; trig calls per query were " << 5 * (distances + segments) / sources.size()
+             << ", now 0" << endl;
+    }
+    
+    return 0;
+}
+
+    // Converts a text map file into a snapshot file that StreetMap::loadSnapshot() can map in, with landmarkCount
+    //      landmarks for ALT routing (if any) built into it
+int makeSnapshot(string mapFile, string snapshotFile, int landmarkCount)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    if (landmarkCount > 0)
+        sm.buildLandmarks(landmarkCount, FARTHEST_LANDMARKS);
+    if (!sm.saveSnapshot(snapshotFile))
+    {
+        cout << "Unable to write snapshot file " << snapshotFile << endl;
+        return 1;
+    }
+    return 0;
+}
+
+    // Preprocesses a text map file into a ContractionHierarchy file that StreetMap::loadContractionHierarchy() can read
+int makeHierarchy(string mapFile, string hierarchyFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    sm.buildContractionHierarchy();
+    if (!sm.saveContractionHierarchy(hierarchyFile))
+    {
+        cout << "Unable to write hierarchy file " << hierarchyFile << endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
+    if ((argc == 4 || argc == 5) && string(argv[1]) == "--make-snapshot")
+        return makeSnapshot(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : 0);
+    if (argc == 4 && string(argv[1]) == "--make-hierarchy")
+        return makeHierarchy(argv[2], argv[3]);
+    
+
     if (argc == 3)  // MARK: was !=, changed to ==
     {
         cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt" << endl;
@@ -264,3 +1298,838 @@ bool parseDelivery(string line, string& lat, string& lon, string& item)
     }
     return true;
 }
+
+// MARK: REMOVE
+    // The heap a list<StreetSegment> holds onto: a node per segment, and any of its strings too long to be stored inline
+size_t listRouteBytes(const list<StreetSegment>& route) {
+    size_t bytes = 0;
+    for (const StreetSegment& ss : route) {
+        bytes += sizeof(StreetSegment) + 2 * sizeof(void*);
+        for (const string* s : { &ss.start.latitudeText, &ss.start.longitudeText, &ss.end.latitudeText, &ss.end.longitudeText, &ss.name }) {
+            if (s->capacity() > string().capacity()) {
+                bytes += s->capacity() + 1;
+            }
+        }
+    }
+    return bytes;
+}
+
+int compactRouteBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    
+    mt19937 rng(17);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    vector<pair<GeoCoord, GeoCoord>> queries;
+    for (int i = 0; i < 300; i++) {
+        queries.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+    }
+    
+    PointToPointRouter ptpr(&sm);
+    ptpr.setAlgorithm(BIDIRECTIONAL_ASTAR);
+    
+        // The same routes both ways; the searches are identical, so the difference is all in building the route
+    double listMs = 0;
+    double compactMs = 0;
+    size_t listAllocations = 0;
+    size_t compactAllocations = 0;
+    size_t listBytes = 0;
+    size_t compactBytes = 0;
+    size_t segments = 0;
+    CompactRoute compact;
+    for (const auto& [from, to] : queries) {
+        list<StreetSegment> route;
+        double miles = 0;
+        size_t allocations = t_allocations;
+        auto start = chrono::steady_clock::now();
+        if (ptpr.generatePointToPointRoute(from, to, route, miles) != DELIVERY_SUCCESS) {
+            continue;
+        }
+        listMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        listAllocations += t_allocations - allocations;
+        
+        allocations = t_allocations;
+        start = chrono::steady_clock::now();
+        assert(ptpr.generatePointToPointRoute(from, to, compact) == DELIVERY_SUCCESS);
+        compactMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        compactAllocations += t_allocations - allocations;
+        
+            // Both are the same route
+        list<StreetSegment> materialised = compact.toStreetSegments();
+        assert(materialised.size() == route.size() && abs(compact.distance() - miles) < 1e-9);
+        for (auto l = route.begin(), c = materialised.begin(); l != route.end(); l++, c++) {
+            assert(l->start == c->start && l->end == c->end && l->name == c->name);
+        }
+        listBytes += listRouteBytes(route);
+        compactBytes += sizeof(CompactRoute) + compact.size() * sizeof(EdgeId);
+        segments += route.size();
+    }
+    cerr << segments << " segments: list<StreetSegment> " << listMs << " ms, " << listBytes / 1024 << " KB; CompactRoute "
+         << compactMs << " ms, " << compactBytes / 1024 << " KB" << endl;
+    if (ALLOCATIONS_COUNTED) {
+        cerr << "allocations: list<StreetSegment> " << listAllocations << ", CompactRoute " << compactAllocations << endl;
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+void printComponentStats(const StreetGraph& graph) {
+    ComponentStats stats = graph.componentStats();
+    cerr << graph.nodeCount() << " nodes: " << stats.weakComponents << " weak components (largest " << stats.largestWeakComponent
+         << "), " << stats.strongComponents << " strong components (largest " << stats.largestStrongComponent << "), "
+         << stats.isolatedNodes << " isolated nodes" << endl;
+}
+
+int componentBenchmark() {
+    const string dir = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    
+        // mapdata.txt, plus a parking structure that no street leads to
+    {
+        ifstream in(dir + "mapdata.txt");
+        ofstream out(dir + "islandmap.txt");
+        out << in.rdbuf();
+        out << "Parking Structure 8 Ramp" << endl << 3 << endl;
+        out << "34.0800000 -118.5200000 34.0801000 -118.5200000" << endl;
+        out << "34.0801000 -118.5200000 34.0801000 -118.5201000" << endl;
+        out << "34.0801000 -118.5201000 34.0802000 -118.5201000" << endl;
+    }
+    StreetMap sm;
+    auto start = chrono::steady_clock::now();
+    assert(sm.load(dir + "islandmap.txt"));
+    cerr << "load: " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    remove((dir + "islandmap.txt").c_str());
+    const StreetGraph& graph = sm.getStreetGraph();
+    printComponentStats(graph);
+    
+        // The snapshot keeps the components
+    assert(sm.saveSnapshot(dir + "islandmap.snapshot"));
+    StreetMap snapMap;
+    assert(snapMap.loadSnapshot(dir + "islandmap.snapshot"));
+    remove((dir + "islandmap.snapshot").c_str());
+    for (NodeId n = 0; n < graph.nodeCount(); n++) {
+        assert(snapMap.getStreetGraph().weakComponent(n) == graph.weakComponent(n));
+        assert(snapMap.getStreetGraph().strongComponent(n) == graph.strongComponent(n));
+    }
+    
+    GeoCoord island("34.0801000", "-118.5200000");
+    GeoCoord depot("34.0625329", "-118.4470263");
+    assert(!graph.mayReach(graph.findNode(depot), graph.findNode(island)));
+    
+    PointToPointRouter ptpr(&sm);
+    list<StreetSegment> route;
+    double miles = 0;
+    const int nQueries = 1000;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < nQueries; i++) {
+        assert(ptpr.generatePointToPointRoute(depot, island, route, miles) == NO_ROUTE);
+        assert(ptpr.generatePointToPointRoute(island, depot, route, miles) == NO_ROUTE);
+        assert(ptpr.lastRouteStats().settledNodes == 0);
+    }
+    cerr << "NO_ROUTE to or from the island: "
+         << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / (2 * nQueries) << " us" << endl;
+    
+    DeliveryPlanner dp(&sm);
+    vector<DeliveryRequest> deliveries;
+    deliveries.push_back(DeliveryRequest("Chicken tenders", GeoCoord("34.0712323", "-118.4505969")));
+    deliveries.push_back(DeliveryRequest("B-Plate salmon", island));
+    vector<DeliveryCommand> commands;
+    start = chrono::steady_clock::now();
+    assert(dp.generateDeliveryPlan(depot, deliveries, commands, miles) == NO_ROUTE);
+    cerr << "delivery plan with a stop on the island: "
+         << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us" << endl;
+    
+    return 0;
+}
+
+// MARK: REMOVE
+int snapBenchmark() {
+    StreetMap sm;
+    auto start = chrono::steady_clock::now();
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    cerr << "load, grid included: " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    const StreetGraph& graph = sm.getStreetGraph();
+    const SpatialIndex& index = sm.getSpatialIndex();
+    cerr << "grid: " << index.memoryUsage() / 1024 << " KB" << endl;
+    
+        // GPS fixes of orders: near a road, up to about 50 yards off from one of its GeoCoords, in random order
+    mt19937 rng(19);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    uniform_real_distribution<double> jitter(-0.0003, 0.0003);
+    vector<GeoCoord> orders(1000000);
+    for (GeoCoord& gc : orders) {
+        NodeId n = randomNode(rng);
+        gc.latitude = graph.latitude(n) + jitter(rng);
+        gc.longitude = graph.longitude(n) + jitter(rng);
+    }
+        // And points anywhere at all in the map's bounding box, a worst case, since much of it is far from any road
+    double minLatitude = 90, maxLatitude = -90, minLongitude = 180, maxLongitude = -180;
+    for (NodeId n = 0; n < graph.nodeCount(); n++) {
+        minLatitude = min(minLatitude, graph.latitude(n));
+        maxLatitude = max(maxLatitude, graph.latitude(n));
+        minLongitude = min(minLongitude, graph.longitude(n));
+        maxLongitude = max(maxLongitude, graph.longitude(n));
+    }
+    uniform_real_distribution<double> randomLatitude(minLatitude, maxLatitude);
+    uniform_real_distribution<double> randomLongitude(minLongitude, maxLongitude);
+    vector<GeoCoord> anywhere(1000000);
+    for (GeoCoord& gc : anywhere) {
+        gc.latitude = randomLatitude(rng);
+        gc.longitude = randomLongitude(rng);
+    }
+    
+        // Checked against every node and segment for a few hundred of each
+    for (const vector<GeoCoord>* points : { &orders, &anywhere }) {
+        for (size_t i = 0; i < 200; i++) {
+            const GeoCoord& gc = (*points)[i];
+            double nearestMiles = numeric_limits<double>::infinity();
+            for (NodeId n = 0; n < graph.nodeCount(); n++) {
+                nearestMiles = min(nearestMiles, distanceEarthMiles(gc.latitude, gc.longitude, graph.latitude(n), graph.longitude(n)));
+            }
+            double miles;
+            index.nearestNode(gc, &miles);
+            assert(miles <= nearestMiles * (1 + 1e-5) + 1e-9);
+            
+            vector<NodeId> nearest;
+            index.nearestNodes(gc.latitude, gc.longitude, 5, nearest);
+            assert(nearest.size() == 5 && nearest[0] == index.nearestNode(gc));
+            
+            SegmentSnap snap = index.nearestSegment(gc);
+            assert(snap.edge != NO_EDGE && snap.miles <= miles * (1 + 1e-5) + 1e-9);
+            for (EdgeId e = 0; e < graph.edgeCount(); e++) {
+                    // Points all along every segment; none may be nearer than the snap
+                for (int step = 0; step <= 8; step++) {
+                    double t = step / 8.0;
+                    double lat = graph.latitude(graph.edgeSource(e)) + t * (graph.latitude(graph.edgeTarget(e)) - graph.latitude(graph.edgeSource(e)));
+                    double lon = graph.longitude(graph.edgeSource(e)) + t * (graph.longitude(graph.edgeTarget(e)) - graph.longitude(graph.edgeSource(e)));
+                    assert(snap.miles <= distanceEarthMiles(gc.latitude, gc.longitude, lat, lon) * (1 + 1e-5) + 1e-9);
+                }
+            }
+        }
+    }
+    
+    const pair<const vector<GeoCoord>*, const char*> workloads[] = { { &orders, "order GPS fixes" }, { &anywhere, "points anywhere" } };
+    for (const auto& [points, name] : workloads) {
+        start = chrono::steady_clock::now();
+        size_t checksum = 0;
+        for (const GeoCoord& gc : *points) {
+            checksum += index.nearestNode(gc);
+        }
+        double oneByOneMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        
+        vector<NodeId> nodes;
+        start = chrono::steady_clock::now();
+        index.nearestNodes(*points, nodes);
+        double batchMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < points->size(); i += 997) {
+            assert(nodes[i] == index.nearestNode((*points)[i]));
+        }
+        
+        vector<SegmentSnap> snaps;
+        start = chrono::steady_clock::now();
+        index.nearestSegments(*points, snaps);
+        double segmentMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        
+        cerr << "1M " << name << ": nearest node " << oneByOneMs << " ms one by one, " << batchMs << " ms batched; nearest segment "
+             << segmentMs << " ms batched (checksum " << checksum << ")" << endl;
+    }
+    
+        // A delivery a few yards off the road only works once the planner snaps it
+    DeliveryPlanner dp(&sm);
+    GeoCoord depot("34.0625329", "-118.4470263");
+    vector<DeliveryRequest> deliveries;
+    deliveries.push_back(DeliveryRequest("Chicken tenders", GeoCoord("34.0712500", "-118.4506200")));
+    vector<DeliveryCommand> commands;
+    double miles = 0;
+    assert(dp.generateDeliveryPlan(depot, deliveries, commands, miles) == BAD_COORD);
+    dp.setSnapDistance(0.05);
+    assert(dp.generateDeliveryPlan(depot, deliveries, commands, miles) == DELIVERY_SUCCESS);
+    cerr << "snapped delivery: " << commands.size() << " commands, " << miles << " miles" << endl;
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Opens a counter of this thread's last level cache misses, or returns -1 where there isn't one (not Linux, or not
+    //      allowed to read hardware counters, as in most containers)
+int openCacheMissCounter() {
+#ifdef __linux__
+    perf_event_attr attr = {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    return -1;
+#endif
+}
+
+// MARK: REMOVE
+long long readCacheMisses(int counter) {
+    long long misses = -1;
+#ifdef __linux__
+    if (counter >= 0 && read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+        misses = -1;
+    }
+#endif
+    return misses;
+}
+
+// MARK: REMOVE
+    // Rewrites mapFile with its streets in a random order, so that the GeoCoords of a street's neighbours are as scattered
+    //      through the file as they are in an alphabetical map file
+void shuffleStreets(string mapFile) {
+    vector<string> streets;
+    {
+        ifstream in(mapFile);
+        string name;
+        while (getline(in, name)) {
+            string count;
+            getline(in, count);
+            string street = name + "\n" + count + "\n";
+            for (int i = stoi(count); i > 0; i--) {
+                string line;
+                getline(in, line);
+                street += line + "\n";
+            }
+            streets.push_back(street);
+        }
+    }
+    shuffle(streets.begin(), streets.end(), mt19937(20));
+    ofstream out(mapFile);
+    for (const string& street : streets) {
+        out << street;
+    }
+}
+
+// MARK: REMOVE
+    // Loads mapFile with its GeoCoords numbered in file order, then along a Hilbert curve, and times the same A* queries
+    //      on each, counting cache misses where the hardware lets us; every route must be as long either way
+    // How far apart in memory the two ends of the average edge are shows how much nearer neighbours have got
+void timeNodeOrders(string mapFile, int nQueries) {
+    const pair<NodeOrder, const char*> orders[] = { { FILE_ORDER, "file order" }, { HILBERT_ORDER, "Hilbert order" } };
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    vector<double> fileOrderMiles;
+    
+    for (const auto& [order, name] : orders) {
+        StreetMap sm;
+        sm.setNodeOrder(order);
+        auto start = chrono::steady_clock::now();
+        assert(sm.load(mapFile));
+        double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        const StreetGraph& graph = sm.getStreetGraph();
+        
+        if (pairs.empty()) {
+            mt19937 rng(20);
+            uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+            for (int i = 0; i < nQueries; i++) {
+                pairs.push_back(make_pair(graph.nodeCoord(randomNode(rng)), graph.nodeCoord(randomNode(rng))));
+            }
+        }
+        
+        double span = 0;
+        for (EdgeId e = 0; e < graph.edgeCount(); e++) {
+            span += abs(static_cast<double>(graph.edgeTarget(e)) - graph.edgeSource(e));
+        }
+        
+        PointToPointRouter ptpr(&sm);
+        CompactRoute route;
+        int counter = openCacheMissCounter();
+        long long misses = readCacheMisses(counter);
+        size_t settled = 0;
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < pairs.size(); q++) {
+            double miles = -1;
+            if (ptpr.generatePointToPointRoute(pairs[q].first, pairs[q].second, route) == DELIVERY_SUCCESS) {
+                miles = route.distance();
+            }
+            settled += ptpr.lastRouteStats().settledNodes;
+            if (order == FILE_ORDER) {
+                fileOrderMiles.push_back(miles);
+            } else {
+                assert(abs(miles - fileOrderMiles[q]) < 1e-9);
+            }
+        }
+        double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        misses = (misses < 0) ? -1 : readCacheMisses(counter) - misses;
+#ifdef __linux__
+        if (counter >= 0) {
+            close(counter);
+        }
+#endif
+        
+        cerr << "    " << name << ": load " << loadMs << " ms, average edge spans " << span / graph.edgeCount() << " nodes" << endl
+             << "        average " << totalMs / pairs.size() << " ms per query, " << settled / pairs.size() << " nodes settled per query, ";
+        if (misses < 0) {
+            cerr << "cache misses unavailable" << endl;
+        } else {
+            cerr << misses / static_cast<long long>(pairs.size()) << " cache misses per query" << endl;
+        }
+    }
+}
+
+// MARK: REMOVE
+int nodeOrderBenchmark() {
+    string directory = "/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/";
+    cerr << "mapdata.txt:" << endl;
+    timeNodeOrders(directory + "mapdata.txt", 1000);
+    
+    writeSyntheticMap(directory + "syntheticmap.txt", 200, 3);
+    shuffleStreets(directory + "syntheticmap.txt");
+    cerr << "synthetic map, streets shuffled:" << endl;
+    timeNodeOrders(directory + "syntheticmap.txt", 200);
+    remove((directory + "syntheticmap.txt").c_str());
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Optimises batches of random stops from mapdata.txt with the greedy order alone, then with more and more local search,
+    //      reporting the average crow distance of the tours against the time taken
+    // Every order must still visit each stop once, and the search must never make a tour longer
+int tourImprovementBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(21);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    
+    const double unlimited = numeric_limits<double>::infinity();
+    for (size_t stops : { 10, 50, 200 }) {
+        const int nBatches = 50;
+        vector<GeoCoord> depots;
+        vector<vector<DeliveryRequest>> batches;
+        for (int b = 0; b < nBatches; b++) {
+            depots.push_back(graph.nodeCoord(randomNode(rng)));
+            batches.emplace_back();
+            for (size_t i = 0; i < stops; i++) {
+                batches.back().push_back(DeliveryRequest("Stop " + to_string(i), graph.nodeCoord(randomNode(rng))));
+            }
+        }
+        
+        const struct { const char* name; double milliseconds; size_t iterations; } budgets[] = {
+            { "greedy only", unlimited, 0 },
+            { "stops iterations", unlimited, stops },
+            { "4 x stops iterations", unlimited, 4 * stops },
+            { "0.1 ms", 0.1, numeric_limits<size_t>::max() },
+            { "to a local optimum", unlimited, numeric_limits<size_t>::max() },
+        };
+        cerr << stops << " stops:" << endl;
+        double greedyMiles = 0;
+        for (const auto& budget : budgets) {
+            DeliveryOptimizer optimizer(&sm);
+            optimizer.setExactStops(0);
+            optimizer.setSearchTime(budget.milliseconds);
+            optimizer.setSearchIterations(budget.iterations);
+            double totalMiles = 0;
+            double totalMs = 0;
+            for (int b = 0; b < nBatches; b++) {
+                vector<DeliveryRequest> deliveries = batches[b];
+                double oldCrowDistance = 0;
+                double newCrowDistance = 0;
+                auto start = chrono::steady_clock::now();
+                optimizer.optimizeDeliveryOrder(depots[b], deliveries, oldCrowDistance, newCrowDistance);
+                totalMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                totalMiles += newCrowDistance;
+                
+                assert(deliveries.size() == stops && newCrowDistance <= oldCrowDistance);
+                vector<string> items;
+                double miles = 0;
+                GeoCoord prevLoc = depots[b];
+                for (const DeliveryRequest& request : deliveries) {
+                    items.push_back(request.item);
+                    miles += distanceEarthMiles(prevLoc, request.location);
+                    prevLoc = request.location;
+                }
+                miles += distanceEarthMiles(prevLoc, depots[b]);
+                assert(abs(miles - newCrowDistance) < 1e-9);
+                sort(items.begin(), items.end());
+                assert(unique(items.begin(), items.end()) == items.end());
+            }
+            if (budget.iterations == 0) {
+                greedyMiles = totalMiles;
+            }
+            cerr << "    " << budget.name << ": average " << totalMiles / nBatches << " miles ("
+                 << 100 * (totalMiles - greedyMiles) / greedyMiles << "% against greedy), " << totalMs / nBatches << " ms" << endl;
+        }
+    }
+    
+        // The search on its own, to see which moves it makes
+    vector<GeoCoord> locations;
+    for (int i = 0; i < 201; i++) {
+        locations.push_back(graph.nodeCoord(randomNode(rng)));
+    }
+    vector<double> distances(locations.size() * locations.size());
+    for (size_t i = 0; i < locations.size(); i++) {
+        for (size_t j = 0; j < locations.size(); j++) {
+            distances[i * locations.size() + j] = distanceEarthMiles(locations[i], locations[j]);
+        }
+    }
+    vector<uint32_t> tour(locations.size());
+    for (uint32_t i = 0; i < tour.size(); i++) {
+        tour[i] = i;
+    }
+    TourImprover improver(distances.data(), locations.size());
+    double before = TourImprover::tourLength(distances.data(), locations.size(), tour);
+    double after = improver.improve(tour);
+    const TourSearchStats& stats = improver.stats();
+    assert(tour[0] == 0 && after <= before);
+    cerr << "200 stops in file order: " << before << " miles to " << after << " miles in " << stats.milliseconds << " ms, "
+         << stats.iterations << " stops looked at, " << stats.twoOptMoves << " 2-opt, " << stats.orOptMoves << " Or-opt and "
+         << stats.relocateMoves << " relocate moves" << endl;
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Times optimizeDeliveryOrder() on batches of each size up to HELD_KARP_MAX_STOPS, ordered exactly and by the greedy
+    //      order plus local search, to show where exact ordering stops being worth its time
+    // The exact order must never be longer, and must be as short as trying every order for the smallest batches
+int heldKarpBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(22);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    
+    DeliveryOptimizer exact(&sm);
+    exact.setExactStops(HELD_KARP_MAX_STOPS);
+    DeliveryOptimizer heuristic(&sm);
+    heuristic.setExactStops(0);
+    
+    for (size_t stops = 1; stops <= HELD_KARP_MAX_STOPS; stops++) {
+        const int nBatches = (stops <= 12) ? 200 : 20;
+        double exactMs = 0, heuristicMs = 0;
+        double exactMiles = 0, heuristicMiles = 0;
+        int heuristicOptimal = 0;
+        for (int b = 0; b < nBatches; b++) {
+            GeoCoord depot = graph.nodeCoord(randomNode(rng));
+            vector<DeliveryRequest> batch;
+            for (size_t i = 0; i < stops; i++) {
+                batch.push_back(DeliveryRequest("Stop " + to_string(i), graph.nodeCoord(randomNode(rng))));
+            }
+            
+            vector<DeliveryRequest> exactOrder = batch;
+            double oldCrowDistance = 0, exactCrowDistance = 0;
+            auto start = chrono::steady_clock::now();
+            exact.optimizeDeliveryOrder(depot, exactOrder, oldCrowDistance, exactCrowDistance);
+            exactMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            
+            vector<DeliveryRequest> heuristicOrder = batch;
+            double heuristicCrowDistance = 0;
+            oldCrowDistance = 0;
+            start = chrono::steady_clock::now();
+            heuristic.optimizeDeliveryOrder(depot, heuristicOrder, oldCrowDistance, heuristicCrowDistance);
+            heuristicMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            
+            assert(exactCrowDistance <= heuristicCrowDistance + 1e-9);
+            heuristicOptimal += (heuristicCrowDistance <= exactCrowDistance + 1e-9);
+            exactMiles += exactCrowDistance;
+            heuristicMiles += heuristicCrowDistance;
+            
+            if (stops <= 7) {
+                vector<size_t> order(stops);
+                for (size_t i = 0; i < stops; i++) {
+                    order[i] = i;
+                }
+                double best = numeric_limits<double>::infinity();
+                do {
+                    double miles = 0;
+                    GeoCoord prevLoc = depot;
+                    for (size_t i : order) {
+                        miles += distanceEarthMiles(prevLoc, batch[i].location);
+                        prevLoc = batch[i].location;
+                    }
+                    best = min(best, miles + distanceEarthMiles(prevLoc, depot));
+                } while (next_permutation(order.begin(), order.end()));
+                assert(abs(best - exactCrowDistance) < 1e-9);
+            }
+        }
+        cerr << stops << " stops: exact " << exactMs / nBatches << " ms, greedy and local search " << heuristicMs / nBatches
+             << " ms, " << 100 * (heuristicMiles - exactMiles) / exactMiles << "% longer, optimal in "
+             << heuristicOptimal << " of " << nBatches << endl;
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Anneals a catering day's worth of random stops from mapdata.txt with more and more threads and time, reporting how much
+    //      shorter than local search alone the tour gets, and checks that a fixed seed, thread count and number of rounds
+    //      always gives the same order
+int annealingBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(23);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    
+    for (size_t stops : { 200, 500 }) {
+        vector<GeoCoord> locations;
+        for (size_t i = 0; i <= stops; i++) {
+            locations.push_back(graph.nodeCoord(randomNode(rng)));
+        }
+        vector<double> distances(locations.size() * locations.size());
+        for (size_t i = 0; i < locations.size(); i++) {
+            for (size_t j = 0; j < locations.size(); j++) {
+                distances[i * locations.size() + j] = distanceEarthMiles(locations[i], locations[j]);
+            }
+        }
+        vector<uint32_t> localOptimum(locations.size());
+        for (uint32_t i = 0; i < localOptimum.size(); i++) {
+            localOptimum[i] = i;
+        }
+        TourImprover improver(distances.data(), locations.size());
+        double localMiles = improver.improve(localOptimum);
+        cerr << stops << " stops: local search " << localMiles << " miles" << endl;
+        
+        unsigned int cores = max(1u, thread::hardware_concurrency());
+        for (unsigned int threads : { 1u, 2u, 4u, cores }) {
+            for (double milliseconds : { 100.0, 400.0, 1600.0 }) {
+                vector<uint32_t> tour = localOptimum;
+                TourAnnealer annealer(distances.data(), locations.size());
+                double miles = annealer.anneal(tour, milliseconds, numeric_limits<size_t>::max(), threads, 1);
+                const AnnealingStats& stats = annealer.stats();
+                assert(miles <= localMiles && tour[0] == 0);
+                cerr << "    " << threads << " threads, " << milliseconds << " ms: " << miles << " miles ("
+                     << 100 * (miles - localMiles) / localMiles << "%), " << stats.rounds << " rounds, "
+                     << stats.moves / stats.milliseconds / 1000 << "M moves per second" << endl;
+                
+                    // Rerunning with the rounds the time allowed gives the very same tour
+                vector<uint32_t> again = localOptimum;
+                TourAnnealer rerun(distances.data(), locations.size());
+                assert(rerun.anneal(again, numeric_limits<double>::infinity(), stats.rounds, threads, 1) == miles && again == tour);
+            }
+        }
+    }
+    
+        // And through the optimizer, which must give the same order every time for the same settings
+    GeoCoord depot = graph.nodeCoord(randomNode(rng));
+    vector<DeliveryRequest> batch;
+    for (int i = 0; i < 300; i++) {
+        batch.push_back(DeliveryRequest("Tray " + to_string(i), graph.nodeCoord(randomNode(rng))));
+    }
+    vector<string> firstItems;
+    for (int run = 0; run < 2; run++) {
+        DeliveryOptimizer optimizer(&sm);
+        optimizer.setAnnealing(numeric_limits<double>::infinity(), 8, 4, 7);
+        vector<DeliveryRequest> deliveries = batch;
+        double oldCrowDistance = 0, newCrowDistance = 0;
+        optimizer.optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
+        vector<string> items;
+        for (const DeliveryRequest& request : deliveries) {
+            items.push_back(request.item);
+        }
+        assert(run == 0 || items == firstItems);
+        firstItems = items;
+        cerr << "300 stop batch, 8 rounds on 4 threads: " << oldCrowDistance << " miles as given, " << newCrowDistance << " miles annealed" << endl;
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Plans 1,000 random orders of 1 to 3 trays onto 50 vehicles with room for 44 each (about 10% to spare), checking every order goes out on
+    //      exactly one vehicle and none is overloaded, then times routing the vehicles' trips on one thread and on every core
+int fleetBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    sm.buildContractionHierarchy();
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(24);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    uniform_int_distribution<int> randomLoad(1, 3);
+    
+    NodeId depotNode = randomNode(rng);
+    GeoCoord depot = graph.nodeCoord(depotNode);
+    vector<DeliveryRequest> orders;
+    while (orders.size() < 1000) {
+        NodeId node = randomNode(rng);
+        if (graph.mayReach(depotNode, node)) {
+            orders.push_back(DeliveryRequest("Order " + to_string(orders.size()), graph.nodeCoord(node), randomLoad(rng)));
+        }
+    }
+    vector<double> capacities(50, 44);
+    
+        // The split itself, from the same crow-flies matrix the optimizer uses
+    vector<double> distances((orders.size() + 1) * (orders.size() + 1));
+    vector<double> loads(orders.size() + 1, 0);
+    for (size_t i = 0; i <= orders.size(); i++) {
+        const GeoCoord& from = (i == 0) ? depot : orders[i - 1].location;
+        for (size_t j = 0; j <= orders.size(); j++) {
+            distances[i * (orders.size() + 1) + j] = distanceEarthMiles(from, (j == 0) ? depot : orders[j - 1].location);
+        }
+        if (i > 0) {
+            loads[i] = orders[i - 1].load;
+        }
+    }
+    FleetRouter router(distances.data(), loads.data(), orders.size() + 1);
+    vector<vector<uint32_t>> stops;
+    assert(router.route(capacities, stops));
+    const FleetRouterStats& stats = router.stats();
+    cerr << "Fleet router: " << stats.savingsJoins << " savings joins, " << stats.forcedJoins << " forced, "
+         << stats.repairMoves << " repairs; " << stats.savingsMiles << " crow miles after savings, " << stats.miles
+         << " after " << stats.relocateMoves << " relocates and " << stats.swapMoves << " swaps, "
+         << stats.milliseconds << " ms" << endl;
+    
+    auto start = chrono::steady_clock::now();
+    DeliveryOptimizer optimizer(&sm);
+    vector<vector<DeliveryRequest>> routes;
+    double crowMiles = 0;
+    assert(optimizer.optimizeFleet(depot, orders, capacities, routes, crowMiles));
+    cerr << "optimizeFleet: " << crowMiles << " crow miles, "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    
+    vector<int> delivered(orders.size(), 0);
+    for (size_t v = 0; v < routes.size(); v++) {
+        double load = 0;
+        for (const DeliveryRequest& request : routes[v]) {
+            delivered[stoi(request.item.substr(6))]++;
+            load += request.load;
+        }
+        assert(load <= capacities[v]);
+    }
+    assert(count(delivered.begin(), delivered.end(), 1) == static_cast<ptrdiff_t>(orders.size()));
+    
+        // Too little room in the fleet altogether
+    vector<vector<DeliveryCommand>> commands;
+    vector<double> vehicleMiles;
+    double miles = 0;
+    DeliveryPlanner planner(&sm);
+    assert(planner.generateFleetPlan(depot, orders, vector<double>(10, 50), commands, vehicleMiles, miles) == OVER_CAPACITY);
+    
+    unsigned int cores = max(1u, thread::hardware_concurrency());
+    for (unsigned int threads : { 1u, cores }) {
+        planner.setThreadCount(threads);
+        start = chrono::steady_clock::now();
+        assert(planner.generateFleetPlan(depot, orders, capacities, commands, vehicleMiles, miles) == DELIVERY_SUCCESS);
+        size_t nDelivered = 0;
+        for (const vector<DeliveryCommand>& vehicleCommands : commands) {
+            for (const DeliveryCommand& dc : vehicleCommands) {
+                nDelivered += (dc.description().compare(0, 7, "DELIVER") == 0);
+            }
+        }
+        assert(commands.size() == capacities.size() && nDelivered == orders.size());
+        cerr << "generateFleetPlan on " << threads << " threads: " << miles << " miles, "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    }
+    
+    return 0;
+}
+
+// MARK: REMOVE
+    // Orders random batches of mapdata.txt with tight (15 minute) and loose (90 minute) windows, each of which some order
+    //      meets (the windows are laid around the times a good tour gets to each stop), timing the search and how many
+    //      moves a second it scores, against scoring each by driving the whole tour; then plans a batch on the roads
+int timeWindowBenchmark() {
+    StreetMap sm;
+    assert(sm.load("/Users/mmclinton/Google Drive/UCLA/@Winter 20/COM SCI 32/Programming Assignments/Assignment 4/Goober Eats/Goober Eats/mapdata.txt"));
+    sm.buildContractionHierarchy();
+    const StreetGraph& graph = sm.getStreetGraph();
+    mt19937 rng(25);
+    uniform_int_distribution<NodeId> randomNode(0, static_cast<NodeId>(graph.nodeCount() - 1));
+    TravelModel model;
+    double minutesPerMile = model.minutesPerMile() * model.roadFactor;
+    
+    NodeId depotNode = randomNode(rng);
+    GeoCoord depot = graph.nodeCoord(depotNode);
+    vector<DeliveryRequest> plannedBatch;
+    for (size_t stops : { 100, 300 }) {
+        vector<GeoCoord> locations(1, depot);
+        while (locations.size() <= stops) {
+            NodeId node = randomNode(rng);
+            if (graph.mayReach(depotNode, node)) {
+                locations.push_back(graph.nodeCoord(node));
+            }
+        }
+        vector<double> distances(locations.size() * locations.size());
+        for (size_t i = 0; i < locations.size(); i++) {
+            for (size_t j = 0; j < locations.size(); j++) {
+                distances[i * locations.size() + j] = distanceEarthMiles(locations[i], locations[j]);
+            }
+        }
+        vector<uint32_t> reference(locations.size());
+        for (uint32_t i = 0; i < reference.size(); i++) {
+            reference[i] = i;
+        }
+        TourImprover(distances.data(), locations.size()).improve(reference);
+        
+        for (double width : { 15.0, 90.0 }) {
+            uniform_real_distribution<double> offset(0, width);
+            vector<double> earliest(locations.size(), 0), latest(locations.size(), numeric_limits<double>::infinity());
+            double time = 0;
+            for (size_t i = 1; i < reference.size(); i++) {
+                time += distances[reference[i - 1] * locations.size() + reference[i]] * minutesPerMile;
+                earliest[reference[i]] = max(time - offset(rng), 0.0);
+                latest[reference[i]] = earliest[reference[i]] + width;
+            }
+            
+                // The search on its own, from the order of the deadlines
+            TimeWindowImprover improver(distances.data(), locations.size(), minutesPerMile, model.serviceMinutes,
+                                        earliest.data(), latest.data());
+            vector<uint32_t> tour = reference;
+            stable_sort(tour.begin() + 1, tour.end(), [&latest] (uint32_t l1, uint32_t l2) { return latest[l1] < latest[l2]; });
+            vector<double> arrivals;
+            size_t lateBefore = improver.schedule(tour, arrivals);
+            TimeWindowCost cost = improver.improve(tour);
+            const TimeWindowSearchStats& stats = improver.stats();
+            size_t lateAfter = improver.schedule(tour, arrivals);
+            
+            const int nFull = 20000;
+            auto start = chrono::steady_clock::now();
+            double sink = 0;
+            for (int i = 0; i < nFull; i++) {
+                sink += improver.evaluate(tour).timeWarp;
+            }
+            double fullMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / nFull;
+            cerr << stops << " stops, " << width << " minute windows: " << lateBefore << " late in deadline order, "
+                 << lateAfter << " after search (" << cost.timeWarp << " minutes of time warp), " << cost.miles << " crow miles; "
+                 << stats.milliseconds << " ms, " << stats.evaluations / stats.milliseconds / 1000 << "M moves scored per second, "
+                 << stats.twoOptMoves + stats.orOptMoves + stats.swapMoves << " made; driving the tour to score one takes "
+                 << fullMicros << " us" << (sink < 0 ? "!" : "") << endl;
+            
+                // And through the optimizer, from a shuffled batch
+            vector<DeliveryRequest> deliveries;
+            for (size_t i = 1; i < locations.size(); i++) {
+                deliveries.push_back(DeliveryRequest("Order " + to_string(i), locations[i], 1, earliest[i], latest[i]));
+            }
+            shuffle(deliveries.begin(), deliveries.end(), rng);
+            DeliveryOptimizer optimizer(&sm);
+            double oldCrowDistance = 0, newCrowDistance = 0;
+            start = chrono::steady_clock::now();
+            optimizer.optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
+            double optimizeMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            vector<uint32_t> ordered(1, 0);
+            for (const DeliveryRequest& request : deliveries) {
+                ordered.push_back(stoi(request.item.substr(6)));
+            }
+            cerr << "    optimizeDeliveryOrder: " << improver.schedule(ordered, arrivals) << " late, " << newCrowDistance
+                 << " crow miles, " << optimizeMillis << " ms" << endl;
+            if (stops == 100 && width == 90) {
+                plannedBatch = deliveries;
+            }
+        }
+    }
+    
+        // Then on the roads, where the optimizer's guess at how much longer they are than the crow's miles comes in
+    DeliveryPlanner planner(&sm);
+    planner.setTravelModel(model);
+    vector<DeliveryCommand> commands;
+    vector<DeliveryTiming> timings;
+    double miles = 0;
+    assert(planner.generateDeliveryPlan(depot, plannedBatch, commands, miles, timings) == DELIVERY_SUCCESS);
+    assert(timings.size() == plannedBatch.size());
+    size_t late = 0;
+    double mostLate = 0;
+    for (const DeliveryTiming& timing : timings) {
+        late += (timing.minutesLate > 0);
+        mostLate = max(mostLate, timing.minutesLate);
+    }
+    cerr << "Planned on the roads: " << miles << " miles, " << late << " of " << timings.size() << " late, by up to "
+         << mostLate << " minutes" << endl;
+    
+    return 0;
+}
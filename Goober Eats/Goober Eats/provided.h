@@ -8,10 +8,12 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <utility>
+#include <limits>
 
 enum DeliveryResult
 {
-    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD
+    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD, OVER_CAPACITY
 };
 
 struct GeoCoord
@@ -54,7 +56,7 @@ bool operator<(const GeoCoord& lhs, const GeoCoord& rhs)
 struct StreetSegment
 {
     StreetSegment(const GeoCoord& s, const GeoCoord& e, std::string streetName)
-     : start(s), end(e), name(streetName)
+     : start(s), end(e), name(std::move(streetName))
     {}
 
     StreetSegment()
@@ -72,6 +74,25 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
 }
 
 class StreetMapImpl;
+class StreetGraph;
+class SegmentRange;
+class ContractionHierarchy;
+class SpatialIndex;
+class RouteCache;
+
+    // How StreetMap::buildLandmarks() chooses its landmarks (see Landmarks.h)
+enum LandmarkSelection
+{
+    FARTHEST_LANDMARKS,     // each one as far by road as possible from those already chosen
+    AVOID_LANDMARKS         // each one where the bounds from those already chosen are worst
+};
+
+    // How StreetMap::load() numbers the GeoCoords of the map
+enum NodeOrder
+{
+    HILBERT_ORDER,          // along a Hilbert curve over the map, so GeoCoords near each other are near each other in memory (the default)
+    FILE_ORDER              // in the order they first appear in the map file
+};
 
 class StreetMap
 {
@@ -79,7 +100,28 @@ public:
     StreetMap();
     ~StreetMap();
     bool load(std::string mapFile);
+      // How the next load() numbers the map's GeoCoords; snapshots keep whatever order the map they were saved from had
+    void setNodeOrder(NodeOrder order);
+      // Write the loaded map to a binary snapshot file, and map one back in (much faster than load())
+    bool saveSnapshot(std::string snapshotFile) const;
+    bool loadSnapshot(std::string snapshotFile);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // Same, but gives a view of the stored segments instead of copies (see StreetGraph.h)
+    bool getSegmentsThatStartWith(const GeoCoord& gc, SegmentRange& segs) const;
+      // The compact graph built by load(), for code that walks the map by node and edge IDs
+    const StreetGraph& getStreetGraph() const;
+      // Choose count landmarks and work out every GeoCoord's distance to and from them, for ALT routing
+      // They are saved in (and loaded with) snapshots; loading a map file drops them
+    void buildLandmarks(int count, LandmarkSelection selection);
+      // Preprocess the loaded map into a ContractionHierarchy for fast routing (see ContractionHierarchy.h),
+      // and write it to, or read it back from, a file kept next to the map
+    void buildContractionHierarchy();
+    bool saveContractionHierarchy(std::string hierarchyFile) const;
+    bool loadContractionHierarchy(std::string hierarchyFile);
+      // The hierarchy built or loaded for the current map, or nullptr if there isn't one
+    const ContractionHierarchy* getContractionHierarchy() const;
+      // A grid over the loaded map for finding the GeoCoords and segments nearest to any coordinates (see SpatialIndex.h)
+    const SpatialIndex& getSpatialIndex() const;
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -88,6 +130,26 @@ private:
 };
 
 class PointToPointRouterImpl;
+class CompactRoute;
+
+    // The searches a PointToPointRouter can use; they all find a shortest route
+enum RouteAlgorithm
+{
+    ASTAR,                  // A* from the start towards the end (the default)
+    BIDIRECTIONAL_ASTAR,    // A* forwards from the start and backwards from the end at once, meeting in the middle
+    ALT,                    // A* bounded by the map's landmarks as well as the straight line distance (plain A* if it has none)
+    CONTRACTION_HIERARCHY   // a search of the map's ContractionHierarchy (bidirectional A* if the map doesn't have one)
+};
+
+    // What generating one route took
+struct RouteStats
+{
+    size_t settledNodes = 0;        // nodes whose shortest distance the search settled, in either direction
+    size_t relaxedEdges = 0;        // segments (or shortcuts) the search looked along
+    size_t straightLineDistances = 0;   // straight line distances worked out for the search's heuristic
+    double milliseconds = 0;
+    bool fromCache = false;         // the route came out of a RouteCache, without a search
+};
 
 class PointToPointRouter
 {
@@ -99,6 +161,21 @@ public:
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // The same route as its segments' EdgeIds (see CompactRoute.h), with its length in route.distance()
+      // Nothing is allocated once route has grown to fit, and no StreetSegment strings are made
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        CompactRoute& route) const;
+    void setAlgorithm(RouteAlgorithm algorithm);
+      // Look routes up in cache before searching, and store the ones searched for there (see RouteCache.h)
+      // The cache may be shared with other routers, on other threads; nullptr (the default) turns caching off
+    void setRouteCache(RouteCache* cache);
+      // A start or end that isn't a GeoCoord in the map is moved to the nearer end of the nearest segment, if that segment
+      //      passes within maxMiles of it (see SpatialIndex::snap()); 0 (the default) means they must be in the map
+    void setSnapDistance(double maxMiles);
+      // The stats of the last route this thread generated with any PointToPointRouter
+    RouteStats lastRouteStats() const;
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -106,13 +183,60 @@ private:
     PointToPointRouterImpl* m_impl;
 };
 
+class DistanceMatrixImpl;
+
+    // Road distances between every one of a set of sources and every one of a set of targets, worked out with
+    //      one search per source (or per source and target, with a ContractionHierarchy) instead of one per pair
+class DistanceMatrix
+{
+public:
+    DistanceMatrix(const StreetMap* sm);
+    ~DistanceMatrix();
+      // Fills in distances, source by source, with the length in miles of the shortest route from each source to each
+      //      target: distances[s * targets.size() + t], or infinity where there is no route
+      // Returns BAD_COORD (and leaves distances alone) if any of the GeoCoords isn't in the map
+    DeliveryResult computeDistances(
+        const std::vector<GeoCoord>& sources,
+        const std::vector<GeoCoord>& targets,
+        std::vector<double>& distances) const;
+      // How many threads the searches are spread over; 0 (the default) means one per core
+    void setThreadCount(unsigned int threads);
+      // We prevent a DistanceMatrix object from being copied or assigned.
+    DistanceMatrix(const DistanceMatrix&) = delete;
+    DistanceMatrix& operator=(const DistanceMatrix&) = delete;
+private:
+    DistanceMatrixImpl* m_impl;
+};
+
 struct DeliveryRequest
 {
-    DeliveryRequest(std::string it, const GeoCoord& loc)
-     : item(it), location(loc)
+    DeliveryRequest(std::string it, const GeoCoord& loc, double ld = 1,
+                    double early = 0, double late = std::numeric_limits<double>::infinity())
+     : item(it), location(loc), load(ld), earliest(early), latest(late)
     {}
     std::string item;
     GeoCoord location;
+    double load;        // how much of a vehicle's capacity the item takes up, for fleet plans
+    double earliest;    // the window the delivery was promised in, in minutes after the courier leaves the depot
+    double latest;
+};
+
+  // How fast couriers get around, for deliveries with time windows: mapdata.txt has nothing to tell one street from
+  //      another by, so every street is driven at the same speed
+struct TravelModel
+{
+    double milesPerHour = 20;
+    double serviceMinutes = 0;      // spent at each delivery
+    double roadFactor = 2.0;        // road miles per mile as the crow flies, for the optimizer, which only has the crow's (about 2 on mapdata.txt)
+    double minutesPerMile() const { return 60 / milesPerHour; }
+};
+
+  // When a delivery in a plan gets there
+struct DeliveryTiming
+{
+    std::string item;
+    double arrival;         // minutes after leaving the depot
+    double minutesLate;     // after the request's latest; 0 if it's on time
 };
 
 class DeliveryOptimizerImpl;
@@ -127,6 +251,29 @@ public:
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // Batches of up to maxStops deliveries (12 by default, at most 16) are put in the shortest order there is, by dynamic
+      //      programming (see HeldKarp.h); 0 turns this off
+    void setExactStops(size_t maxStops);
+      // Bigger batches get a greedy order, which is then improved with local search (see TourImprover.h) until no move shortens it, or it runs out
+      //      of time or has looked at iterations stops; there is no limit on either by default, and 0 iterations skips it
+    void setSearchTime(double milliseconds);
+    void setSearchIterations(size_t iterations);
+      // After local search, anneal those batches on threads chains at once (0 means one per core; see TourAnnealer.h),
+      //      for up to rounds rounds or milliseconds, whichever ends first; 0 rounds (the default) turns annealing off
+      // For the same seed and threads, the same number of rounds always gives the same order
+    void setAnnealing(double milliseconds, size_t rounds, unsigned int threads, unsigned long long seed);
+      // If any delivery in a batch has a time window, the batch is ordered to be as little late as it can first and as short
+      //      as it can second, travel times coming from model (see TimeWindowImprover.h); search time and iterations are as above
+    void setTravelModel(const TravelModel& model);
+      // Splits deliveries between vehicles, vehicle v carrying at most capacities[v] of load, and orders each vehicle's
+      //      share as optimizeDeliveryOrder() would (see FleetRouter.h); routes[v] is vehicle v's, and may be empty
+      // Returns false, leaving routes empty, if the deliveries can't be fitted into the vehicles
+    bool optimizeFleet(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        const std::vector<double>& capacities,
+        std::vector<std::vector<DeliveryRequest>>& routes,
+        double& crowDistance) const;
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -220,6 +367,32 @@ public:
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // As above, also filling in timings with when each delivery gets there, in the order delivered, on the map's
+      //      roads at the travel model's speed
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled,
+        std::vector<DeliveryTiming>& timings) const;
+      // Splits deliveries between vehicles, vehicle v carrying at most capacities[v] (see DeliveryOptimizer::optimizeFleet()),
+      //      and plans each vehicle's trip from the depot and back; commands[v] and vehicleDistances[v] are vehicle v's
+      // Returns OVER_CAPACITY if the deliveries don't fit in the vehicles
+    DeliveryResult generateFleetPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        const std::vector<double>& capacities,
+        std::vector<std::vector<DeliveryCommand>>& commands,
+        std::vector<double>& vehicleDistances,
+        double& totalDistanceTravelled) const;
+      // How many threads a fleet plan's vehicles are routed on; 0 (the default) means one per core
+    void setThreadCount(unsigned int threads);
+      // How fast couriers get around, for deliveries with time windows (see DeliveryOptimizer::setTravelModel())
+    void setTravelModel(const TravelModel& model);
+      // Route through cache (see PointToPointRouter::setRouteCache())
+    void setRouteCache(RouteCache* cache);
+      // Route from and to the nearest road for a depot or delivery that isn't in the map (see PointToPointRouter::setSnapDistance())
+    void setSnapDistance(double maxMiles);
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;